@@ -0,0 +1,72 @@
+# Compile GLSL shaders with glslc and embed the SPIR-V into the executable.
+#
+# embed_spirv_shaders(<target> <shader>...) :
+#   shaders/shader.vert -> ${CMAKE_CURRENT_BINARY_DIR}/shaders/shader.vert.spv (glslc)
+#                       -> ${CMAKE_CURRENT_BINARY_DIR}/generated/shaders/shader_vert.h (this file in script mode)
+#   and generated/Shaders.h including all of them, so the code can use
+#       #include "Shaders.h"
+#       shaders::shader_vert  // constexpr uint32_t[], the SPIR-V words
+#
+# Script mode (used by the build step above) :
+#   cmake -DSPIRV_INPUT=<file.spv> -DSPIRV_OUTPUT=<file.h> -DSPIRV_SYMBOL=<name> -P EmbedSpirv.cmake
+
+if(CMAKE_SCRIPT_MODE_FILE)
+    file(READ "${SPIRV_INPUT}" spirv_hex HEX)
+    string(LENGTH "${spirv_hex}" spirv_hex_length)
+    math(EXPR spirv_remainder "${spirv_hex_length} % 8")
+    if(spirv_hex_length EQUAL 0 OR NOT spirv_remainder EQUAL 0)
+        message(FATAL_ERROR "${SPIRV_INPUT} is not a SPIR-V module (size is not a multiple of 4 bytes)")
+    endif()
+    # SPIR-V words are little endian in the file : bytes aa bb cc dd -> 0xddccbbaa
+    string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1," spirv_words "${spirv_hex}")
+    # 8 words per line
+    string(REPEAT "0x........," 8 spirv_line)
+    string(REGEX REPLACE "(${spirv_line})" "\\1\n    " spirv_words "${spirv_words}")
+    file(WRITE "${SPIRV_OUTPUT}"
+        "// Generated from ${SPIRV_INPUT} by cmake/EmbedSpirv.cmake, do not edit\n"
+        "#pragma once\n\n"
+        "#include <cstdint>\n\n"
+        "namespace shaders\n{\n"
+        "constexpr uint32_t ${SPIRV_SYMBOL}[] = {\n    ${spirv_words}\n};\n"
+        "} // namespace shaders\n")
+    return()
+endif()
+
+find_program(GLSLC_EXECUTABLE glslc HINTS "$ENV{VULKAN_SDK}/bin" "$ENV{VULKAN_SDK}/Bin")
+if(NOT GLSLC_EXECUTABLE)
+    message(FATAL_ERROR "glslc not found, it is needed to compile the shaders (install the Vulkan SDK or shaderc)")
+endif()
+
+set(EMBED_SPIRV_SCRIPT "${CMAKE_CURRENT_LIST_FILE}")
+
+function(embed_spirv_shaders target)
+    set(generated_dir "${CMAKE_CURRENT_BINARY_DIR}/generated")
+    set(headers)
+    set(includes "")
+    foreach(shader ${ARGN})
+        get_filename_component(shader_name "${shader}" NAME)
+        string(MAKE_C_IDENTIFIER "${shader_name}" symbol)
+        set(spirv "${CMAKE_CURRENT_BINARY_DIR}/shaders/${shader_name}.spv")
+        set(header "${generated_dir}/shaders/${symbol}.h")
+        add_custom_command(
+            OUTPUT "${header}"
+            COMMAND "${CMAKE_COMMAND}" -E make_directory "${CMAKE_CURRENT_BINARY_DIR}/shaders" "${generated_dir}/shaders"
+            COMMAND "${GLSLC_EXECUTABLE}" --target-env=vulkan1.0 -O -o "${spirv}" "${shader}"
+            COMMAND "${CMAKE_COMMAND}" -DSPIRV_INPUT=${spirv} -DSPIRV_OUTPUT=${header} -DSPIRV_SYMBOL=${symbol}
+                    -P "${EMBED_SPIRV_SCRIPT}"
+            MAIN_DEPENDENCY "${shader}"
+            DEPENDS "${EMBED_SPIRV_SCRIPT}"
+            BYPRODUCTS "${spirv}"
+            COMMENT "Compiling and embedding ${shader_name}"
+            VERBATIM)
+        list(APPEND headers "${header}")
+        string(APPEND includes "#include \"shaders/${symbol}.h\"\n")
+    endforeach()
+
+    # the list of shaders is known at configure time, the aggregate header only changes with it
+    file(CONFIGURE OUTPUT "${generated_dir}/Shaders.h"
+        CONTENT "// Generated by cmake/EmbedSpirv.cmake, do not edit\n#pragma once\n\n${includes}")
+
+    target_sources(${target} PRIVATE ${headers})
+    target_include_directories(${target} PRIVATE "${generated_dir}")
+endfunction()
@@ -0,0 +1,16 @@
+#ifndef _CAMERAINTRINSICS_H_
+#define _CAMERAINTRINSICS_H_
+
+/*Pinhole camera model of the depth camera, the color image is expected to be registered to the depth image*/
+struct CameraIntrinsics
+{
+    float fx = 0.0f;
+    float fy = 0.0f;
+    float cx = 0.0f;
+    float cy = 0.0f;
+    float depthScale = 0.001f; // meters per unit of a 16-bit depth image (1mm for most sensors), unused for float depth
+    float minDepth = 0.1f;     // valid depth range in meters, 0 / NaN / out of range pixels are skipped
+    float maxDepth = 10.0f;
+};
+
+#endif // _CAMERAINTRINSICS_H_
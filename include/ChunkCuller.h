@@ -0,0 +1,94 @@
+#ifndef _CHUNKCULLER_H_
+#define _CHUNKCULLER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_core.h>
+
+#include "MemoryAllocator.h"
+#include "PipelineCache.h"
+#include "Vertex.h"
+
+/*
+GPU frustum culling of the draw list (shaders/cull.comp).
+Every chunk of the draw list has a bounding box. Each frame a compute pass tests them against the current mvp and
+writes the VkDrawIndexedIndirectCommand of the visible ones into the frame slot's draw buffer, the CPU does nothing per
+chunk. How they are drawn depends on the device :
+ - VK_KHR_draw_indirect_count : the visible draws are compacted, vkCmdDrawIndexedIndirectCountKHR reads the count.
+ - multiDrawIndirect only : one vkCmdDrawIndexedIndirect over all chunks, culled ones have instanceCount 0.
+ - neither : one vkCmdDrawIndexedIndirect per chunk, still culled on the GPU.
+*/
+class ChunkCuller
+{
+public:
+    static const uint32_t WORKGROUP_SIZE = 64; // local_size_x of the shader
+
+    /*mirrors struct Chunk of the shader*/
+    struct Chunk
+    {
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t pad0;
+        uint32_t pad1;
+    };
+
+    /* bounds of chunks from the vertices their index range references, firstIndex / indexCount must be set */
+    static void computeBounds(std::vector<Chunk>& chunks, const std::vector<Vertex>& vertices,
+        const std::vector<uint32_t>& indices);
+
+    /* drawIndirectCount : vkCmdDrawIndexedIndirectCountKHR if the extension is enabled, else nullptr.
+     * multiDrawIndirect : the feature is enabled and maxDrawIndirectCount allows a draw per chunk */
+    void init(VkDevice device, MemoryAllocator* allocator, uint32_t framesInFlight, const std::vector<Chunk>& chunks,
+        VkShaderModule cullShader, PipelineCache* pipelineCache,
+        PFN_vkCmdDrawIndexedIndirectCountKHR drawIndirectCount, bool multiDrawIndirect);
+    void destroy();
+
+    /* resets the count, culls, and makes the draws visible to the indirect draw. Outside of a render pass */
+    void recordCull(VkCommandBuffer commandBuffer, uint32_t slot, const glm::mat4& mvp);
+    /* the draws of the slot, inside the render pass with the graphics pipeline and buffers bound */
+    void recordDraw(VkCommandBuffer commandBuffer, uint32_t slot) const;
+
+    uint32_t chunkCount() const { return static_cast<uint32_t>(chunkTotal); }
+
+private:
+    /*mirrors the push constants of the shader*/
+    struct Params
+    {
+        glm::mat4 mvp;
+        uint32_t chunkCount;
+        uint32_t compact;
+    };
+
+    struct Slot
+    {
+        VkBuffer drawBuffer = VK_NULL_HANDLE; // one VkDrawIndexedIndirectCommand per chunk
+        Allocation drawMemory;
+        VkBuffer countBuffer = VK_NULL_HANDLE;
+        Allocation countMemory;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    };
+
+    void createPipeline(VkShaderModule cullShader, PipelineCache* pipelineCache);
+    void createDescriptors();
+
+    VkDevice device = VK_NULL_HANDLE;
+    MemoryAllocator* allocator = nullptr;
+    size_t chunkTotal = 0;
+    PFN_vkCmdDrawIndexedIndirectCountKHR drawIndirectCount = nullptr;
+    bool multiDraw = false;
+
+    VkBuffer chunkBuffer = VK_NULL_HANDLE; // the Chunks, written once
+    Allocation chunkMemory;
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::vector<Slot> slots;
+};
+
+#endif // _CHUNKCULLER_H_
@@ -0,0 +1,34 @@
+#ifndef _DELETIONQUEUE_H_
+#define _DELETIONQUEUE_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+/*
+Destruction of objects the GPU may still be using, deferred until the frames that could reference them completed.
+Frames are counted in submission order : push(frames, ...) with the number of frames submitted so far, collect(frames)
+with the number of frames known to be complete (a frame fence signalled, and with it every earlier submission on the
+queue). Nothing here waits, the render thread calls collect() once per frame after its fence wait.
+*/
+class DeletionQueue
+{
+public:
+    /* destroy runs once the first submittedFrames frames completed */
+    void push(uint64_t submittedFrames, std::function<void()> destroy);
+    /* runs every entry whose frames completed, in push order */
+    void collect(uint64_t completedFrames);
+    /* runs everything, the device must be idle */
+    void flush();
+    bool empty() const { return entries.empty(); }
+
+private:
+    struct Entry
+    {
+        uint64_t frames;
+        std::function<void()> destroy;
+    };
+    std::deque<Entry> entries; // frames is non decreasing
+};
+
+#endif // _DELETIONQUEUE_H_
@@ -0,0 +1,101 @@
+#ifndef _DEPTHPROJECTOR_H_
+#define _DEPTHPROJECTOR_H_
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "CameraIntrinsics.h"
+#include "MemoryAllocator.h"
+#include "PipelineCache.h"
+
+/*
+GPU depth back-projection (shaders/depth_to_points.comp).
+Only the raw 16-bit depth and the 8-bit color of a frame are sent to the GPU (5 bytes per pixel instead of a 24 byte
+Vertex). Each frame slot owns:
+ - a host visible input buffer : parameters (intrinsics), depth, color. Written by the CPU with memcpy.
+ - a device local vertex buffer the compute shader appends the valid points to.
+ - a VkDrawIndirectCommand whose vertexCount is the append counter, the draw uses it directly so the CPU never
+   needs to know how many points there are. Point i is vertex i, no index buffer is needed.
+The dispatch and its barriers are recorded in front of the render pass of each slot, see recordDispatch().
+*/
+class DepthProjector
+{
+public:
+    static const uint32_t WORKGROUP_SIZE = 16;         // local_size_x / local_size_y of the shader
+    static const VkDeviceSize SECTION_ALIGNMENT = 256; // largest minStorageBufferOffsetAlignment allowed by the spec
+
+    /* frame size, fixes the input buffer layout. Call before submitFrame() and init() */
+    void setExtent(uint32_t width, uint32_t height);
+    void init(VkDevice device, MemoryAllocator* allocator, uint32_t framesInFlight, VkShaderModule computeShader,
+        PipelineCache* pipelineCache);
+    void destroy();
+
+    /* keeps a copy of the frame, every slot picks it up in prepareFrame(). colorChannels : 3 (BGR) or 4 (BGRA).
+     * Safe to call from any thread */
+    void submitFrame(const uint16_t* depth, const uint8_t* color, uint32_t colorChannels,
+        const CameraIntrinsics& intrinsics);
+
+    /* call once the fence of slot signalled, copies the latest frame into the slot if it has not seen it yet */
+    void prepareFrame(uint32_t slot);
+
+    /* reset the counter, dispatch, and make the results visible to vertex input and indirect draws. Outside of a
+     * render pass */
+    void recordDispatch(VkCommandBuffer commandBuffer, uint32_t slot);
+
+    VkBuffer vertexBuffer(uint32_t slot) const { return slots[slot].vertexBuffer; }
+    VkBuffer indirectBuffer(uint32_t slot) const { return slots[slot].indirectBuffer; }
+    uint32_t pixelCount() const { return width * height; }
+
+private:
+    /*mirrors the Params block of the shader*/
+    struct Params
+    {
+        float fx, fy, cx, cy;
+        float depthScale, minDepth, maxDepth;
+        uint32_t width, height, colorChannels;
+    };
+
+    struct Slot
+    {
+        VkBuffer inputBuffer = VK_NULL_HANDLE;
+        Allocation inputMemory;
+        VkBuffer vertexBuffer = VK_NULL_HANDLE;
+        Allocation vertexMemory;
+        VkBuffer indirectBuffer = VK_NULL_HANDLE;
+        Allocation indirectMemory;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        uint64_t generation = 0; // latest frame copied into inputBuffer
+    };
+
+    void createPipeline(VkShaderModule computeShader, PipelineCache* pipelineCache);
+    void createDescriptors();
+
+    VkDevice device = VK_NULL_HANDLE;
+    MemoryAllocator* allocator = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    /*sections of an input buffer, aligned to SECTION_ALIGNMENT*/
+    VkDeviceSize depthOffset = 0;
+    VkDeviceSize depthSize = 0;
+    VkDeviceSize colorOffset = 0;
+    VkDeviceSize colorSize = 0;
+    VkDeviceSize inputSize = 0;
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::vector<Slot> slots;
+
+    /*the most recent frame, in the input buffer layout*/
+    std::mutex frameMutex;
+    std::vector<uint8_t> latestFrame;
+    uint64_t latestGeneration = 0;
+};
+
+#endif // _DEPTHPROJECTOR_H_
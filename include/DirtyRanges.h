@@ -0,0 +1,33 @@
+#ifndef _DIRTYRANGES_H_
+#define _DIRTYRANGES_H_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/*Half open range [begin, end) of elements*/
+struct Range
+{
+    uint64_t begin = 0;
+    uint64_t end = 0;
+};
+
+/*
+Set of modified element ranges. Overlapping and touching ranges are merged on insertion, so the set always holds
+disjoint ranges sorted by begin and take() returns the minimal list of copies to make.
+*/
+class DirtyRanges
+{
+public:
+    void add(uint64_t begin, uint64_t end);
+    void addAll(uint64_t count) { add(0, count); }
+    bool empty() const { return ranges.empty(); }
+    uint64_t dirtyCount() const; // total number of dirty elements
+    /* returns the ranges and clears the set */
+    std::vector<Range> take();
+
+private:
+    std::map<uint64_t, uint64_t> ranges; // begin -> end
+};
+
+#endif // _DIRTYRANGES_H_
@@ -0,0 +1,22 @@
+#ifndef _DRAWLIST_H_
+#define _DRAWLIST_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+/*One draw of the draw list : a range of the index buffer (of the vertex buffer for non indexed geometry)*/
+struct DrawChunk
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+/*
+Cuts count indices in chunks of about chunkIndices indices (whole primitives), one draw each. Strips and fans can not
+be cut, they stay one draw.
+*/
+std::vector<DrawChunk> splitDrawList(uint32_t count, VkPrimitiveTopology topology, uint32_t chunkIndices);
+
+#endif // _DRAWLIST_H_
@@ -0,0 +1,105 @@
+#ifndef _FRAMEINGEST_H_
+#define _FRAMEINGEST_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "SpscQueue.h"
+
+/*One decoded RGB-D frame, registered color and depth of the same size*/
+struct IngestedFrame
+{
+    cv::Mat color;      // 8-bit BGR, continuous
+    cv::Mat depth;      // 16-bit, continuous
+    uint64_t index = 0; // position in the source
+};
+
+/*Counters of a FrameIngest, readable from any thread*/
+struct IngestStats
+{
+    uint64_t decoded = 0;       // frames pushed by the decoder thread
+    uint64_t consumed = 0;      // frames handed to the renderer
+    uint64_t dropped = 0;       // decoded, then skipped by the renderer because a newer frame was there
+    size_t queueDepth = 0;      // frames waiting right now
+    size_t maxQueueDepth = 0;   // most frames the renderer ever found waiting
+    double lastDecodeMs = 0.0;  // decode (and read) time of the latest frame
+    double averageDecodeMs = 0.0;
+};
+
+/*
+Producer / consumer frame ingest : a recorded RGB-D stream is decoded off the render thread.
+The decoder thread reads the source at its frame rate and pushes each frame into a bounded SpscQueue (it waits while
+the queue is full). The render thread calls takeLatest() once per rendered frame : it keeps the most recent frame and
+drops the older ones, a renderer that fell behind catches up at once instead of replaying the backlog.
+
+Sources :
+ - a video file (cv::VideoCapture), color only : every pixel gets the same depth (a flat plane).
+ - a directory with a color/ (or rgb/) and a depth/ subdirectory, images paired by sorted file name. Depth images are
+   16-bit.
+*/
+class FrameIngest
+{
+public:
+    static const size_t DEFAULT_QUEUE_CAPACITY = 4;
+
+    explicit FrameIngest(size_t queueCapacity = DEFAULT_QUEUE_CAPACITY);
+    FrameIngest(const FrameIngest&) = delete;
+    FrameIngest& operator=(const FrameIngest&) = delete;
+    ~FrameIngest() { stop(); }
+
+    /* reads the first frame to know the extent, the decoder is not started yet. constantDepth : the depth of a video
+     * (unused for image pairs). false if the source can not be read, the reason is printed */
+    bool open(const std::string& source, uint16_t constantDepth = 1000);
+    uint32_t width() const { return frameWidth; }
+    uint32_t height() const { return frameHeight; }
+    /* the rate of the source : the frame rate of a video, 30 for images */
+    double sourceFps() const { return fps; }
+
+    /* starts the decoder thread, paced at fps frames per second (0 : sourceFps()) */
+    void start(double pacingFps = 0.0);
+    /* joins the decoder thread */
+    void stop();
+    /* the decoder reached the end of the source (or failed) and every frame has been taken or dropped */
+    bool finished() const { return decoderDone.load(std::memory_order_acquire) && queue.size() == 0; }
+
+    /* render thread only : the most recent frame, older waiting frames are dropped. false if nothing new arrived */
+    bool takeLatest(IngestedFrame& frame);
+    IngestStats stats() const;
+
+private:
+    void decodeLoop();
+    /* next frame of the source, false at the end */
+    bool decode(IngestedFrame& frame);
+
+    SpscQueue<IngestedFrame> queue;
+    std::thread thread;
+    std::atomic<bool> stopRequested{false};
+    std::atomic<bool> decoderDone{false};
+
+    /*source*/
+    cv::VideoCapture video;
+    std::vector<std::string> colorFiles, depthFiles; // image pairs
+    cv::Mat flatDepth;                               // depth of every video frame, shared by all of them
+    IngestedFrame first;                             // read by open(), pushed first
+    uint64_t nextIndex = 0;
+    uint32_t frameWidth = 0;
+    uint32_t frameHeight = 0;
+    double fps = 30.0;
+    double pacing = 30.0;
+
+    /*counters, written by one side each*/
+    std::atomic<uint64_t> decodedFrames{0};
+    std::atomic<uint64_t> consumedFrames{0};
+    std::atomic<uint64_t> droppedFrames{0};
+    std::atomic<uint64_t> lastDecodeNs{0};
+    std::atomic<uint64_t> totalDecodeNs{0};
+    std::atomic<uint64_t> timedFrames{0}; // frames decoded, open() included
+    std::atomic<size_t> maxQueued{0};
+};
+
+#endif // _FRAMEINGEST_H_
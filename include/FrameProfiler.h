@@ -0,0 +1,163 @@
+#ifndef _FRAMEPROFILER_H_
+#define _FRAMEPROFILER_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+/*The CPU stages of render() we time separately*/
+enum class FrameStage : uint32_t
+{
+    FenceWait = 0, // vkWaitForFences on the frame slot
+    Acquire,       // vkAcquireNextImageKHR
+    UniformUpdate, // updateUniformBuffer()
+    VertexUpdate,  // updateVertexBuffer() (dynamic geometry only), staging of the color overlay
+    Record,        // vkResetCommandPool + recordCommandBuffer()
+    Submit,        // vkQueueSubmit
+    Present,       // vkQueuePresentKHR
+    Count
+};
+
+const char* toStringFrameStage(FrameStage stage);
+
+static const size_t FRAME_STAGE_COUNT = static_cast<size_t>(FrameStage::Count);
+
+/*One finished frame. All times in milliseconds, gpuMs is negative when the queue has no timestamp support*/
+struct FrameRecord
+{
+    uint64_t frameIndex = 0;
+    double cpuFrameMs = 0.0;                           // the whole render() call
+    std::array<double, FRAME_STAGE_COUNT> cpuStageMs{}; // per stage, see FrameStage
+    double gpuMs = -1.0;                               // render pass, from the timestamp queries
+};
+
+/*
+Fixed size ring of FrameRecords. One writer (the render thread) pushes, any thread may read at any time.
+Every slot is guarded by a sequence number (seqlock): odd while being written, readers retry or skip torn slots.
+The payload is stored as atomic words so concurrent reads are well defined, no mutex is ever taken.
+*/
+class FrameRecordRing
+{
+public:
+    static const size_t CAPACITY = 1024; // must be a power of two
+
+    void push(const FrameRecord& record);
+    /* copies up to maxCount of the most recent records, oldest first */
+    std::vector<FrameRecord> snapshot(size_t maxCount = CAPACITY) const;
+    uint64_t totalPushed() const { return head.load(std::memory_order_acquire); }
+
+private:
+    static const size_t WORDS = (sizeof(FrameRecord) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence{0};
+        std::array<std::atomic<uint64_t>, WORDS> words{};
+    };
+    std::array<Slot, CAPACITY> slots;
+    std::atomic<uint64_t> head{0};
+};
+
+/*p50/p95/p99 of a series of milliseconds*/
+struct Percentiles
+{
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+/* sorts values */
+Percentiles computePercentiles(std::vector<double>& values);
+
+struct FrameStats
+{
+    size_t frameCount = 0;
+    Percentiles cpuFrame;
+    std::array<Percentiles, FRAME_STAGE_COUNT> cpuStages;
+    Percentiles gpu; // all zero when no GPU timings were available
+};
+
+/*
+Frame profiling subsystem.
+ - GPU : a VkQueryPool with two timestamps per frame slot, written around the render pass by cmdWriteBegin/End.
+ - CPU : ScopedTimer around each FrameStage of render().
+ - a FrameRecordRing with the latest finished frames, it can be queried and dumped as CSV or JSON.
+
+The GPU timestamps of a slot can only be read back once the slot's fence signalled, so a frame's record is completed
+and published when its slot is reused (framesInFlight frames later), see beginFrame().
+*/
+class FrameProfiler
+{
+public:
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(FrameProfiler& profiler, FrameStage stage)
+            : profiler(profiler)
+            , stage(stage)
+            , start(std::chrono::steady_clock::now())
+        {
+        }
+        ~ScopedTimer()
+        {
+            profiler.addStageTime(stage, std::chrono::steady_clock::now() - start);
+        }
+
+    private:
+        FrameProfiler& profiler;
+        FrameStage stage;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight);
+    void destroy();
+
+    bool hasGpuTimestamps() const { return queryPool != VK_NULL_HANDLE; }
+
+    /* recorded into the command buffer of a frame slot, outside of the render pass */
+    void cmdWriteBegin(VkCommandBuffer commandBuffer, uint32_t slot);
+    void cmdWriteEnd(VkCommandBuffer commandBuffer, uint32_t slot);
+
+    /* call right after the slot's fence has been waited on */
+    void beginFrame(uint32_t slot);
+    /* call once the slot's work has been submitted */
+    void endFrame(uint32_t slot);
+    /* render() returned without submitting (minimized window, out of date swapchain) : the stage times measured so far
+     * are dropped. The next frame's time still starts at the last endFrame() */
+    void discardFrame();
+    /* publish the frames still waiting for GPU results, the device must be idle */
+    void flushPending();
+
+    void addStageTime(FrameStage stage, std::chrono::steady_clock::duration duration);
+
+    const FrameRecordRing& records() const { return ring; }
+    FrameStats computeStats(size_t maxFrames = FrameRecordRing::CAPACITY) const;
+
+    void dumpCsv(std::ostream& out) const;
+    void dumpJson(std::ostream& out) const;
+    void printSummary(std::ostream& out) const;
+
+private:
+    void collectGpuTime(uint32_t slot);
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    double timestampPeriodNs = 1.0;
+    uint64_t timestampMask = ~0ull;
+
+    FrameRecord current;                 // the frame being built by render()
+    std::vector<FrameRecord> pending;    // submitted, waiting for GPU results, one per slot
+    std::vector<bool> pendingValid;
+    std::chrono::steady_clock::time_point frameStart;
+    uint64_t nextFrameIndex = 0;
+
+    FrameRecordRing ring;
+};
+
+#endif // _FRAMEPROFILER_H_
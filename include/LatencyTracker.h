@@ -0,0 +1,49 @@
+#ifndef _LATENCYTRACKER_H_
+#define _LATENCYTRACKER_H_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "FrameProfiler.h"
+
+/*
+Sample-to-present latency : from the moment a frame samples its inputs (window events, the newest ingested frame) to
+the moment it is known to be done.
+ - with VK_KHR_present_wait : vkWaitForPresentKHR returned for the frame's present id, the image is on screen.
+ - otherwise : the frame's fence was seen signalled, the GPU finished it. The presentation engine queue comes on top
+   of it (lower bound), and a fence is only looked at when the render thread waits on it (upper bound on the GPU part).
+Frames are numbered like VulkanDisplayer::frameCount once submitted (the first one is 1). Render thread only.
+*/
+class LatencyTracker
+{
+public:
+    static const size_t CAPACITY = 4096; // latencies kept, the most recent ones
+
+    /* the inputs of frame are sampled now. Sampling the same frame again (it was not submitted) replaces the time */
+    void sampled(uint64_t frame);
+    /* frame is done now (presented or its fence signalled), ignored if it was already counted or never sampled */
+    void completed(uint64_t frame);
+
+    size_t count() const { return latencies.size(); }
+    /* milliseconds, over the kept latencies */
+    Percentiles compute() const;
+    /* completion : what "done" means, printed with the numbers */
+    void printSummary(std::ostream& out, const char* completion) const;
+
+private:
+    /*frames sampled and not completed yet, by frame number modulo the size. More than the frames in flight*/
+    struct PendingSample
+    {
+        uint64_t frame = 0; // 0 : free
+        std::chrono::steady_clock::time_point time;
+    };
+    std::array<PendingSample, 16> pending;
+
+    std::vector<double> latencies; // ring of CAPACITY once full
+    size_t next = 0;
+};
+
+#endif // _LATENCYTRACKER_H_
@@ -0,0 +1,131 @@
+#ifndef _LOGGER_H_
+#define _LOGGER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SpscQueue.h"
+
+enum class LogLevel : int
+{
+    Trace = 0, // every frame
+    Debug,
+    Info,
+    Warn,
+    Error, // written before log() returns
+    Off
+};
+
+/*
+Levels below VD_LOG_LEVEL are compiled out : the VD_LOG_* statement stays type checked but is discarded, its arguments
+are never evaluated. Default : Debug, Info in release builds (NDEBUG), set with cmake -DVD_LOG_LEVEL=Trace|...|Off.
+*/
+#ifndef VD_LOG_LEVEL
+#ifdef NDEBUG
+#define VD_LOG_LEVEL 2
+#else
+#define VD_LOG_LEVEL 1
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VD_PRINTF_FORMAT(formatIndex, firstArg) __attribute__((format(printf, formatIndex, firstArg)))
+#else
+#define VD_PRINTF_FORMAT(formatIndex, firstArg)
+#endif
+
+#define VD_LOG(level, ...)                                                                                             \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (static_cast<int>(level) >= VD_LOG_LEVEL)                                                         \
+        {                                                                                                              \
+            Logger::global().log(level, __VA_ARGS__);                                                                  \
+        }                                                                                                              \
+    } while (0)
+
+#define VD_LOG_TRACE(...) VD_LOG(LogLevel::Trace, __VA_ARGS__)
+#define VD_LOG_DEBUG(...) VD_LOG(LogLevel::Debug, __VA_ARGS__)
+#define VD_LOG_INFO(...) VD_LOG(LogLevel::Info, __VA_ARGS__)
+#define VD_LOG_WARN(...) VD_LOG(LogLevel::Warn, __VA_ARGS__)
+#define VD_LOG_ERROR(...) VD_LOG(LogLevel::Error, __VA_ARGS__)
+
+const char* toStringLogLevel(LogLevel level);
+
+/*One formatted line, the text is cut at TEXT_SIZE - 1 characters*/
+struct LogRecord
+{
+    static const size_t TEXT_SIZE = 240;
+    int64_t timeNs = 0; // since the logger was created
+    LogLevel level = LogLevel::Info;
+    uint32_t thread = 0; // threads are numbered in the order they first log
+    char text[TEXT_SIZE];
+};
+
+/*
+Asynchronous logger, the VD_LOG_* macros write to the process wide one.
+ - log() formats the line on the calling thread into a LogRecord and pushes it into that thread's own SpscQueue
+   (registered the first time the thread logs) : no lock and no I/O on the caller. A full queue drops the record, see
+   dropped().
+ - a background thread drains every queue every few milliseconds, sorts the records by time and writes them in one go,
+   Trace, Debug and Info to stdout, Warn and Error to stderr.
+ - Error records are drained and written by log() itself, a VK_CHECK abort right after still shows its message.
+*/
+class Logger
+{
+public:
+    static const size_t QUEUE_CAPACITY = 1024; // records per thread
+
+    /* created on first use */
+    static Logger& global();
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /* printf style. Any thread */
+    void log(LogLevel level, const char* format, ...) VD_PRINTF_FORMAT(3, 4);
+    /* writes every record pushed so far, before returning. Call before printing to std::cout directly so the lines
+     * come out in order. Any thread */
+    void flush();
+    /* records lost to a full queue */
+    uint64_t dropped() const { return droppedRecords.load(std::memory_order_relaxed); }
+
+private:
+    Logger();
+
+    struct ThreadQueue
+    {
+        SpscQueue<LogRecord> records{QUEUE_CAPACITY};
+        uint32_t index = 0;
+        std::atomic<bool> retired{false}; // the thread exited, removed once drained
+    };
+    /*thread_local in threadQueue(), marks the queue retired when its thread exits*/
+    struct ThreadQueueHandle
+    {
+        std::shared_ptr<ThreadQueue> queue;
+        ~ThreadQueueHandle();
+    };
+    ThreadQueue& threadQueue();
+    void drainLoop();
+
+    std::chrono::steady_clock::time_point start;
+
+    std::mutex registryMutex; // queues
+    std::vector<std::shared_ptr<ThreadQueue>> queues;
+    uint32_t nextThread = 0;
+
+    std::mutex drainMutex; // one consumer of the queues at a time, the background thread or flush()
+    std::vector<LogRecord> batch;
+
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> droppedRecords{0};
+};
+
+#endif // _LOGGER_H_
@@ -0,0 +1,35 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+Read only mapping of a whole file (mmap, Linux only). Nothing is read up front, the kernel pages the file in when a
+range is first touched, so handing a range of data() to a memcpy (or a decompressor) is the only copy there is.
+*/
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    /* false if the file is empty or can not be mapped (or the platform has no mmap), the reason is printed */
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return mapped != nullptr; }
+    const uint8_t* data() const { return mapped; }
+    size_t size() const { return mappedSize; }
+    /* the file is going to be read front to back, the kernel reads ahead more aggressively */
+    void adviseSequential() const;
+
+private:
+    const uint8_t* mapped = nullptr;
+    size_t mappedSize = 0;
+};
+
+#endif // _MAPPEDFILE_H_
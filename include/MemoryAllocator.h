@@ -0,0 +1,138 @@
+#ifndef _MEMORYALLOCATOR_H_
+#define _MEMORYALLOCATOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+/*What the memory is used for, this decides which memory type it is taken from*/
+enum class MemoryUsage
+{
+    GpuOnly,  // device local, never touched by the CPU (vertex / index buffers, images)
+    CpuToGpu, // host visible + coherent, written every frame by the CPU (uniforms, streaming data), device local if
+              // the device has such a type
+    CpuOnly,  // host visible + coherent staging memory, prefers system memory
+    GpuToCpu  // host visible + coherent, prefers cached memory (read backs)
+};
+
+/*
+Linear resources (buffers) and optimal tiling images must be bufferImageGranularity apart when they share a
+VkDeviceMemory. Blocks only ever hold one kind of resource, so the granularity never has to be checked.
+*/
+enum class ResourceKind
+{
+    Linear,
+    Optimal
+};
+
+/*A piece of a VkDeviceMemory block, or a dedicated VkDeviceMemory for very large resources*/
+struct Allocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0; // offset inside memory, to pass to vkBind*Memory
+    VkDeviceSize size = 0;   // requested size
+    void* mapped = nullptr;  // persistently mapped pointer to offset, null if the memory is not host visible
+    uint32_t memoryType = 0;
+
+    /*bookkeeping of the allocator*/
+    void* block = nullptr; // owning block, null for dedicated allocations
+};
+
+/*Live statistics of a memory heap*/
+struct HeapStats
+{
+    VkDeviceSize heapSize = 0;
+    VkDeviceSize reserved = 0; // bytes taken from the driver with vkAllocateMemory
+    VkDeviceSize used = 0;     // bytes handed out to resources (requested sizes)
+    uint32_t blockCount = 0;   // VkDeviceMemory objects, including dedicated ones
+    uint32_t allocationCount = 0;
+    double fragmentation = 0.0; // 1 - largest free range / total free bytes, 0 : all free space is contiguous
+};
+
+/*
+Pooled device memory allocator.
+Big VkDeviceMemory blocks are allocated per memory type and carved with a buddy allocator: every allocation gets a
+power of two node aligned to its own size, so any power of two alignment requirement up to the node size is honoured
+for free, and freeing merges buddies back in O(log n). Resources bigger than half a block get a dedicated allocation.
+Host visible blocks are mapped once when they are created and stay mapped.
+All functions are thread safe.
+*/
+class MemoryAllocator
+{
+public:
+    static const VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+    static const VkDeviceSize MIN_NODE_SIZE = 256;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+    void destroy();
+
+    Allocation allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, ResourceKind kind);
+    void free(Allocation& allocation);
+
+    /* create + allocate + bind in one go */
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage, VkBuffer& buffer,
+        Allocation& allocation, const std::vector<uint32_t>& queueFamilies = {});
+    void destroyBuffer(VkBuffer& buffer, Allocation& allocation);
+    void createImage(const VkImageCreateInfo& imageInfo, MemoryUsage memoryUsage, VkImage& image,
+                     Allocation& allocation);
+    void destroyImage(VkImage& image, Allocation& allocation);
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0,
+        VkMemoryPropertyFlags avoided = 0) const;
+    bool isHostVisible(uint32_t memoryType) const;
+
+    std::vector<HeapStats> getHeapStats() const;
+    void printStats(std::ostream& out) const;
+
+private:
+    class BuddyBlock
+    {
+    public:
+        BuddyBlock(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryType, ResourceKind kind, void* mapped);
+
+        bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+        void free(VkDeviceSize offset);
+        bool empty() const { return allocated.empty(); }
+        VkDeviceSize largestFree() const;
+        VkDeviceSize freeBytes() const { return size - nodeBytes; }
+
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        uint32_t memoryType;
+        ResourceKind kind;
+        uint8_t* mapped;
+        VkDeviceSize nodeBytes = 0; // bytes covered by allocated nodes (>= requested)
+
+    private:
+        uint32_t maxOrder;
+        std::vector<std::set<VkDeviceSize>> freeLists;        // free node offsets, indexed by order
+        std::unordered_map<VkDeviceSize, uint32_t> allocated; // offset -> order
+    };
+
+    uint32_t chooseMemoryType(uint32_t typeFilter, MemoryUsage usage) const;
+    VkDeviceSize blockSizeFor(uint32_t memoryType) const;
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped);
+    void freeDeviceMemory(VkDeviceMemory memory, bool mapped);
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE;
+    uint32_t maxAllocationCount = 4096;
+    uint32_t deviceMemoryCount = 0; // live vkAllocateMemory allocations
+
+    std::vector<std::vector<std::unique_ptr<BuddyBlock>>> blocks; // indexed by memory type
+    std::vector<VkDeviceSize> dedicatedBytes;                     // per memory type
+    std::vector<uint32_t> dedicatedCount;
+    std::vector<VkDeviceSize> usedBytes;
+    std::vector<uint32_t> allocationCount;
+
+    mutable std::mutex mutex;
+};
+
+#endif // _MEMORYALLOCATOR_H_
@@ -0,0 +1,125 @@
+#ifndef _OCTREESTREAMER_H_
+#define _OCTREESTREAMER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_core.h>
+
+#include "MemoryAllocator.h"
+#include "PointOctree.h"
+#include "UploadManager.h"
+
+/*
+Draws a PointOctree within a point budget, streaming its nodes in and out of GPU memory as the view changes.
+ - selection, every frame on the render thread : from the root, the visible node whose points look the furthest apart
+   on screen (projected spacing, in pixels) is taken first and its children are considered next, until the point budget
+   is spent or every visible node is detailed enough (spacing below maxScreenError).
+ - residency : one device local vertex buffer cut in fixed slots of maxNodePoints points. A selected node that is not
+   resident gets a free slot, or the least recently drawn slot of a node that is neither selected nor read by a frame
+   still in flight. Its points are read (from memory or from the octree file) on a loader thread, then enqueued to the
+   upload manager by update() on the render thread (an enqueue may submit, to a queue the render thread also submits
+   to). It is drawn once its upload ticket completed.
+ - drawing : one vkCmdDraw per resident selected node whose parent is drawn too, so the nested subsamples never leave
+   holes. Until a node arrives its ancestors stand for it.
+*/
+class OctreeStreamer
+{
+public:
+    static const uint32_t MAX_PENDING_LOADS = 16; // nodes requested from the loader thread and not resident yet
+
+    struct Stats
+    {
+        uint32_t selectedNodes = 0;
+        uint32_t drawnNodes = 0;
+        uint64_t drawnPoints = 0;
+        uint32_t residentNodes = 0;
+        uint32_t pendingLoads = 0;
+    };
+
+    /* the octree may still be building (buildAsync()), nothing is drawn until it is ready. dstFamilies : queue families
+     * the vertex buffer is shared with, see UploadManager::sharingFamilies() */
+    void init(MemoryAllocator* allocator, UploadManager* uploads, std::shared_ptr<const PointOctree> octree,
+        uint64_t pointBudget, const std::vector<uint32_t>& dstFamilies);
+    /* stops the loader thread and frees the buffer, the device must be idle */
+    void destroy();
+
+    /* render thread, before recording. frame : number the frame will be submitted as, completedFrames : frames whose
+     * fence signalled (their slots may be reused) */
+    void update(const glm::mat4& mvp, float viewportHeight, uint64_t frame, uint64_t completedFrames);
+    /* the draws of the last update(), inside the render pass with vertexBuffer() bound */
+    void recordDraws(VkCommandBuffer commandBuffer) const;
+
+    VkBuffer vertexBuffer() const { return buffer; }
+    const Stats& stats() const { return frameStats; }
+    /* projected point spacing (pixels) below which a node is not refined */
+    void setMaxScreenError(float pixels) { maxScreenError = pixels; }
+
+private:
+    enum class Residency
+    {
+        Absent,
+        Loading,   // queued, being read by the loader thread or read and waiting for update()
+        Uploading, // in the upload manager, waiting for its ticket
+        Resident
+    };
+
+    struct NodeState
+    {
+        Residency residency = Residency::Absent;
+        int32_t slot = -1;
+        UploadTicket ticket = 0;
+        uint64_t selectedFrame = 0; // last frame the node was selected in
+        uint64_t drawnFrame = 0;    // last frame the node was drawn in
+    };
+
+    struct Slot
+    {
+        int32_t node = PointOctree::NO_NODE;
+        uint64_t lastUsedFrame = 0; // last frame that draws from the slot
+    };
+
+    struct Load
+    {
+        uint32_t node;
+        int32_t slot;
+        std::vector<Vertex> points; // filled by the loader thread
+    };
+
+    void select(const glm::mat4& mvp, float viewportHeight, uint64_t frame); // fills selection
+    int32_t acquireSlot(uint64_t frame, uint64_t completedFrames);
+    void loaderLoop();
+
+    MemoryAllocator* allocator = nullptr;
+    UploadManager* uploads = nullptr;
+    std::shared_ptr<const PointOctree> octree;
+    uint64_t pointBudget = 0;
+    uint32_t slotPoints = 0; // maxNodePoints of the octree
+    float maxScreenError = 1.5f;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Allocation bufferMemory;
+    std::vector<Slot> slots;
+    std::vector<NodeState> states; // per node, once the octree is ready
+    std::vector<uint32_t> selection;          // nodes to draw this frame
+    std::vector<VkDrawIndirectCommand> draws; // of the last update()
+    std::vector<uint32_t> uploading;          // nodes in Residency::Uploading
+    uint32_t pendingLoads = 0;
+    Stats frameStats;
+
+    /*loader thread : requests in, nodes read out*/
+    std::thread loader;
+    std::mutex loaderMutex;
+    std::condition_variable loaderCondition;
+    std::deque<Load> requests;
+    std::vector<Load> loaded;
+    bool stopLoader = false;
+};
+
+#endif // _OCTREESTREAMER_H_
@@ -0,0 +1,49 @@
+#ifndef _PIPELINECACHE_H_
+#define _PIPELINECACHE_H_
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+/*
+VkPipelineCache kept in a file between runs.
+init() seeds the cache with the file if its header (VkPipelineCacheHeaderVersionOne) was written by the same vendor,
+device and driver (pipelineCacheUUID), otherwise the file is ignored and the cache starts empty. save() writes the
+current cache data back, through a temporary file so a crash never leaves a truncated cache behind.
+Every pipeline creation can be timed with recordPipeline(), the summary tells whether the cache was warm.
+*/
+class PipelineCache
+{
+public:
+    /* path empty : in memory cache only, nothing is read or written */
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path);
+    void save();
+    void destroy();
+
+    VkPipelineCache handle() const { return cache; }
+    /* the file was valid for this device and its data was loaded */
+    bool loadedFromDisk() const { return loaded; }
+
+    /* time spent in a vkCreate*Pipelines call that used this cache, any thread */
+    void recordPipeline(const char* name, double milliseconds);
+    void printSummary(std::ostream& out) const;
+
+private:
+    bool validHeader(const std::vector<char>& data) const;
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties{};
+    std::string path;
+    bool loaded = false;
+    size_t loadedSize = 0;
+    std::vector<std::pair<std::string, double>> pipelineTimes; // name, ms
+    mutable std::mutex mutex;                                  // pipelineTimes, pipelines are created in parallel
+};
+
+#endif // _PIPELINECACHE_H_
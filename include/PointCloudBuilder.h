@@ -0,0 +1,48 @@
+#ifndef _POINTCLOUDBUILDER_H_
+#define _POINTCLOUDBUILDER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "CameraIntrinsics.h"
+#include "ThreadPool.h"
+#include "Vertex.h"
+
+/*
+RGB-D image -> point cloud Vertices.
+Every valid depth pixel (u, v, z) is back-projected to ((u - cx) / fx * z, (v - cy) / fy * z, z) with the color of the
+same pixel. The image is split in bands of rows run on the thread pool: a first pass counts the valid pixels of each
+band, a prefix sum gives each band its output offset, the second pass writes the vertices densely into the caller's
+buffer. The per pixel math uses AVX2 (8 pixels) when the CPU running the program has it, SSE2 (4 pixels) otherwise,
+picked at run time whatever the build targets.
+
+color : CV_8UC3 (BGR) or CV_8UC4 (BGRA). depth : CV_16UC1 (scaled by depthScale) or CV_32FC1 (meters).
+A builder keeps scratch tables between calls, use one builder per thread.
+*/
+class PointCloudBuilder
+{
+public:
+    explicit PointCloudBuilder(ThreadPool& pool = ThreadPool::global());
+
+    /* upper bound of the vertex count, size the output buffer with it */
+    static size_t maxVertexCount(const cv::Mat& depth) { return depth.total(); }
+
+    /* writes the points to out (capacity vertices) and returns how many were written */
+    size_t build(const cv::Mat& color, const cv::Mat& depth, const CameraIntrinsics& intrinsics, Vertex* out,
+        size_t capacity);
+    /* convenience overload, resizes vertices to the point count */
+    size_t build(
+        const cv::Mat& color, const cv::Mat& depth, const CameraIntrinsics& intrinsics, std::vector<Vertex>& vertices);
+
+private:
+    void prepareTables(int width, int height, const CameraIntrinsics& intrinsics);
+
+    ThreadPool& pool;
+    std::vector<float> xTable; // (u - cx) / fx per column
+    std::vector<float> yTable; // (v - cy) / fy per row
+    std::vector<size_t> bandCounts; // pass 1 result, then the output offset of every band
+};
+
+#endif // _POINTCLOUDBUILDER_H_
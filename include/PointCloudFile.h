@@ -0,0 +1,80 @@
+#ifndef _POINTCLOUDFILE_H_
+#define _POINTCLOUDFILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Vertex.h"
+
+/*
+Binary point cloud file, memory mapped (see MappedFile).
+open() maps the whole file and parses the header, nothing of the payload is read yet. convert() turns a range of
+points into Vertex, in parallel on the thread pool, straight into memory the caller owns (a staging region of the
+UploadManager) : the payload is never copied into a vector, the page cache is the only buffer. The mapping is
+advised sequential so the kernel reads ahead while the points are converted.
+
+Formats :
+ - PLY binary_little_endian : the "vertex" element, x y z as any scalar type, red green blue as uchar (0-255) or
+   float (0-1). Elements in front of it must have a fixed size (no list property).
+ - PCD DATA binary : fields x y z, and rgb or rgba packed in 4 bytes (0x00RRGGBB, as float or uint).
+Missing colors are white. ASCII, big endian and compressed payloads are rejected.
+*/
+class PointCloudFile
+{
+public:
+    PointCloudFile() = default;
+    PointCloudFile(const PointCloudFile&) = delete;
+    PointCloudFile& operator=(const PointCloudFile&) = delete;
+    ~PointCloudFile() { close(); }
+
+    /* false if the file can not be mapped or its format is not supported, the reason is printed */
+    bool open(const std::string& path);
+    void close();
+
+    uint64_t pointCount() const { return points; }
+    /* writes points [first, first + count) to out */
+    void convert(uint64_t first, uint64_t count, Vertex* out, ThreadPool& pool = ThreadPool::global()) const;
+
+private:
+    enum class Scalar
+    {
+        Int8,
+        UInt8,
+        Int16,
+        UInt16,
+        Int32,
+        UInt32,
+        Float32,
+        Float64
+    };
+
+    /*where a value sits inside a point record*/
+    struct Field
+    {
+        size_t offset = 0;
+        Scalar type = Scalar::Float32;
+        bool present = false;
+    };
+
+    bool parsePly(const std::string& header);
+    bool parsePcd(const std::string& header);
+    static bool parseScalar(const std::string& name, Scalar& type, size_t& size);
+    static float readScalar(const uint8_t* p, Scalar type);
+
+    MappedFile file;
+    const uint8_t* mapped = nullptr; // file.data()
+    size_t mappedSize = 0;
+    size_t payloadOffset = 0; // first point record
+    size_t stride = 0;        // bytes per point record
+    uint64_t points = 0;
+    Field position[3];        // x y z
+    Field color[3];           // red green blue, unused if packedColor is
+    Field packedColor;        // PCD rgb / rgba
+    bool floatPositions = false; // x y z are consecutive Float32, one memcpy
+};
+
+#endif // _POINTCLOUDFILE_H_
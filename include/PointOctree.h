@@ -0,0 +1,103 @@
+#ifndef _POINTOCTREE_H_
+#define _POINTOCTREE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+
+/*How PointOctree::build() cuts the cloud into nodes*/
+struct OctreeBuildOptions
+{
+    uint32_t maxNodePoints = 32768; // a node never holds more, this is also the size of a streaming slot
+    uint32_t gridResolution = 128;  // subsampling grid cells per edge
+    uint32_t maxDepth = 20;         // nodes at this level keep a regular subsample of what reaches them
+};
+
+/*
+Level of detail hierarchy of a point cloud too large to draw (or to keep on the GPU) at once.
+Every node of the octree holds a subsample of the points of its subtree : at most one point per cell of a grid of
+gridResolution^3 cells over the node's cube, the points left over go down to the children. The points of a node are
+never repeated in its children, a node drawn together with its ancestors shows its region at the node's spacing
+(nested subsampling, as in Potree).
+
+build() makes the hierarchy from points in memory, buildAsync() does it on a background thread, ready() tells when it
+is done. save() writes it to a file laid out node after node. open() reads back only the header and the node table,
+the points of a node are read from the file when readNode() asks for them : the cloud never has to fit in memory,
+only the nodes currently streamed do, see OctreeStreamer.
+*/
+class PointOctree
+{
+public:
+    static constexpr int32_t NO_NODE = -1;
+
+    /*also the on-disk layout of the node table*/
+    struct Node
+    {
+        glm::vec3 boundsMin;  // cube
+        float size;           // edge length of the cube
+        float spacing;        // grid cell size of this node, the distance between its points
+        uint32_t level;       // 0 : root
+        int32_t parent;       // NO_NODE for the root
+        int32_t children[8];  // octant x + 2 y + 4 z, NO_NODE if empty
+        uint32_t pointCount;
+        uint64_t pointOffset; // first point of the node, in points, in node order
+    };
+
+    /* points are consumed. Blocks, nodes() is valid once it returns */
+    void build(std::vector<Vertex> points, const OctreeBuildOptions& options = OctreeBuildOptions());
+    /* same on a background thread, ready() becomes true when the hierarchy can be used */
+    std::future<void> buildAsync(
+        std::vector<Vertex> points, const OctreeBuildOptions& options = OctreeBuildOptions());
+    bool save(const std::string& path) const;
+    /* out of core : loads the node table, the points stay in the file. false if the file is not an octree */
+    bool open(const std::string& path);
+
+    bool ready() const { return isReady.load(std::memory_order_acquire); }
+    /* only once ready() */
+    const std::vector<Node>& nodes() const { return nodeTable; }
+    uint64_t pointCount() const { return totalPoints; }
+    /* known as soon as a build started or the file was opened, the streaming slots are sized with it */
+    uint32_t maxNodePoints() const { return nodeCapacity; }
+
+    /* the points of node, from memory or from the file. Thread safe, false on a read error or an unknown node */
+    bool readNode(uint32_t node, std::vector<Vertex>& out) const;
+
+private:
+    /*file header, followed by the node table and the points*/
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t maxNodePoints;
+        uint64_t nodeCount;
+        uint64_t pointCount;
+    };
+
+    /* nullptr if the counts of header fit in a file of fileSize bytes, the reason otherwise */
+    static const char* checkHeader(const FileHeader& header, uint64_t fileSize);
+    /* nullptr if every node links to nodes of the table and holds points of the file, the reason otherwise. Nothing
+     * read from the file is trusted before this, the streamer indexes the table with it */
+    const char* checkNodes(const FileHeader& header) const;
+    int32_t buildNode(std::vector<Vertex>& points, const glm::vec3& boundsMin, float size, uint32_t level,
+        int32_t parent, const OctreeBuildOptions& options);
+
+    std::vector<Node> nodeTable;
+    std::vector<Vertex> nodePoints; // built in memory : every node's points, in node order. Empty once opened
+    uint64_t totalPoints = 0;
+    uint32_t nodeCapacity = OctreeBuildOptions().maxNodePoints;
+    std::atomic<bool> isReady{false};
+
+    mutable std::ifstream file; // opened octree
+    uint64_t pointsFileOffset = 0;
+    mutable std::mutex fileMutex;
+};
+
+#endif // _POINTOCTREE_H_
@@ -0,0 +1,107 @@
+#ifndef _SCENECACHE_H_
+#define _SCENECACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "ChunkCuller.h"
+#include "MappedFile.h"
+#include "UploadManager.h"
+#include "Vertex.h"
+
+/*How the payload sections of a scene cache are stored*/
+enum class SceneCompression : uint32_t
+{
+    None, // raw, uploaded straight from the mapping
+    LZ4   // independent LZ4 blocks, decompressed straight into the staging ring (needs VD_HAVE_LZ4)
+};
+
+/*
+Geometry converted once and reloaded without any parsing or reformatting.
+The file holds the vertices already packed in the GPU layout of a VertexFormat (VertexLayout of Vertex, ColorVertex or
+PackedVertex, plus the PackedChunk table for Packed16), the indices, and the draw list as ChunkCuller::Chunk entries
+with their bounding boxes, ready for GPU culling.
+Every section starts on a page boundary : open() maps the file and upload() hands page aligned ranges of the mapping
+to the UploadManager as they are, or decompresses them block by block straight into the staging ring. Nothing of the
+payload is ever copied into the process.
+
+Layout (native byte order) : FileHeader, then the sections. A compressed section starts with its BlockEntry table.
+*/
+class SceneCache
+{
+public:
+    static const uint32_t VERSION = 1;
+    static const uint64_t SECTION_ALIGNMENT = 4096;     // a page
+    static const uint32_t BLOCK_SIZE = 4 * 1024 * 1024; // raw bytes per LZ4 block, well below half the staging ring
+
+    enum Section
+    {
+        Vertices,
+        VertexChunks, // PackedChunk, VertexFormat::Packed16 only
+        Indices,
+        DrawChunks,   // ChunkCuller::Chunk, never compressed
+        SECTION_COUNT
+    };
+
+    /* packs the geometry in format, cuts it in draws of about chunkIndices indices and writes it. LZ4 falls back to
+     * None if the build has no LZ4 */
+    static bool write(const std::string& path, const std::vector<Vertex>& vertices,
+        const std::vector<uint32_t>& indices, VkPrimitiveTopology topology, VertexFormat format, uint32_t chunkIndices,
+        SceneCompression compression);
+
+    /* false if the file is not a scene cache of this version, or is compressed and the build has no LZ4 */
+    bool open(const std::string& path);
+
+    VertexFormat vertexFormat() const { return static_cast<VertexFormat>(header.vertexFormat); }
+    VkPrimitiveTopology topology() const { return static_cast<VkPrimitiveTopology>(header.topology); }
+    uint64_t vertexCount() const { return header.vertexCount; }
+    uint64_t indexCount() const { return header.indexCount; }
+    /* the draw list with bounds, read at open() */
+    const std::vector<ChunkCuller::Chunk>& chunks() const { return chunkTable; }
+    /* size of the section once uploaded */
+    VkDeviceSize sectionSize(Section section) const { return header.sections[section].rawSize; }
+
+    /* copies section to dst (offset 0) through uploads, returns the ticket of the last copy */
+    UploadTicket upload(Section section, UploadManager& uploads, VkBuffer dst) const;
+
+private:
+    /* nullptr if the header, the block tables and the draw list stay inside the file and agree with each other, the
+     * reason otherwise. The file is mapped : nothing read from it is trusted before this */
+    const char* checkLayout() const;
+
+    struct SectionEntry
+    {
+        uint64_t offset;     // from the start of the file, multiple of SECTION_ALIGNMENT
+        uint64_t storedSize; // bytes in the file, block table included
+        uint64_t rawSize;    // bytes once uploaded
+        uint64_t blockCount; // 0 : stored raw
+    };
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t vertexFormat;
+        uint32_t topology;
+        uint32_t vertexStride; // checked against vertexStride(vertexFormat), the layout did not change
+        uint64_t vertexCount;
+        uint64_t indexCount;
+        SectionEntry sections[SECTION_COUNT];
+    };
+
+    struct BlockEntry
+    {
+        uint64_t offset;     // from the start of the section
+        uint32_t storedSize; // compressed bytes
+        uint32_t rawSize;
+    };
+
+    MappedFile file;
+    FileHeader header{};
+    std::vector<ChunkCuller::Chunk> chunkTable;
+};
+
+#endif // _SCENECACHE_H_
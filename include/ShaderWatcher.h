@@ -0,0 +1,45 @@
+#ifndef _SHADERWATCHER_H_
+#define _SHADERWATCHER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Watches a shader source directory (inotify, Linux only) on its own thread.
+Every file that is written and closed, or moved into the directory (editors that save through a temporary file), is
+reported once to the callback, on the watcher thread. Events are collected for a short while first, a save usually
+produces several of them.
+*/
+class ShaderWatcher
+{
+public:
+    typedef std::function<void(const std::string& fileName)> Callback;
+
+    ~ShaderWatcher() { stop(); }
+
+    /* false if the directory can not be watched (or the platform has no inotify), the callback is never called then */
+    bool start(const std::string& directory, Callback onChange);
+    /* joins the thread, no callback runs once it returned */
+    void stop();
+    bool running() const { return thread.joinable(); }
+
+private:
+    void loop();
+
+    Callback callback;
+    std::thread thread;
+    int inotifyFd = -1;
+    int wakeFd[2] = {-1, -1}; // pipe, stop() writes to it to end the poll() of the watcher thread
+};
+
+/*
+Compiles a GLSL file with glslc (the one found by CMake, else the one on the PATH) into SPIR-V words.
+Empty if the compilation failed, glslc prints the errors.
+*/
+std::vector<uint32_t> compileGlsl(const std::string& path);
+
+#endif // _SHADERWATCHER_H_
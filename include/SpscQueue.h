@@ -0,0 +1,67 @@
+#ifndef _SPSCQUEUE_H_
+#define _SPSCQUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+Bounded single producer / single consumer queue, lock free.
+One thread only pushes, one other thread only pops. head and tail count the items ever popped / pushed, each is
+written by one side only (release) and read by the other (acquire) : a slot is handed over with the counter, no
+compare-and-swap and no mutex. The counters sit on their own cache lines so the two threads do not share one.
+*/
+template <typename T> class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity)
+        : slots(capacity)
+    {
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /* producer only. false (value untouched) if the queue is full */
+    bool tryPush(T&& value)
+    {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size())
+        {
+            return false;
+        }
+        slots[t % slots.size()] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* consumer only. false if the queue is empty */
+    bool tryPop(T& out)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        out = std::move(slots[h % slots.size()]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* exact on either side for the items it can see, a snapshot from any other thread */
+    size_t size() const
+    {
+        uint64_t h = head.load(std::memory_order_acquire);
+        return static_cast<size_t>(tail.load(std::memory_order_acquire) - h);
+    }
+    size_t capacity() const { return slots.size(); }
+
+private:
+    std::vector<T> slots;
+    alignas(64) std::atomic<uint64_t> head{0}; // next item to pop, written by the consumer
+    alignas(64) std::atomic<uint64_t> tail{0}; // next item to push, written by the producer
+};
+
+#endif // _SPSCQUEUE_H_
@@ -0,0 +1,94 @@
+#ifndef _STREAMINGTEXTURE_H_
+#define _STREAMINGTEXTURE_H_
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <vulkan/vulkan_core.h>
+
+#include "MemoryAllocator.h"
+#include "PipelineCache.h"
+
+/*
+A sampled texture replaced by a new 8-bit BGR image (a camera color stream) up to every frame, and the overlay that
+shows it in a corner of the frame (shaders/overlay.vert, overlay.frag).
+ - staging : a ring of one persistently mapped region per frame slot. A region is only written once its slot's fence
+   signalled, the image goes from the cv::Mat straight into it.
+ - format : B8G8R8_UNORM when the device samples and blits it, the rows are copied as they are. Otherwise
+   R8G8B8A8_UNORM, the pixels are converted on the thread pool (SSSE3 / AVX2 byte shuffles when the compiler targets
+   them).
+ - the copy, the mip chain (vkCmdBlitImage, level by level) and the layout transitions are recorded in the frame's
+   command buffer in front of the render pass, on the graphics queue, see recordUpload(). There is one image : the
+   barriers order it after the frames still sampling it.
+ - bound through a combined image sampler (trilinear, clamp to edge), allocated from the renderer's descriptor pool.
+*/
+class StreamingTexture
+{
+public:
+    /* image size, fixes the staging layout. Call before submitImage() and init() */
+    void setExtent(uint32_t width, uint32_t height);
+    /* descriptorPool needs one set with a VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER left */
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator* allocator, uint32_t framesInFlight,
+        VkDescriptorPool descriptorPool, VkRenderPass renderPass, VkShaderModule vertShader, VkShaderModule fragShader,
+        PipelineCache* pipelineCache);
+    void destroy();
+
+    /* image : CV_8UC3 (BGR), width x height. The pixels are referenced, not copied : give a new cv::Mat per frame
+     * (what cv::imread and VideoCapture::read into an empty cv::Mat do), not one written over. Safe to call from any
+     * thread */
+    void submitImage(const cv::Mat& image);
+
+    /* call once the fence of slot signalled, writes the latest image into the slot's staging if it is not uploaded
+     * yet */
+    void prepareFrame(uint32_t slot);
+    /* the copy and the mip chain of the image prepareFrame() staged, if any. Outside of a render pass */
+    void recordUpload(VkCommandBuffer commandBuffer, uint32_t slot);
+    /* draws the texture in the top right corner of target, a quarter of its width. Inside the render pass, changes
+     * the viewport and scissor. Nothing until a first image was uploaded */
+    void recordOverlay(VkCommandBuffer commandBuffer, VkExtent2D target);
+
+    VkFormat format() const { return imageFormat; }
+    uint32_t mipLevels() const { return levels; }
+
+private:
+    void chooseFormat(VkPhysicalDevice physicalDevice);
+    void createImage();
+    void createDescriptor(VkDescriptorPool descriptorPool);
+    void createPipeline(VkRenderPass renderPass, VkShaderModule vertShader, VkShaderModule fragShader,
+        PipelineCache* pipelineCache);
+
+    VkDevice device = VK_NULL_HANDLE;
+    MemoryAllocator* allocator = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    VkFormat imageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    uint32_t texelSize = 4;
+    uint32_t levels = 1;
+    VkImage image = VK_NULL_HANDLE;
+    Allocation imageMemory;
+    VkImageView imageView = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+    bool uploaded = false; // the image holds a frame, it can be sampled
+
+    /*staging ring, one region per frame slot*/
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    Allocation stagingMemory;
+    VkDeviceSize regionSize = 0;
+    std::vector<bool> regionPending; // staged by prepareFrame(), not recorded yet
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    /*the most recent image*/
+    std::mutex imageMutex;
+    cv::Mat latestImage;
+    uint64_t latestGeneration = 0;
+    uint64_t stagedGeneration = 0; // render thread only
+};
+
+#endif // _STREAMINGTEXTURE_H_
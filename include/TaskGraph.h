@@ -0,0 +1,92 @@
+#ifndef _TASKGRAPH_H_
+#define _TASKGRAPH_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+/*
+One shot dependency graph of tasks, run on a ThreadPool and on the calling thread.
+A task starts once all the tasks it depends on finished. Tasks marked MainThread only ever run on the thread that
+called run() (GLFW window and surface calls must stay there), the others go to whichever thread is free.
+The pool workers are only taken while there are ready tasks : a helper returns to the pool as soon as it finds none,
+so the workers stay free for the parallelFor() calls made by the tasks themselves.
+Every task is timed, printTimings() shows when each one started and how long it took.
+If a task throws, the tasks not started yet are skipped and run() rethrows the first exception.
+*/
+class TaskGraph
+{
+public:
+    typedef size_t TaskId;
+
+    enum class Affinity
+    {
+        AnyThread,
+        MainThread
+    };
+
+    struct TaskTiming
+    {
+        std::string name;
+        double startMs = 0.0;    // since run() was called
+        double durationMs = 0.0;
+        bool mainThread = false; // ran on the calling thread
+    };
+
+    TaskId add(const std::string& name, std::function<void()> func, std::initializer_list<TaskId> dependencies = {},
+        Affinity affinity = Affinity::AnyThread);
+
+    /* blocks until every task ran, the AnyThread tasks are also run by helpers submitted to pool */
+    void run(ThreadPool& pool = ThreadPool::global());
+
+    /* in the order the tasks were added */
+    const std::vector<TaskTiming>& timings() const { return taskTimings; }
+    double totalMs() const { return wallMs; }
+    void printTimings(std::ostream& out, const char* title = "Task graph") const;
+
+private:
+    struct Task
+    {
+        std::function<void()> func;
+        std::vector<TaskId> dependents;
+        size_t pendingDependencies = 0;
+        Affinity affinity = Affinity::AnyThread;
+    };
+
+    /* the calling thread of run() : runs ready tasks of both kinds until the graph is done. lock holds mutex */
+    void work(std::unique_lock<std::mutex>& lock);
+    /* a pool worker : runs ready AnyThread tasks until there is none */
+    void help();
+    void execute(TaskId id, bool mainThread);
+    /* marks id finished and readies its dependents. lock holds mutex */
+    void complete(TaskId id);
+    /* one helper per ready AnyThread task, up to maxHelpers running. Unlocks mutex while submitting */
+    void spawnHelpers(std::unique_lock<std::mutex>& lock);
+
+    std::vector<Task> tasks;
+    std::vector<TaskTiming> taskTimings;
+    double wallMs = 0.0;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<TaskId> readyAny;
+    std::deque<TaskId> readyMain;
+    size_t finished = 0;
+    std::exception_ptr failure;
+    ThreadPool* pool = nullptr;
+    size_t maxHelpers = 0;
+    size_t activeHelpers = 0; // submitted and not returned yet
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // _TASKGRAPH_H_
@@ -0,0 +1,49 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+Fixed set of worker threads pulling tasks from one queue.
+parallelFor() is the main use: it cuts a range into chunks, runs them on the workers and on the calling thread, and
+returns once every chunk is done.
+*/
+class ThreadPool
+{
+public:
+    /* threadCount 0 : one worker per hardware thread, minus the caller that also works in parallelFor() */
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /* number of threads working in parallelFor(), workers + the caller */
+    size_t concurrency() const { return workers.size() + 1; }
+
+    std::future<void> submit(std::function<void()> task);
+
+    /* func(chunkBegin, chunkEnd) over [begin, end) in chunks of about grain elements, blocks until all are done */
+    void parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& func);
+
+    /* a process wide pool, created on first use */
+    static ThreadPool& global();
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+};
+
+#endif // _THREADPOOL_H_
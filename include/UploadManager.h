@@ -0,0 +1,106 @@
+#ifndef _UPLOADMANAGER_H_
+#define _UPLOADMANAGER_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "MemoryAllocator.h"
+
+/*
+Identifies a submitted (or about to be submitted) batch of copies. Tickets increase monotonically, a ticket is
+complete once every copy enqueued before it was returned has landed in device memory. 0 is always complete.
+*/
+typedef uint64_t UploadTicket;
+
+/*
+Asynchronous host -> device uploads.
+ - copies go through a persistently mapped staging ring and are recorded on the dedicated transfer queue family when
+   the device has one (the graphics queue otherwise), so they overlap with rendering.
+ - everything enqueued between two flush() calls is one batch: one command buffer, one vkQueueSubmit, one fence.
+   The renderer flushes once per frame.
+ - every enqueue returns the ticket of its batch. Nothing ever waits on the queue, the caller checks isComplete() or
+   waits on wait() only at the point where the data is actually used.
+ - staging space of a batch is recycled as soon as its fence signalled.
+
+Destination resources must be accessible from the transfer family, see sharingFamilies().
+Every function locks the manager. An enqueue (when the ring or the batches are full), flush() and wait() may submit to
+transferQueue, which is the graphics / present queue on devices without a transfer only family : a VkQueue is
+externally synchronized, so once frames are being submitted only the render thread may call them. Other threads hand
+their data to the render thread instead (see OctreeStreamer).
+*/
+class UploadManager
+{
+public:
+    static const VkDeviceSize DEFAULT_STAGING_SIZE = 32ull * 1024 * 1024;
+    static const uint32_t MAX_BATCHES = 8; // batches in flight before enqueue has to wait for the oldest one
+
+    void init(VkDevice device, MemoryAllocator* allocator, uint32_t transferFamily, VkQueue transferQueue,
+        uint32_t graphicsFamily, VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+    void destroy();
+
+    /* copy size bytes from data to dst at dstOffset, data can be released as soon as the call returns */
+    UploadTicket uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+    /* fill(staging) writes the size bytes straight into the staging ring, no copy of the source is needed. size is at
+     * most getStagingSize() / 2 (one piece). fill runs with the manager locked, other uploads wait for it */
+    UploadTicket uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, VkDeviceSize size,
+        const std::function<void(void* staging)>& fill);
+    /* submit the current batch, returns its ticket (the last submitted one if nothing was pending) */
+    UploadTicket flush();
+
+    bool isComplete(UploadTicket ticket);
+    /* block until the ticket completed, flushes first if the ticket is still being recorded */
+    void wait(UploadTicket ticket);
+    /* ticket of the batch currently recording, what the next enqueue will return */
+    UploadTicket currentTicket();
+
+    bool usesDedicatedQueue() const { return transferFamily != graphicsFamily; }
+    /* queue families a destination resource has to be shared with (VK_SHARING_MODE_CONCURRENT if more than one) */
+    std::vector<uint32_t> sharingFamilies() const;
+
+    VkDeviceSize getStagingSize() const { return stagingSize; }
+
+private:
+    struct Batch
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        UploadTicket ticket = 0;
+        uint64_t stagingEnd = 0; // ring position after the last byte this batch used
+    };
+
+    /* returns the ring position of size free bytes, may submit the recording batch or wait for old batches */
+    uint64_t reserveStaging(VkDeviceSize size);
+    Batch& recordingBatch();
+    UploadTicket submitLocked();
+    void retireCompleted();
+    void waitOldest();
+
+    VkDevice device = VK_NULL_HANDLE;
+    MemoryAllocator* allocator = nullptr;
+    uint32_t transferFamily = 0;
+    uint32_t graphicsFamily = 0;
+    VkQueue transferQueue = VK_NULL_HANDLE;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    Allocation stagingMemory;
+    VkDeviceSize stagingSize = 0;
+    uint64_t stagingHead = 0; // monotonic ring positions, offset = position % stagingSize
+    uint64_t stagingTail = 0;
+
+    std::vector<Batch> freeBatches;
+    std::deque<Batch> submitted; // oldest first
+    Batch recording;
+    bool isRecording = false;
+    UploadTicket nextTicket = 1;
+    UploadTicket completedTicket = 0;
+
+    std::mutex mutex;
+};
+
+#endif // _UPLOADMANAGER_H_
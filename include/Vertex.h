@@ -2,10 +2,13 @@
 #define _VERTEX_H_
 
 #include <array>
+#include <cstdint>
 
 #include <glm/glm.hpp>
 #include <vulkan/vulkan_core.h>
 
+#include "VertexLayout.h"
+
 struct Vertex
 {
     glm::vec3 position;
@@ -13,9 +16,60 @@ struct Vertex
     Vertex();
     Vertex(const glm::vec3& position, const glm::vec3& color);
 
-    static VkVertexInputBindingDescription getBindingDescription();
+    /*shader locations 0, 1, see VertexLayout.h*/
+    static constexpr std::array<VertexAttribute, 2> attributes()
+    {
+        return {{VERTEX_ATTRIBUTE(Vertex, position), VERTEX_ATTRIBUTE(Vertex, color)}};
+    }
+};
+
+/*
+Vertex layouts of a mesh on the GPU. Vertex is what the application works with, the others are packed copies of it
+made by packVertices() (VertexPacking.h) to save vertex bandwidth.
+*/
+enum class VertexFormat
+{
+    Float32,     // Vertex : float position + float color, 24 bytes
+    ColorUnorm8, // ColorVertex : float position + RGBA8 color, 16 bytes
+    Packed16     // PackedVertex : SNORM16 position relative to its chunk + RGBA8 color, 12 bytes
+};
+
+struct ColorVertex
+{
+    glm::vec3 position;
+    uint8_t color[4]; // R8G8B8A8_UNORM
+
+    /*shader.vert reads the color as a vec3, the alpha of the RGBA8 attribute is simply dropped*/
+    static constexpr std::array<VertexAttribute, 2> attributes()
+    {
+        return {{VERTEX_ATTRIBUTE(ColorVertex, position), VERTEX_ATTRIBUTE(ColorVertex, color)}};
+    }
+};
+
+/*
+Position quantized to 16 bits inside the bounding box of its chunk of PACK_CHUNK_SIZE consecutive vertices:
+position = chunk.offset + snorm(position) * chunk.scale, decoded in shader_packed.vert.
+*/
+struct PackedVertex
+{
+    int16_t position[4]; // R16G16B16A16_SNORM, w unused
+    uint8_t color[4];    // R8G8B8A8_UNORM
+
+    /*R16G16B16_SNORM is optional as a vertex format, the 4 component one is required*/
+    static constexpr std::array<VertexAttribute, 2> attributes()
+    {
+        return {{VERTEX_ATTRIBUTE(PackedVertex, position), VERTEX_ATTRIBUTE(PackedVertex, color)}};
+    }
+};
+
+static const uint32_t PACK_CHUNK_SHIFT = 16; // also the CHUNK_SHIFT of shader_packed.vert
+static const uint32_t PACK_CHUNK_SIZE = 1u << PACK_CHUNK_SHIFT;
 
-    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions();
+/*Decoding parameters of one chunk, std430 layout of the Chunks buffer of shader_packed.vert*/
+struct PackedChunk
+{
+    glm::vec4 offset; // center of the chunk's bounding box
+    glm::vec4 scale;  // half extent of the bounding box
 };
 
 #endif // _VERTEX_H_
\ No newline at end of file
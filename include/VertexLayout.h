@@ -0,0 +1,192 @@
+#ifndef _VERTEXLAYOUT_H_
+#define _VERTEXLAYOUT_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_core.h>
+
+/*
+Vertex input state derived at compile time from the field list of the vertex structs.
+
+A vertex struct lists the fields the shader reads, in location order:
+
+    struct Vertex
+    {
+        glm::vec3 position;
+        glm::vec3 color;
+        static constexpr std::array<VertexAttribute, 2> attributes()
+        {
+            return {{VERTEX_ATTRIBUTE(Vertex, position), VERTEX_ATTRIBUTE(Vertex, color)}};
+        }
+    };
+
+VertexLayout<Streams...> turns one or more such structs into the binding and attribute descriptions of a pipeline:
+stream i is binding i, locations are numbered consecutively over all streams in order. Split (SoA) streams are just
+several structs, VertexLayout<Positions, Colors>, and PerInstance<T> reads T once per instance instead of per vertex.
+Everything is a constexpr array, the pipeline points into them directly.
+*/
+
+/*One field of a vertex struct*/
+struct VertexAttribute
+{
+    VkFormat format;
+    uint32_t offset; // in the struct
+    uint32_t size;   // sizeof the field, checked against the size of format
+};
+
+/*
+Default format of a field type. Floats map to SFLOAT; the small integer arrays used by the packed layouts map to the
+normalized formats (shader sees [0, 1] / [-1, 1]). Anything else needs VERTEX_ATTRIBUTE_AS.
+*/
+template <typename T> struct VertexFormatOf;
+template <> struct VertexFormatOf<float> { static constexpr VkFormat value = VK_FORMAT_R32_SFLOAT; };
+template <> struct VertexFormatOf<glm::vec2> { static constexpr VkFormat value = VK_FORMAT_R32G32_SFLOAT; };
+template <> struct VertexFormatOf<glm::vec3> { static constexpr VkFormat value = VK_FORMAT_R32G32B32_SFLOAT; };
+template <> struct VertexFormatOf<glm::vec4> { static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_SFLOAT; };
+template <> struct VertexFormatOf<uint32_t> { static constexpr VkFormat value = VK_FORMAT_R32_UINT; };
+template <> struct VertexFormatOf<int32_t> { static constexpr VkFormat value = VK_FORMAT_R32_SINT; };
+template <> struct VertexFormatOf<uint8_t[4]> { static constexpr VkFormat value = VK_FORMAT_R8G8B8A8_UNORM; };
+template <> struct VertexFormatOf<int16_t[2]> { static constexpr VkFormat value = VK_FORMAT_R16G16_SNORM; };
+template <> struct VertexFormatOf<int16_t[4]> { static constexpr VkFormat value = VK_FORMAT_R16G16B16A16_SNORM; };
+
+#define VERTEX_ATTRIBUTE_AS(Struct, field, vkFormat)                                                                   \
+    VertexAttribute                                                                                                    \
+    {                                                                                                                  \
+        vkFormat, static_cast<uint32_t>(offsetof(Struct, field)), static_cast<uint32_t>(sizeof(Struct::field))        \
+    }
+#define VERTEX_ATTRIBUTE(Struct, field)                                                                                \
+    VERTEX_ATTRIBUTE_AS(Struct, field, VertexFormatOf<decltype(Struct::field)>::value)
+
+/*bytes of one element of a vertex format, 0 for the formats this file does not know*/
+constexpr uint32_t vertexFormatSize(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_R16G16_SNORM:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R32_SFLOAT:
+    case VK_FORMAT_R32_UINT:
+    case VK_FORMAT_R32_SINT: return 4;
+    case VK_FORMAT_R16G16B16A16_SNORM:
+    case VK_FORMAT_R16G16B16A16_UNORM:
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R16G16B16A16_SINT:
+    case VK_FORMAT_R16G16B16A16_UINT:
+    case VK_FORMAT_R32G32_SFLOAT:
+    case VK_FORMAT_R32G32_UINT:
+    case VK_FORMAT_R32G32_SINT: return 8;
+    case VK_FORMAT_R32G32B32_SFLOAT: return 12;
+    case VK_FORMAT_R32G32B32A32_SFLOAT: return 16;
+    default: return 0;
+    }
+}
+
+/*Stream read once per instance, same fields as T*/
+template <typename T> struct PerInstance
+{
+    static constexpr auto attributes() { return T::attributes(); }
+};
+
+namespace vertex_layout_detail
+{
+template <typename T> struct StreamTraits
+{
+    static constexpr VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    static constexpr uint32_t stride = sizeof(T);
+};
+template <typename T> struct StreamTraits<PerInstance<T>>
+{
+    static constexpr VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    static constexpr uint32_t stride = sizeof(T);
+};
+
+template <typename Stream> constexpr bool validStream()
+{
+    constexpr auto fields = Stream::attributes();
+    for (const VertexAttribute& field : fields)
+    {
+        if (vertexFormatSize(field.format) != field.size || field.offset + field.size > StreamTraits<Stream>::stride)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename... Streams> constexpr uint32_t attributeCount()
+{
+    return (0 + ... + static_cast<uint32_t>(Streams::attributes().size()));
+}
+
+/*stream i -> binding i*/
+template <typename... Streams>
+constexpr std::array<VkVertexInputBindingDescription, sizeof...(Streams)> makeBindings()
+{
+    std::array<VkVertexInputBindingDescription, sizeof...(Streams)> result{};
+    const uint32_t strides[] = {StreamTraits<Streams>::stride...};
+    const VkVertexInputRate rates[] = {StreamTraits<Streams>::inputRate...};
+    for (uint32_t i = 0; i < sizeof...(Streams); i++)
+    {
+        result[i].binding = i;
+        result[i].stride = strides[i];
+        result[i].inputRate = rates[i];
+    }
+    return result;
+}
+
+/*fields in declaration order, locations numbered on from one stream to the next*/
+template <typename... Streams>
+constexpr std::array<VkVertexInputAttributeDescription, attributeCount<Streams...>()> makeAttributes()
+{
+    std::array<VkVertexInputAttributeDescription, attributeCount<Streams...>()> result{};
+    uint32_t binding = 0;
+    uint32_t location = 0;
+    auto addStream = [&](const auto& fields) {
+        for (const VertexAttribute& field : fields)
+        {
+            result[location].location = location;
+            result[location].binding = binding;
+            result[location].format = field.format;
+            result[location].offset = field.offset;
+            location++;
+        }
+        binding++;
+    };
+    (addStream(Streams::attributes()), ...);
+    return result;
+}
+} // namespace vertex_layout_detail
+
+template <typename... Streams> struct VertexLayout
+{
+    static constexpr uint32_t bindingCount = sizeof...(Streams);
+    static constexpr uint32_t attributeCount = vertex_layout_detail::attributeCount<Streams...>();
+
+    static_assert(bindingCount > 0, "a vertex layout needs at least one stream");
+    static_assert((vertex_layout_detail::validStream<Streams>() && ...),
+        "vertex attribute format does not match the size of its field, or the field lies outside the stride");
+
+    static constexpr std::array<VkVertexInputBindingDescription, bindingCount> bindings
+        = vertex_layout_detail::makeBindings<Streams...>();
+    static constexpr std::array<VkVertexInputAttributeDescription, attributeCount> attributes
+        = vertex_layout_detail::makeAttributes<Streams...>();
+
+    /* the descriptions point to the constexpr arrays above, the result can be kept as long as needed */
+    static VkPipelineVertexInputStateCreateInfo inputState()
+    {
+        VkPipelineVertexInputStateCreateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        info.vertexBindingDescriptionCount = bindingCount;
+        info.pVertexBindingDescriptions = bindings.data();
+        info.vertexAttributeDescriptionCount = attributeCount;
+        info.pVertexAttributeDescriptions = attributes.data();
+        return info;
+    }
+};
+
+#endif // _VERTEXLAYOUT_H_
@@ -0,0 +1,31 @@
+#ifndef _VERTEXPACKING_H_
+#define _VERTEXPACKING_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "Vertex.h"
+
+/*
+Vertex -> the compact layouts of VertexFormat.
+Colors are rounded to 8 bits per channel (alpha 255). For PackedVertex the vertices are cut in chunks of
+PACK_CHUNK_SIZE, every chunk gets the bounding box of its positions and the positions are stored as SNORM16
+relative to it, so the error is at most half extent / 32767 per axis of the chunk. Chunks are converted in parallel on
+the pool.
+*/
+void packVertices(const Vertex* vertices, size_t count, ColorVertex* out, ThreadPool& pool = ThreadPool::global());
+
+/* out : count vertices, chunks : packedChunkCount(count) entries */
+void packVertices(const Vertex* vertices, size_t count, PackedVertex* out, PackedChunk* chunks,
+    ThreadPool& pool = ThreadPool::global());
+
+inline size_t packedChunkCount(size_t vertexCount) { return (vertexCount + PACK_CHUNK_SIZE - 1) / PACK_CHUNK_SIZE; }
+
+/* size of one vertex in format */
+size_t vertexStride(VertexFormat format);
+
+/* decode of a packed vertex, the same math as shader_packed.vert */
+glm::vec3 unpackPosition(const PackedVertex& vertex, const PackedChunk& chunk);
+
+#endif // _VERTEXPACKING_H_
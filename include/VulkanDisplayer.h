@@ -9,25 +9,49 @@
 #include <GLFW/glfw3.h>
 
 #include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <iostream>
+#include <string>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Vertex.h"
+#include "DirtyRanges.h"
+#include "FrameProfiler.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+#include "VertexPacking.h"
+#include "ChunkCuller.h"
+#include "DeletionQueue.h"
+#include "DrawList.h"
+#include "DepthProjector.h"
+#include "FrameIngest.h"
+#include "LatencyTracker.h"
+#include "Logger.h"
+#include "OctreeStreamer.h"
+#include "PointCloudFile.h"
+#include "SceneCache.h"
+#include "PipelineCache.h"
+#include "ShaderWatcher.h"
+#include "StreamingTexture.h"
 
 static const int WIDTH = 800;
 static const int HEIGHT = 600;
 static const int MAX_FRAMES_IN_FLIGHT = 3;
 
+static const uint32_t UNIFORM_SLOTS_PER_FRAME = 64; // UniformObjects (per frame + per object data) per frame in flight
+
 #define VK_CHECK(x)                                                                                                    \
     do                                                                                                                 \
     {                                                                                                                  \
         VkResult err = x;                                                                                              \
         if (err)                                                                                                       \
         {                                                                                                              \
-            printf("Detected Vulkan error: %d", err);                                                                  \
+            VD_LOG_ERROR("Detected Vulkan error: %d", static_cast<int>(err));                                          \
             abort();                                                                                                   \
         }                                                                                                              \
     } while (0)
@@ -54,16 +78,19 @@ struct QueueFamilyIndices
     /*Initial value of -1 represents "Not found" or "Not available"*/
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    /*A transfer only family (DMA engine) if the device has one, the graphics family otherwise*/
+    std::optional<uint32_t> transferFamily;
 
     /*
     Once the neccessary queries to the device have been processed,
     we would either remain with -1 for one or either of the queues,
     or both would now have a positive index ( or 0).
     */
-    bool isComplete()
+    bool isComplete(bool needPresent = true)
     {
         /*If this function returns true, then both type of queue famileis are supported on our device*/
-        return graphicsFamily.has_value() && presentFamily.has_value();
+        /*A headless displayer never presents, so only the graphics queue is required*/
+        return graphicsFamily.has_value() && (presentFamily.has_value() || !needPresent);
     }
 };
 
@@ -80,14 +107,45 @@ struct SwapChainSupportDetails // comment this
                       // presenting looping the images in the swap chain.
 };
 
+/*
+How the displayer gets its render targets.
+Windowed : a GLFW window, a surface and a swapchain, frames are presented to the screen.
+Headless : no window, no surface and no swapchain, frames are rendered into offscreen images (batch rendering on
+           servers, software Vulkan like lavapipe in CI).
+*/
+enum class DisplayMode
+{
+    Windowed,
+    Headless
+};
+
+/*
+How the vertices change over time.
+Static  : uploaded once into a single device local buffer shared by every frame in flight.
+Dynamic : the vertices are edited with updateVertices(), every frame in flight streams from its own host visible
+          buffer and only the ranges modified since that buffer was last used are copied into it.
+*/
+enum class GeometryUsage
+{
+    Static,
+    Dynamic
+};
+
 class VulkanDisplayer
 {
 
 public:
-    VulkanDisplayer(const std::vector<Vertex>& vertices_, const std::vector<uint32_t>& indices_)
+    /* frameLimit : number of frames to render before run() returns, 0 means run until the window is closed or
+     * requestStop() is called */
+    VulkanDisplayer(const std::vector<Vertex>& vertices_, const std::vector<uint32_t>& indices_,
+        DisplayMode mode_ = DisplayMode::Windowed, uint64_t frameLimit_ = 0,
+        GeometryUsage geometryUsage_ = GeometryUsage::Static)
     {
         vertices = vertices_;
         indices = indices_;
+        mode = mode_;
+        frameLimit = frameLimit_;
+        geometryUsage = geometryUsage_;
     }
     ~VulkanDisplayer() {}
 
@@ -98,12 +156,20 @@ private:
 
     /************************ Data *************************/
 
-    GLFWwindow* window; // GLFW window object
+    DisplayMode mode = DisplayMode::Windowed;
+    GeometryUsage geometryUsage = GeometryUsage::Static;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; // POINT_LIST for point clouds
+    VertexFormat vertexFormat = VertexFormat::Float32; // layout of static geometry on the GPU
+    uint64_t frameLimit = 0;                  // 0 : no limit
+    uint64_t frameCount = 0;                  // frames submitted since initVulkan()
+    std::atomic<bool> stopRequested{false};   // set by requestStop(), may come from another thread
+
+    GLFWwindow* window = nullptr; // GLFW window object
 
     /************************* Vulkans *************************/
     VkInstance instance;  // The Vulkan instance represents the connection between OUR application the Vulkan API.
-    VkSurfaceKHR surface; // The surface is an interface between the NATIVE windowing API and the Vulkan API. Note, this
-                          // is platform specific always.
+    VkSurfaceKHR surface = VK_NULL_HANDLE; // The surface is an interface between the NATIVE windowing API and the
+                                           // Vulkan API. Note, this is platform specific always.
 
     VkDebugUtilsMessengerEXT debugMessenger;
 
@@ -112,15 +178,21 @@ private:
 
     VkQueue graphicsQueue; // The graphics queue is used to submit command buffers that render images.
     VkQueue presentQueue;  // A set of commands that execture presentation commands
+    VkQueue transferQueue; // Uploads, see UploadManager. Same as graphicsQueue if there is no transfer only family
 
-    VkSwapchainKHR swapChain; // The swap chain is essentially a queue of images that are waiting to be presented to the
-                              // screen.
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE; // The swap chain is essentially a queue of images that are waiting to
+                                               // be presented to the screen.
     VkFormat swapChainImageFormat; // The chosen surface format will be stored in this variable.
     VkExtent2D swapChainExtent;    // A handle representing the resolution of the images inside the swap chain.
     // VkExtent2D displaySizeIdentity;
 
     std::vector<VkImage> swapChainImages;         // The images in the swap chain.
     std::vector<VkImageView> swapChainImageViews; // The image views are used to represent the images in the swap chain.
+                                                  // In headless mode they are the views of the offscreen images.
+
+    /*Headless render targets, one per frame in flight so that frame i never clears an image frame i-1 still draws to*/
+    std::vector<VkImage> offscreenImages;
+    std::vector<Allocation> offscreenImageMemory;
 
     VkRenderPass renderPass; // Denotes the number and type of formats used in the rendering pass.
 
@@ -132,9 +204,31 @@ private:
     std::vector<VkFramebuffer> swapChainFramebuffers; // An array of valid render targets which can be rendered to
                                                       // and then submitted to the Queue to execute on the device.
 
-    VkCommandPool commandPool; // The command pool is used to allocate command buffers that will be submitted to the
+    std::array<VkCommandPool, MAX_FRAMES_IN_FLIGHT> frameCommandPools{}; // one per frame slot, reset as a whole
     std::vector<VkCommandBuffer> commandBuffers; // The command buffers are used to record commands that will be
-                                                 // submitted to the device.
+                                                 // submitted to the device. One per frame slot, recorded every frame
+
+    /*Draw list : the index buffer cut in chunks of about drawChunkIndices indices, one draw each*/
+    uint32_t drawChunkIndices = 65536;
+    std::vector<DrawChunk> drawChunks;
+    /*Parallel recording : each job records its part of the draw list into a secondary command buffer allocated from
+     * its own pool, [frame slot][job]. No pools when recordingThreads is 0, everything is recorded inline*/
+    uint32_t recordingThreads = 0;
+    std::array<std::vector<VkCommandPool>, MAX_FRAMES_IN_FLIGHT> secondaryCommandPools;
+    std::array<std::vector<VkCommandBuffer>, MAX_FRAMES_IN_FLIGHT> secondaryCommandBuffers;
+
+    /*GPU culling of the draw list, see ChunkCuller. Static geometry only, the chunk bounds are computed once*/
+    bool gpuCullingEnabled = false;
+    ChunkCuller culler;
+    bool drawIndirectCountEnabled = false; // VK_KHR_draw_indirect_count was enabled on the device
+    bool multiDrawIndirectEnabled = false; // the multiDrawIndirect feature was enabled
+    glm::mat4 frameMvp = glm::mat4(1.0f);  // mvp of the frame being recorded, the culling frustum
+
+    /*Objects replaced while frames in flight may still use them (swapchain recreation, shader hot reload)*/
+    DeletionQueue deletionQueue;
+    std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> slotSubmittedFrames{}; // frameCount right after each slot's last submit
+    uint64_t completedFrames = 0;                                     // frames whose fence signalled
+    bool swapChainOutOfDate = false; // recreation postponed while the window is minimized
 
     /*Semaphores are used to synchronize the application on a global level as it otherwise does not exist by default to
      * ensure maximum performance. (Explained better in the cpp file)*/
@@ -142,26 +236,102 @@ private:
     std::vector<VkSemaphore> renderFinishedSemaphores;
     std::vector<VkFence> inFlightFences;
 
-    std::vector<VkBuffer> vertexBuffer;
-    std::vector<VkDeviceMemory> vertexBufferMemory;
+    /*Static geometry : the one device local copy. Indices never change, so the index buffer is always shared*/
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    Allocation vertexBufferMemory;
 
-    std::vector<VkBuffer> indexBuffer;
-    std::vector<VkDeviceMemory> indexBufferMemory;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    Allocation indexBufferMemory;
 
-    std::vector<VkBuffer> uniformBuffer;
-    std::vector<VkDeviceMemory> uniformBufferMemory;
+    /*VertexFormat::Packed16 : one PackedChunk per PACK_CHUNK_SIZE vertices, read by shader_packed.vert (binding 1)*/
+    VkBuffer vertexChunkBuffer = VK_NULL_HANDLE;
+    Allocation vertexChunkMemory;
 
-    VkDescriptorPool descriptorPool; // The descriptor pool which contains the descriptor sets
+    /*Static geometry converted by prepareVertexData(), released once uploaded*/
+    std::vector<ColorVertex> colorVertices;
+    std::vector<PackedVertex> packedVertices;
+    std::vector<PackedChunk> packedChunks;
 
-    std::vector<VkDescriptorSet>
-        descriptorSets; // The descriptor set that will contain all ... ubos? ResourceS? Something?!
     /*
-    TODO: I'm not sure whether to use texture here, becauce we dont use texture.
-        VkImage textureImage;
-        VkDeviceMemory textureImageMemory;
+    Dynamic geometry : one persistently mapped buffer per frame in flight. A buffer may still be read by the GPU
+    while the CPU edits the vertices, so every edit is recorded in the dirty ranges of every frame slot and a slot's
+    buffer is only patched once its fence signalled, in updateVertexBuffer().
     */
+    std::array<VkBuffer, MAX_FRAMES_IN_FLIGHT> streamingVertexBuffers{};
+    std::array<Allocation, MAX_FRAMES_IN_FLIGHT> streamingVertexMemory{};
+    std::array<DirtyRanges, MAX_FRAMES_IN_FLIGHT> vertexDirtyRanges; // in vertices
+    std::mutex vertexMutex;                                          // vertices + vertexDirtyRanges
+
+    /*
+    All uniform data lives in one host-coherent buffer mapped once for its whole lifetime. It is split into
+    MAX_FRAMES_IN_FLIGHT regions of UNIFORM_SLOTS_PER_FRAME slots, a slot is selected at bind time with a dynamic
+    offset (VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC), so writing uniforms never needs a map call or a new descriptor.
+    */
+    VkBuffer uniformBuffer;
+    Allocation uniformBufferMemory;
+    uint8_t* uniformBufferMapped = nullptr;
+    VkDeviceSize uniformSlotStride = 0; // sizeof(UniformObject) rounded up to minUniformBufferOffsetAlignment
+
+    VkDescriptorPool descriptorPool; // The descriptor pool which contains the descriptor sets
+
+    VkDescriptorSet descriptorSet; // The descriptor set that will contain all ... ubos? ResourceS? Something?! With
+                                   // dynamic offsets a single set serves every frame in flight.
+    /*Camera color stream shown next to the point cloud : a texture replaced up to every frame and drawn in a corner,
+     * its combined image sampler comes from descriptorPool, see StreamingTexture*/
+    bool colorOverlayEnabled = false;
+    StreamingTexture colorTexture;
     UniformObject ubo;
 
+    FrameProfiler profiler; // GPU timestamps + CPU stage timings of every frame
+
+    /*Frame pacing. The per slot resources are always created for MAX_FRAMES_IN_FLIGHT, only the first
+     * framesInFlight slots are cycled through*/
+    uint32_t framesInFlight = MAX_FRAMES_IN_FLIGHT;
+    std::optional<VkPresentModeKHR> requestedPresentMode; // none : chooseSwapPresentMode() picks
+    /*Low latency pacing : main_loop() waits for the previous frame right before it samples the inputs of the next
+     * one, see waitForPreviousFrame()*/
+    bool lowLatencyEnabled = false;
+    bool properties2Enabled = false; // VK_KHR_get_physical_device_properties2 was enabled on the instance
+    bool presentWaitEnabled = false; // VK_KHR_present_id + VK_KHR_present_wait were enabled on the device
+    PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+    uint64_t lastPresentId = 0;                           // present id (frameCount) of the last queued image
+    VkSwapchainKHR lastPresentSwapChain = VK_NULL_HANDLE; // the swapchain it was queued to
+    LatencyTracker latency;
+
+    MemoryAllocator allocator; // every buffer and image memory comes from here, see MemoryAllocator.h
+    UploadManager uploads;     // asynchronous host -> device copies
+    UploadTicket geometryTicket = 0; // vertex + index data, waited on before the first draw that uses it
+
+    /*Compiled pipelines of the previous runs, see PipelineCache.h*/
+    PipelineCache pipelineCache;
+    std::string pipelineCachePath = "pipeline_cache.bin";
+
+    /*Shader hot reload : the watcher thread compiles the saved shader and builds a new pipeline, render() swaps it in
+     * at a frame boundary, see applyReloadedPipeline()*/
+    std::string shaderSourceDir; // empty : hot reload disabled
+    ShaderWatcher shaderWatcher;
+    std::vector<uint32_t> vertSpirv; // stages of the current pipeline, a reload replaces one of them
+    std::vector<uint32_t> fragSpirv;
+    std::atomic<VkPipeline> pendingPipeline{VK_NULL_HANDLE};          // built, not picked up by render() yet
+
+    /*GPU depth back-projection : the vertices are produced by a compute shader every frame, see DepthProjector*/
+    bool depthProjectionEnabled = false;
+    DepthProjector depthProjector;
+    /*Frames decoded by the ingest thread, the newest one is handed to the depth projection before each frame*/
+    std::shared_ptr<FrameIngest> frameIngest;
+    CameraIntrinsics ingestIntrinsics;
+
+    /*Points of a mapped PLY / PCD file, converted chunk by chunk straight into the staging ring and drawn non indexed*/
+    std::shared_ptr<const PointCloudFile> pointFile;
+    /*Geometry of a scene cache, already in its GPU layout (vertexFormat comes from the cache), see SceneCache*/
+    std::shared_ptr<const SceneCache> sceneCache;
+
+    /*Octree LOD : the points come from the nodes OctreeStreamer selected and streamed in this frame, no index buffer*/
+    bool octreeEnabled = false;
+    std::shared_ptr<const PointOctree> octree;
+    uint64_t octreePointBudget = 0;
+    OctreeStreamer octreeStreamer;
+
     /*The coordinate frame's vectors*/
     glm::vec3 cameraForwardVector = glm::vec3(0.0f, -1.0f, 0.0f);
     glm::vec3 cameraUpVector = glm::vec3(0.0f, 0.0f, 1.0f);
@@ -173,16 +343,79 @@ public:
     void initVulkan();
     void render();
     void main_loop();
+    /* ask main_loop() to return after the current frame, safe to call from any thread */
+    void requestStop() { stopRequested = true; }
+    bool isHeadless() const { return mode == DisplayMode::Headless; }
+    uint64_t getFrameCount() const { return frameCount; }
+    /* per frame CPU/GPU timings, still readable after run() returned */
+    const FrameProfiler& getProfiler() const { return profiler; }
+    /* live device memory statistics */
+    const MemoryAllocator& getAllocator() const { return allocator; }
+    /* Dynamic geometry only : overwrite count vertices starting at first, visible from the next rendered frame. Safe
+     * to call from any thread */
+    void updateVertices(uint32_t first, const Vertex* data, uint32_t count);
+    /* how the indices are assembled, call before run() */
+    void setTopology(VkPrimitiveTopology topology_) { topology = topology_; }
+    /* GPU layout of Static geometry, call before run(). Dynamic geometry and depth projection always use Float32 */
+    void setVertexFormat(VertexFormat vertexFormat_) { vertexFormat = vertexFormat_; }
+    /* file the pipeline cache is loaded from and saved to, empty disables it. Call before run() */
+    void setPipelineCachePath(const std::string& path) { pipelineCachePath = path; }
+    /* rebuild the graphics pipeline whenever one of its shaders is saved in shaderDir (Linux), without stalling the
+     * rendering. Needs glslc at run time, call before run() */
+    void enableShaderHotReload(const std::string& shaderDir) { shaderSourceDir = shaderDir; }
+    /* record the draw list on up to threads threads (secondary command buffers), 0 : all on the render thread. Call
+     * before run() */
+    void setRecordingThreads(uint32_t threads) { recordingThreads = threads; }
+    /* indices per draw of the draw list, call before run() */
+    void setDrawChunkSize(uint32_t chunkIndices) { drawChunkIndices = chunkIndices; }
+    /* frustum cull the chunks of the draw list on the GPU every frame (static geometry), call before run() */
+    void enableGpuCulling() { gpuCullingEnabled = true; }
+    /* draw the point cloud computed on the GPU from width x height depth frames instead of the vertices given to the
+     * constructor, call before run() */
+    void enableDepthProjection(uint32_t width, uint32_t height);
+    /* depth : 16-bit, color : 8-bit BGR or BGRA, both width x height and tightly packed. Any thread, any time after
+     * enableDepthProjection() */
+    void submitDepthFrame(
+        const uint16_t* depth, const uint8_t* color, uint32_t colorChannels, const CameraIntrinsics& intrinsics);
+    /* feed the depth projection with the frames of ingest (opened, started by the caller), the newest one is taken
+     * before each frame is rendered. Call before run(), after enableDepthProjection() */
+    void setFrameIngest(std::shared_ptr<FrameIngest> ingest, const CameraIntrinsics& intrinsics);
+    /* show width x height color images in the top right corner, call before run() */
+    void enableColorOverlay(uint32_t width, uint32_t height);
+    /* 8-bit BGR, width x height, referenced until a frame has uploaded it (see StreamingTexture::submitImage()). Any
+     * thread, any time after enableColorOverlay() */
+    void submitColorImage(const cv::Mat& image);
+    /* draw the points of file instead of the vertices given to the constructor. They go from the file mapping to the
+     * vertex buffer through the staging ring, never through a std::vector. Call before run() */
+    void setPointCloudFile(std::shared_ptr<const PointCloudFile> file);
+    /* draw the geometry of a scene cache (Static) instead of the vertices given to the constructor, its vertex format,
+     * topology and draw list replace the ones set here. Call before run() */
+    void setSceneCache(std::shared_ptr<const SceneCache> cache);
+    /* draw octree (possibly still building, or opened from a file) instead of the vertices given to the constructor,
+     * at most pointBudget points per frame, streamed in as the view needs them. Call before run() */
+    void enableOctree(std::shared_ptr<const PointOctree> octree_, uint64_t pointBudget);
+    /* how images are queued for the screen. Falls back to chooseSwapPresentMode()'s choice when the surface does not
+     * support it. Call before run() */
+    void setPresentMode(VkPresentModeKHR presentMode) { requestedPresentMode = presentMode; }
+    /* frames the CPU may record ahead of the GPU, 1 to MAX_FRAMES_IN_FLIGHT. Call before run() */
+    void setFramesInFlight(uint32_t frames);
+    /* sample the inputs of a frame only once the previous frame is on screen (VK_KHR_present_wait when the device has
+     * it) or finished on the GPU, and keep the swapchain queue short. Call before run() */
+    void enableLowLatency() { lowLatencyEnabled = true; }
+    /* sample-to-present latency of the rendered frames, see LatencyTracker */
+    const LatencyTracker& getLatency() const { return latency; }
     bool is_initialized = false;
     int currentFrame = 0;
 
 private:
     /*initializing GLFW window (only on linux/windows)*/
     void initWindow();
+    bool shouldStop();
+    void waitForPreviousFrame();
     /* some reset funs */
     void cleanup();
     void cleanupSwapChain();
-    void recreateSwapChain();
+    bool recreateSwapChain();
     /*initializing vulkan passes */
     bool checkValidationLayerSupport();
     std::vector<const char*> getRequiredExtensions();
@@ -193,6 +426,7 @@ private:
     void createSurface();      // step 3
     void pickPhysicalDevice(); // step 4
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
+    std::vector<const char*> getRequiredDeviceExtensions();
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
     bool isDeviceSuitable(VkPhysicalDevice device);
@@ -202,32 +436,55 @@ private:
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
     void createSwapChain();           // step 6
+    void createOffscreenTargets();    // step 6 (headless), replaces the swapchain
     void createImageViews();          // step 7
     void createRenderPass();          // step 8
     void createDescriptorSetLayout(); // step 9 设置shader中的uniform数据的分布
-    std::vector<char> readFile(const std::string& filename);
-    VkShaderModule createShaderModule(const std::vector<char>& data);
+    /* code : SPIR-V words embedded at build time, see Shaders.h */
+    VkShaderModule createShaderModule(const uint32_t* code, size_t codeSize);
+    template <size_t N> VkShaderModule createShaderModule(const uint32_t (&code)[N])
+    {
+        return createShaderModule(code, sizeof(code));
+    }
     void createGraphicsPipeline(); // step 10
+    VkPipeline buildGraphicsPipeline(
+        VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, const char* name); // hot reload too
+    void createComputePipeline();  // step 10 (depth projection only)
+    void createColorOverlay();     // step 10 (color overlay only)
+    void createCullingPipeline();  // step 10 (GPU culling only)
     void createFramebuffers();     // step 11
     void createCommandPool();      // step 12
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer,
-        VkDeviceMemory& bufferMemory);
-    VkCommandBuffer beginSingleTimeCommands();                                  // 用于创建提交command
-    void endSingleTimeCommands(VkCommandBuffer commandBuffer);                  //用于完成提交command
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size); // 内存拷贝
-    void createVertexBuffer();                                                  // step 13
-    void createIndexBuffer();                                                   // step 14
-    void createUniformBuffer();                                                 // step 15
-    void createDescriptorPool();                                                // step 16
-    void createDescriptorSets();                                                // step 17
-    void createCommandBuffers();                                                // step 18
-    void createSemaphores();                                                    // step 19
-    // void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage, VkBuffer& buffer,
+        Allocation& allocation, const std::vector<uint32_t>& queueFamilies = {});
+    void prepareVertexData();
+    void createVertexBuffer();     // step 13
+    void uploadPointCloudFile();   // step 13 (point file)
+    void uploadSceneCache();       // step 13-14 (scene cache)
+    void createIndexBuffer();      // step 14
+    void createUniformBuffer();    // step 15
+    void createDescriptorPool();   // step 16
+    void createDescriptorSets();   // step 17
+    void createCommandBuffers();   // step 18
+    void createSemaphores();       // step 19
+    void buildDrawList();
+    void recordCommandBuffer(uint32_t frame, uint32_t imageIndex);
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t frame, size_t firstChunk, size_t endChunk);
+    void recordSecondaryCommandBuffers(uint32_t frame, uint32_t imageIndex, uint32_t jobs);
+    uint32_t recordingJobCount() const;
+    /* else vkCmdDraw / vkCmdDrawIndirect, no index buffer */
+    bool indexedDraws() const { return !octreeEnabled && !pointFile && !depthProjectionEnabled; }
 
     /* rendering passes */
+    uint32_t uniformOffset(uint32_t frame, uint32_t slot) const;
+    uint32_t writeUniform(uint32_t frame, uint32_t slot, const UniformObject& data);
     void updateUniformBuffer(uint32_t currentImage);
     void updateVertexBuffer(uint32_t currentImage);
+    VkBuffer frameVertexBuffer(uint32_t frame) const; // the vertex buffer frame slot frame draws from
+    VertexFormat activeVertexFormat() const;          // vertexFormat if it applies to the geometry, else Float32
+
+    /* shader hot reload */
+    void reloadShader(const std::string& fileName); // watcher thread
+    void applyReloadedPipeline();                   // render thread
     // TODO: we dont need this, because our indices dont change.
     // void updateIndexBuffer(uint32_t currentImage);
 };
@@ -1,9 +1,20 @@
 #include "Vertex.h"
 #include "VulkanDisplayer.h"
+#include "PointCloudBuilder.h"
+#include "PointCloudFile.h"
+#include "PointOctree.h"
+#include "FrameIngest.h"
+#include "SceneCache.h"
 #include <vulkan/vulkan.h>
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <future>
+#include <memory>
 #include <opencv2/opencv.hpp>
-int main()
+int main(int argc, char** argv)
 
 {
     std::cout << "Vulkan version " << VK_VERSION_MAJOR(VK_HEADER_VERSION) << "." << VK_VERSION_MINOR(VK_HEADER_VERSION)
@@ -21,11 +32,425 @@ int main()
     indices.push_back(1);
     indices.push_back(2);
 
-    VulkanDisplayer displayer(vertices, indices);
+    // ./displayer --headless [frames] : render offscreen without a window, 0 frames means until killed
+    // ./displayer --profile <file.csv|file.json> : dump the per frame timings when the displayer exits
+    // ./displayer --dynamic : vertices can be edited while rendering (per frame streaming buffers)
+    // ./displayer --rgbd <color> <depth> <fx> <fy> <cx> <cy> : render the point cloud of a registered RGB-D pair
+    // ./displayer --rgbd-gpu <color> <depth> <fx> <fy> <cx> <cy> : same, back-projected by a compute shader
+    // ./displayer --pipeline-cache <file> : where the pipeline cache is kept between runs ("" disables it)
+    // ./displayer --vertex-format <float|rgba8|packed16> : GPU layout of static geometry (24, 16 or 12 bytes per
+    // vertex)
+    // ./displayer --hot-reload [dir] : rebuild the graphics pipeline when a shader of dir (default : the source tree's
+    // shaders/) is saved
+    // ./displayer --record-threads <n> [--draw-chunk <indices>] : record the draw list (chunks of indices, default
+    // 65536) on n threads into secondary command buffers
+    // ./displayer --gpu-cull : frustum cull the chunks of the draw list in a compute pass, drawn indirectly
+    // ./displayer --load <file.ply|file.pcd> : render a binary PLY / PCD point cloud, streamed from the mapped file
+    // ./displayer --ingest <video|dir> <fx> <fy> <cx> <cy> [--ingest-fps <fps>] [--ingest-depth <depth>] : play a
+    // recorded RGB-D stream (a video at a constant raw depth, default 1000, or dir/color|rgb + dir/depth images),
+    // decoded on its own thread at the source rate (or fps) and back-projected by the compute shader
+    // ./displayer --rgbd ... | --rgbd-gpu ... | --ingest ... --show-color : show the color images in a corner
+    // ./displayer --cache <file> : render a scene cache, already packed in its GPU layout
+    // ./displayer ... --save-cache <file> [--cache-lz4] : write the geometry (in --vertex-format, cut in --draw-chunk
+    // draws) to a scene cache, LZ4 compressed if the build has LZ4
+    // ./displayer --octree <file> [--point-budget <points>] : stream the LOD octree of file, at most <points> points
+    // (default 2000000) a frame
+    // ./displayer --rgbd ... | --load ... --octree-build <file> : draw the point cloud through an octree built in the
+    // background, written to file when the displayer exits
+    // ./displayer --present-mode <fifo|fifo-relaxed|mailbox|immediate> : how images are queued for the screen
+    // ./displayer --frames-in-flight <1-3> : frames recorded ahead of the GPU (default 3)
+    // ./displayer --low-latency : sample the inputs once the previous frame is on screen (VK_KHR_present_wait) or done
+    // on the GPU, the sample to present latency is printed when the displayer exits
+    DisplayMode mode = DisplayMode::Windowed;
+    GeometryUsage geometryUsage = GeometryUsage::Static;
+    uint64_t frameLimit = 0;
+    std::string profilePath;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VertexFormat vertexFormat = VertexFormat::Float32;
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    std::string shaderDir; // --hot-reload
+    uint32_t recordingThreads = 0;
+    uint32_t drawChunkIndices = 65536;
+    bool gpuCulling = false;
+    std::shared_ptr<PointCloudFile> pointFile; // --load
+    std::string cachePath;                     // --cache
+    std::string saveCachePath;                 // --save-cache
+    SceneCompression cacheCompression = SceneCompression::None;
+    std::string octreePath;      // --octree
+    std::string octreeBuildPath; // --octree-build
+    uint64_t pointBudget = 2000000;
+    cv::Mat gpuColor, gpuDepth; // --rgbd-gpu
+    CameraIntrinsics gpuIntrinsics;
+    std::string ingestSource; // --ingest
+    CameraIntrinsics ingestIntrinsics;
+    double ingestFps = 0.0;
+    bool showColor = false; // --show-color
+    cv::Mat overlayColor;   // the color image of --rgbd / --rgbd-gpu
+    uint16_t ingestDepth = 1000;
+    std::optional<VkPresentModeKHR> presentMode; // --present-mode
+    uint32_t framesInFlight = MAX_FRAMES_IN_FLIGHT;
+    bool lowLatency = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+        {
+            mode = DisplayMode::Headless;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                frameLimit = std::stoull(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            profilePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--dynamic") == 0)
+        {
+            geometryUsage = GeometryUsage::Dynamic;
+        }
+        else if (strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc)
+        {
+            pipelineCachePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--hot-reload") == 0)
+        {
+            shaderDir = VD_SHADER_DIR;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                shaderDir = argv[++i];
+            }
+        }
+        else if (strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc)
+        {
+            recordingThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--gpu-cull") == 0)
+        {
+            gpuCulling = true;
+        }
+        else if (strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (name == "fifo")
+            {
+                presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            }
+            else if (name == "fifo-relaxed")
+            {
+                presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            }
+            else if (name == "mailbox")
+            {
+                presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            }
+            else if (name == "immediate")
+            {
+                presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            }
+            else
+            {
+                std::cerr << "Unknown present mode " << name << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+        {
+            framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+            if (framesInFlight < 1 || framesInFlight > MAX_FRAMES_IN_FLIGHT)
+            {
+                std::cerr << "--frames-in-flight takes 1 to " << MAX_FRAMES_IN_FLIGHT << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--low-latency") == 0)
+        {
+            lowLatency = true;
+        }
+        else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc)
+        {
+            pointFile = std::make_shared<PointCloudFile>();
+            if (!pointFile->open(argv[++i]))
+            {
+                return EXIT_FAILURE;
+            }
+            std::cout << "Point cloud file : " << pointFile->pointCount() << " points" << std::endl;
+        }
+        else if (strcmp(argv[i], "--ingest") == 0 && i + 5 < argc)
+        {
+            ingestSource = argv[i + 1];
+            ingestIntrinsics.fx = std::stof(argv[i + 2]);
+            ingestIntrinsics.fy = std::stof(argv[i + 3]);
+            ingestIntrinsics.cx = std::stof(argv[i + 4]);
+            ingestIntrinsics.cy = std::stof(argv[i + 5]);
+            i += 5;
+        }
+        else if (strcmp(argv[i], "--show-color") == 0)
+        {
+            showColor = true;
+        }
+        else if (strcmp(argv[i], "--ingest-fps") == 0 && i + 1 < argc)
+        {
+            ingestFps = std::stod(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ingest-depth") == 0 && i + 1 < argc)
+        {
+            ingestDepth = static_cast<uint16_t>(std::stoul(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+        {
+            cachePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--save-cache") == 0 && i + 1 < argc)
+        {
+            saveCachePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache-lz4") == 0)
+        {
+            cacheCompression = SceneCompression::LZ4;
+        }
+        else if (strcmp(argv[i], "--octree") == 0 && i + 1 < argc)
+        {
+            octreePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--octree-build") == 0 && i + 1 < argc)
+        {
+            octreeBuildPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--point-budget") == 0 && i + 1 < argc)
+        {
+            pointBudget = std::stoull(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--draw-chunk") == 0 && i + 1 < argc)
+        {
+            drawChunkIndices = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc)
+        {
+            std::string format = argv[++i];
+            if (format == "rgba8")
+            {
+                vertexFormat = VertexFormat::ColorUnorm8;
+            }
+            else if (format == "packed16")
+            {
+                vertexFormat = VertexFormat::Packed16;
+            }
+            else if (format != "float")
+            {
+                std::cerr << "Unknown vertex format " << format << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if ((strcmp(argv[i], "--rgbd") == 0 || strcmp(argv[i], "--rgbd-gpu") == 0) && i + 6 < argc)
+        {
+            bool gpu = strcmp(argv[i], "--rgbd-gpu") == 0;
+            cv::Mat color = cv::imread(argv[i + 1], cv::IMREAD_COLOR);
+            cv::Mat depth = cv::imread(argv[i + 2], cv::IMREAD_ANYDEPTH);
+            CameraIntrinsics intrinsics;
+            intrinsics.fx = std::stof(argv[i + 3]);
+            intrinsics.fy = std::stof(argv[i + 4]);
+            intrinsics.cx = std::stof(argv[i + 5]);
+            intrinsics.cy = std::stof(argv[i + 6]);
+            i += 6;
+            if (color.empty() || depth.empty())
+            {
+                std::cerr << "Failed to read the RGB-D images!" << std::endl;
+                return EXIT_FAILURE;
+            }
+            overlayColor = color;
+            if (gpu)
+            {
+                if (depth.type() != CV_16UC1 || !depth.isContinuous() || !color.isContinuous())
+                {
+                    std::cerr << "--rgbd-gpu needs a 16-bit depth image" << std::endl;
+                    return EXIT_FAILURE;
+                }
+                gpuColor = color;
+                gpuDepth = depth;
+                gpuIntrinsics = intrinsics;
+                continue;
+            }
+
+            PointCloudBuilder builder;
+            auto start = std::chrono::steady_clock::now();
+            builder.build(color, depth, intrinsics, vertices);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Point cloud : " << vertices.size() << " points in " << ms << " ms" << std::endl;
+
+            indices.resize(vertices.size());
+            for (uint32_t index = 0; index < indices.size(); index++)
+            {
+                indices[index] = index;
+            }
+            topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+        }
+    }
+
+    if (!saveCachePath.empty())
+    {
+        if (pointFile)
+        {
+            /*the cache is written from a cloud in memory, drawn through indices like any geometry*/
+            vertices.resize(pointFile->pointCount());
+            pointFile->convert(0, vertices.size(), vertices.data());
+            pointFile.reset();
+            indices.resize(vertices.size());
+            for (uint32_t index = 0; index < indices.size(); index++)
+            {
+                indices[index] = index;
+            }
+            topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (!SceneCache::write(
+                saveCachePath, vertices, indices, topology, vertexFormat, drawChunkIndices, cacheCompression))
+        {
+            return EXIT_FAILURE;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Scene cache written to " << saveCachePath << " in " << ms << " ms" << std::endl;
+    }
+    std::shared_ptr<SceneCache> sceneCache;
+    if (!cachePath.empty())
+    {
+        sceneCache = std::make_shared<SceneCache>();
+        if (!sceneCache->open(cachePath))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::shared_ptr<FrameIngest> ingest;
+    if (!ingestSource.empty())
+    {
+        ingest = std::make_shared<FrameIngest>();
+        if (!ingest->open(ingestSource, ingestDepth))
+        {
+            return EXIT_FAILURE;
+        }
+        std::cout << "Ingest : " << ingest->width() << "x" << ingest->height() << " at " << ingest->sourceFps()
+                  << " fps" << std::endl;
+    }
+
+    std::shared_ptr<PointOctree> octree;
+    std::future<void> octreeBuilt;
+    if (!octreePath.empty())
+    {
+        octree = std::make_shared<PointOctree>();
+        if (!octree->open(octreePath))
+        {
+            return EXIT_FAILURE;
+        }
+        std::cout << "Octree : " << octree->nodes().size() << " nodes, " << octree->pointCount() << " points"
+                  << std::endl;
+    }
+    else if (!octreeBuildPath.empty())
+    {
+        if (pointFile)
+        {
+            /*the builder works on a cloud in memory*/
+            vertices.resize(pointFile->pointCount());
+            pointFile->convert(0, vertices.size(), vertices.data());
+            pointFile.reset();
+        }
+        /*built while the window and the device come up, drawn as soon as it is ready. The cloud is handed over, the
+         * displayer draws the nodes without indices : neither is kept here*/
+        octree = std::make_shared<PointOctree>();
+        octreeBuilt = octree->buildAsync(std::move(vertices));
+        vertices.clear();
+        indices = std::vector<uint32_t>();
+    }
+
+    VulkanDisplayer displayer(vertices, indices, mode, frameLimit, geometryUsage);
+    displayer.setTopology(topology);
+    displayer.setVertexFormat(vertexFormat);
+    displayer.setPipelineCachePath(pipelineCachePath);
+    displayer.setRecordingThreads(recordingThreads);
+    displayer.setDrawChunkSize(drawChunkIndices);
+    displayer.setFramesInFlight(framesInFlight);
+    if (presentMode.has_value())
+    {
+        displayer.setPresentMode(*presentMode);
+    }
+    if (lowLatency)
+    {
+        displayer.enableLowLatency();
+    }
+    if (gpuCulling)
+    {
+        displayer.enableGpuCulling();
+    }
+    if (!shaderDir.empty())
+    {
+        displayer.enableShaderHotReload(shaderDir);
+    }
+    if (octree)
+    {
+        displayer.enableOctree(octree, pointBudget);
+    }
+    else if (pointFile)
+    {
+        displayer.setPointCloudFile(pointFile);
+    }
+    else if (sceneCache)
+    {
+        displayer.setSceneCache(sceneCache);
+    }
+    if (!gpuDepth.empty())
+    {
+        displayer.enableDepthProjection(gpuDepth.cols, gpuDepth.rows);
+        displayer.submitDepthFrame(
+            gpuDepth.ptr<uint16_t>(), gpuColor.ptr<uint8_t>(), gpuColor.channels(), gpuIntrinsics);
+    }
+    else if (ingest)
+    {
+        displayer.enableDepthProjection(ingest->width(), ingest->height());
+        displayer.setFrameIngest(ingest, ingestIntrinsics);
+        ingest->start(ingestFps);
+    }
+    if (showColor && ingest)
+    {
+        displayer.enableColorOverlay(ingest->width(), ingest->height()); // fed with the ingested frames
+    }
+    else if (showColor && !overlayColor.empty())
+    {
+        displayer.enableColorOverlay(overlayColor.cols, overlayColor.rows);
+        displayer.submitColorImage(overlayColor);
+    }
+    else if (showColor)
+    {
+        std::cerr << "--show-color needs --rgbd, --rgbd-gpu or --ingest" << std::endl;
+    }
 
     try
     {
         displayer.run();
+        if (ingest)
+        {
+            ingest->stop();
+            IngestStats stats = ingest->stats();
+            std::cout << "Ingest : " << stats.decoded << " frames decoded, " << stats.consumed << " drawn, "
+                      << stats.dropped << " dropped, queue depth up to " << stats.maxQueueDepth << ", decode "
+                      << stats.averageDecodeMs << " ms on average" << std::endl;
+        }
+        if (octreeBuilt.valid())
+        {
+            octreeBuilt.get();
+            octree->save(octreeBuildPath);
+        }
+        if (!profilePath.empty())
+        {
+            std::ofstream out(profilePath);
+            bool json = profilePath.size() >= 5 && profilePath.compare(profilePath.size() - 5, 5, ".json") == 0;
+            if (json)
+            {
+                displayer.getProfiler().dumpJson(out);
+            }
+            else
+            {
+                displayer.getProfiler().dumpCsv(out);
+            }
+        }
     }
     catch (const std::exception& e)
     {
@@ -0,0 +1,13 @@
+#version 450
+
+// Color image overlay, see StreamingTexture.
+// A quad over the whole viewport, made from gl_VertexIndex (triangle strip, 4 vertices, no vertex buffer). The
+// viewport is the rectangle the image is shown in.
+layout(location = 0) out vec2 fragUv;
+
+void main()
+{
+    vec2 uv = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+    fragUv = uv;
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
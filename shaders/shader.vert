@@ -23,5 +23,6 @@ void main()
 {
     // gl_Position = ubo.model * ubo.view * ubo.proj * vec4(inPosition, 1.0);
     gl_Position = ubo.mvp * vec4(inPosition, 1.0);
+    gl_PointSize = 1.0; // only read for POINT_LIST topology
     fragColor = inColor;
 }
\ No newline at end of file
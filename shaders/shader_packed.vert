@@ -0,0 +1,38 @@
+#version 450
+
+// shader.vert for PackedVertex (VertexFormat::Packed16).
+// The position arrives as SNORM16 in [-1, 1] relative to the bounding box of its chunk of 2^CHUNK_SHIFT consecutive
+// vertices, see packVertices() in VertexPacking.cpp.
+
+#define CHUNK_SHIFT 16 // PACK_CHUNK_SHIFT
+
+layout(binding = 0) uniform UniformObject
+{
+    mat4 mvp;
+}
+ubo;
+
+struct Chunk
+{
+    vec4 offset; // bounding box center
+    vec4 scale;  // bounding box half extent
+};
+
+layout(std430, binding = 1) readonly buffer Chunks
+{
+    Chunk chunks[];
+};
+
+layout(location = 0) in vec4 inPosition; // R16G16B16A16_SNORM
+layout(location = 1) in vec4 inColor;    // R8G8B8A8_UNORM
+
+layout(location = 0) out vec3 fragColor;
+
+void main()
+{
+    Chunk chunk = chunks[uint(gl_VertexIndex) >> CHUNK_SHIFT];
+    vec3 position = chunk.offset.xyz + inPosition.xyz * chunk.scale.xyz;
+    gl_Position = ubo.mvp * vec4(position, 1.0);
+    gl_PointSize = 1.0; // only read for POINT_LIST topology
+    fragColor = inColor.rgb;
+}
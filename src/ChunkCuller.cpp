@@ -0,0 +1,239 @@
+#include "ChunkCuller.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "ThreadPool.h"
+
+static_assert(sizeof(ChunkCuller::Chunk) == 48, "ChunkCuller::Chunk must match the std430 layout of cull.comp");
+
+void ChunkCuller::computeBounds(
+    std::vector<Chunk>& chunks, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+    ThreadPool::global().parallelFor(0, chunks.size(), 16, [&](size_t chunkBegin, size_t chunkEnd) {
+        for (size_t i = chunkBegin; i < chunkEnd; i++)
+        {
+            glm::vec3 lo(std::numeric_limits<float>::max());
+            glm::vec3 hi(-std::numeric_limits<float>::max());
+            const uint32_t* index = indices.data() + chunks[i].firstIndex;
+            for (uint32_t k = 0; k < chunks[i].indexCount; k++)
+            {
+                const glm::vec3& position = vertices[index[k]].position;
+                lo = glm::min(lo, position);
+                hi = glm::max(hi, position);
+            }
+            chunks[i].boundsMin = glm::vec4(lo, 0.0f);
+            chunks[i].boundsMax = glm::vec4(hi, 0.0f);
+        }
+    });
+}
+
+void ChunkCuller::init(VkDevice device_, MemoryAllocator* allocator_, uint32_t framesInFlight,
+    const std::vector<Chunk>& chunks, VkShaderModule cullShader, PipelineCache* pipelineCache,
+    PFN_vkCmdDrawIndexedIndirectCountKHR drawIndirectCount_, bool multiDrawIndirect)
+{
+    assert(!chunks.empty());
+    device = device_;
+    allocator = allocator_;
+    chunkTotal = chunks.size();
+    multiDraw = multiDrawIndirect;
+    /*maxDrawCount of the count draw is bound by maxDrawIndirectCount as well*/
+    drawIndirectCount = multiDraw ? drawIndirectCount_ : nullptr;
+
+    VkDeviceSize chunkBytes = chunks.size() * sizeof(Chunk);
+    allocator->createBuffer(
+        chunkBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::CpuToGpu, chunkBuffer, chunkMemory);
+    memcpy(chunkMemory.mapped, chunks.data(), chunkBytes);
+
+    slots.resize(framesInFlight);
+    for (auto& slot : slots)
+    {
+        allocator->createBuffer(chunks.size() * sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::GpuOnly,
+            slot.drawBuffer, slot.drawMemory);
+        allocator->createBuffer(sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            MemoryUsage::GpuOnly, slot.countBuffer, slot.countMemory);
+    }
+
+    createPipeline(cullShader, pipelineCache);
+    createDescriptors();
+}
+
+void ChunkCuller::createPipeline(VkShaderModule cullShader, PipelineCache* pipelineCache)
+{
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++)
+    {
+        bindings[i].binding = i; // chunks, draws, count
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the culling descriptor set layout!");
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(Params);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the culling pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = cullShader;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+    auto start = std::chrono::steady_clock::now();
+    if (vkCreateComputePipelines(device, pipelineCache->handle(), 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the culling pipeline!");
+    }
+    pipelineCache->recordPipeline(
+        "cull", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+void ChunkCuller::createDescriptors()
+{
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = static_cast<uint32_t>(slots.size()) * 3;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = static_cast<uint32_t>(slots.size());
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the culling descriptor pool!");
+    }
+
+    for (auto& slot : slots)
+    {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &descriptorSetLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &slot.descriptorSet) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate a culling descriptor set!");
+        }
+
+        std::array<VkDescriptorBufferInfo, 3> bufferInfos{};
+        bufferInfos[0] = {chunkBuffer, 0, VK_WHOLE_SIZE};
+        bufferInfos[1] = {slot.drawBuffer, 0, VK_WHOLE_SIZE};
+        bufferInfos[2] = {slot.countBuffer, 0, VK_WHOLE_SIZE};
+
+        std::array<VkWriteDescriptorSet, 3> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++)
+        {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = slot.descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void ChunkCuller::destroy()
+{
+    for (auto& slot : slots)
+    {
+        allocator->destroyBuffer(slot.drawBuffer, slot.drawMemory);
+        allocator->destroyBuffer(slot.countBuffer, slot.countMemory);
+    }
+    slots.clear();
+    allocator->destroyBuffer(chunkBuffer, chunkMemory);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+}
+
+void ChunkCuller::recordCull(VkCommandBuffer commandBuffer, uint32_t slot, const glm::mat4& mvp)
+{
+    const Slot& target = slots[slot];
+
+    /*the append counter restarts from 0 every frame*/
+    vkCmdFillBuffer(commandBuffer, target.countBuffer, 0, sizeof(uint32_t), 0);
+
+    VkBufferMemoryBarrier resetBarrier{};
+    resetBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    resetBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    resetBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    resetBarrier.buffer = target.countBuffer;
+    resetBarrier.offset = 0;
+    resetBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+        nullptr, 1, &resetBarrier, 0, nullptr);
+
+    Params params = {mvp, static_cast<uint32_t>(chunkTotal), drawIndirectCount != nullptr ? 1u : 0u};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(
+        commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &target.descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params), &params);
+    vkCmdDispatch(commandBuffer, static_cast<uint32_t>((chunkTotal + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE), 1, 1);
+
+    /*compute -> draw indirect (the commands and their count)*/
+    std::array<VkBufferMemoryBarrier, 2> barriers{};
+    barriers[0] = resetBarrier;
+    barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    barriers[0].buffer = target.drawBuffer;
+    barriers[1] = barriers[0];
+    barriers[1].buffer = target.countBuffer;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+        0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+}
+
+void ChunkCuller::recordDraw(VkCommandBuffer commandBuffer, uint32_t slot) const
+{
+    const Slot& target = slots[slot];
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    if (drawIndirectCount)
+    {
+        drawIndirectCount(commandBuffer, target.drawBuffer, 0, target.countBuffer, 0,
+            static_cast<uint32_t>(chunkTotal), stride);
+    }
+    else if (multiDraw)
+    {
+        vkCmdDrawIndexedIndirect(commandBuffer, target.drawBuffer, 0, static_cast<uint32_t>(chunkTotal), stride);
+    }
+    else
+    {
+        for (size_t i = 0; i < chunkTotal; i++)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, target.drawBuffer, i * stride, 1, stride);
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#include "DeletionQueue.h"
+
+#include <cassert>
+
+void DeletionQueue::push(uint64_t submittedFrames, std::function<void()> destroy)
+{
+    assert(entries.empty() || entries.back().frames <= submittedFrames);
+    entries.push_back({submittedFrames, std::move(destroy)});
+}
+
+void DeletionQueue::collect(uint64_t completedFrames)
+{
+    while (!entries.empty() && entries.front().frames <= completedFrames)
+    {
+        entries.front().destroy();
+        entries.pop_front();
+    }
+}
+
+void DeletionQueue::flush()
+{
+    for (Entry& entry : entries)
+    {
+        entry.destroy();
+    }
+    entries.clear();
+}
@@ -0,0 +1,230 @@
+#include "DepthProjector.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "Vertex.h"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void DepthProjector::setExtent(uint32_t width_, uint32_t height_)
+{
+    width = width_;
+    height = height_;
+
+    /*[Params][depth, 2 bytes per pixel][color, up to 4 bytes per pixel], every section a multiple of 4 bytes*/
+    depthOffset = alignUp(sizeof(Params), SECTION_ALIGNMENT);
+    depthSize = alignUp(static_cast<VkDeviceSize>(pixelCount()) * 2, 4);
+    colorOffset = alignUp(depthOffset + depthSize, SECTION_ALIGNMENT);
+    colorSize = alignUp(static_cast<VkDeviceSize>(pixelCount()) * 4, 4);
+    inputSize = colorOffset + colorSize;
+}
+
+void DepthProjector::init(VkDevice device_, MemoryAllocator* allocator_, uint32_t framesInFlight,
+    VkShaderModule computeShader, PipelineCache* pipelineCache)
+{
+    assert(inputSize > 0); // setExtent() first
+    device = device_;
+    allocator = allocator_;
+
+    slots.resize(framesInFlight);
+    for (auto& slot : slots)
+    {
+        allocator->createBuffer(
+            inputSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::CpuToGpu, slot.inputBuffer, slot.inputMemory);
+        memset(slot.inputMemory.mapped, 0, inputSize); // an all zero frame has no valid point
+        allocator->createBuffer(static_cast<VkDeviceSize>(pixelCount()) * sizeof(Vertex),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::GpuOnly,
+            slot.vertexBuffer, slot.vertexMemory);
+        allocator->createBuffer(sizeof(VkDrawIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            MemoryUsage::GpuOnly, slot.indirectBuffer, slot.indirectMemory);
+    }
+
+    createPipeline(computeShader, pipelineCache);
+    createDescriptors();
+}
+
+void DepthProjector::createPipeline(VkShaderModule computeShader, PipelineCache* pipelineCache)
+{
+    std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++)
+    {
+        bindings[i].binding = i; // params, depth, color, vertices, indirect
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the depth projection descriptor set layout!");
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the depth projection pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = computeShader;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+    auto start = std::chrono::steady_clock::now();
+    if (vkCreateComputePipelines(device, pipelineCache->handle(), 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the depth projection pipeline!");
+    }
+    pipelineCache->recordPipeline(
+        "depth_to_points", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+void DepthProjector::createDescriptors()
+{
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = static_cast<uint32_t>(slots.size()) * 5;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = static_cast<uint32_t>(slots.size());
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the depth projection descriptor pool!");
+    }
+
+    for (auto& slot : slots)
+    {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &descriptorSetLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &slot.descriptorSet) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate a depth projection descriptor set!");
+        }
+
+        std::array<VkDescriptorBufferInfo, 5> bufferInfos{};
+        bufferInfos[0] = {slot.inputBuffer, 0, sizeof(Params)};
+        bufferInfos[1] = {slot.inputBuffer, depthOffset, depthSize};
+        bufferInfos[2] = {slot.inputBuffer, colorOffset, colorSize};
+        bufferInfos[3] = {slot.vertexBuffer, 0, VK_WHOLE_SIZE};
+        bufferInfos[4] = {slot.indirectBuffer, 0, VK_WHOLE_SIZE};
+
+        std::array<VkWriteDescriptorSet, 5> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++)
+        {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = slot.descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void DepthProjector::destroy()
+{
+    for (auto& slot : slots)
+    {
+        allocator->destroyBuffer(slot.inputBuffer, slot.inputMemory);
+        allocator->destroyBuffer(slot.vertexBuffer, slot.vertexMemory);
+        allocator->destroyBuffer(slot.indirectBuffer, slot.indirectMemory);
+    }
+    slots.clear();
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+}
+
+void DepthProjector::submitFrame(
+    const uint16_t* depth, const uint8_t* color, uint32_t colorChannels, const CameraIntrinsics& intrinsics)
+{
+    assert(colorChannels == 3 || colorChannels == 4);
+    assert(inputSize > 0); // setExtent() first
+    Params params = {intrinsics.fx, intrinsics.fy, intrinsics.cx, intrinsics.cy, intrinsics.depthScale,
+        intrinsics.minDepth, intrinsics.maxDepth, width, height, colorChannels};
+
+    std::lock_guard<std::mutex> lock(frameMutex);
+    latestFrame.resize(inputSize);
+    memcpy(latestFrame.data(), &params, sizeof(Params));
+    memcpy(latestFrame.data() + depthOffset, depth, static_cast<size_t>(pixelCount()) * 2);
+    memcpy(latestFrame.data() + colorOffset, color, static_cast<size_t>(pixelCount()) * colorChannels);
+    latestGeneration++;
+}
+
+void DepthProjector::prepareFrame(uint32_t slot)
+{
+    std::lock_guard<std::mutex> lock(frameMutex);
+    Slot& target = slots[slot];
+    if (target.generation == latestGeneration)
+    {
+        return;
+    }
+    /*the slot's previous dispatch is done (its fence signalled), the input can be overwritten*/
+    memcpy(target.inputMemory.mapped, latestFrame.data(), inputSize);
+    target.generation = latestGeneration;
+}
+
+void DepthProjector::recordDispatch(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    const Slot& target = slots[slot];
+
+    /*vertexCount is the append counter of the shader, it restarts from 0 every frame*/
+    VkDrawIndirectCommand drawCommand = {0, 1, 0, 0};
+    vkCmdUpdateBuffer(commandBuffer, target.indirectBuffer, 0, sizeof(drawCommand), &drawCommand);
+
+    VkBufferMemoryBarrier resetBarrier{};
+    resetBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    resetBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    resetBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    resetBarrier.buffer = target.indirectBuffer;
+    resetBarrier.offset = 0;
+    resetBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+        nullptr, 1, &resetBarrier, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(
+        commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &target.descriptorSet, 0, nullptr);
+    vkCmdDispatch(commandBuffer, (width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+        (height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+    /*compute -> vertex input (the points) and draw indirect (the point count)*/
+    std::array<VkBufferMemoryBarrier, 2> barriers{};
+    barriers[0] = resetBarrier;
+    barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    barriers[0].buffer = target.vertexBuffer;
+    barriers[1] = resetBarrier;
+    barriers[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    barriers[1].buffer = target.indirectBuffer;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+}
@@ -0,0 +1,52 @@
+#include "DirtyRanges.h"
+
+#include <algorithm>
+#include <iterator>
+
+void DirtyRanges::add(uint64_t begin, uint64_t end)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+    /*first range that could touch [begin, end) : the last one starting at or before begin*/
+    auto it = ranges.upper_bound(begin);
+    if (it != ranges.begin())
+    {
+        auto previous = std::prev(it);
+        if (previous->second >= begin)
+        {
+            it = previous;
+        }
+    }
+    /*swallow every range overlapping or touching the new one*/
+    while (it != ranges.end() && it->first <= end)
+    {
+        begin = std::min(begin, it->first);
+        end = std::max(end, it->second);
+        it = ranges.erase(it);
+    }
+    ranges.emplace(begin, end);
+}
+
+uint64_t DirtyRanges::dirtyCount() const
+{
+    uint64_t count = 0;
+    for (const auto& range : ranges)
+    {
+        count += range.second - range.first;
+    }
+    return count;
+}
+
+std::vector<Range> DirtyRanges::take()
+{
+    std::vector<Range> result;
+    result.reserve(ranges.size());
+    for (const auto& range : ranges)
+    {
+        result.push_back({range.first, range.second});
+    }
+    ranges.clear();
+    return result;
+}
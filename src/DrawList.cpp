@@ -0,0 +1,24 @@
+#include "DrawList.h"
+
+#include <algorithm>
+
+std::vector<DrawChunk> splitDrawList(uint32_t count, VkPrimitiveTopology topology, uint32_t chunkIndices)
+{
+    uint32_t primitiveIndices = 0;
+    switch (topology)
+    {
+    case VK_PRIMITIVE_TOPOLOGY_POINT_LIST: primitiveIndices = 1; break;
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST: primitiveIndices = 2; break;
+    case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST: primitiveIndices = 3; break;
+    default: break;
+    }
+    uint32_t step = primitiveIndices == 0
+        ? count
+        : std::max(primitiveIndices, chunkIndices / primitiveIndices * primitiveIndices);
+    std::vector<DrawChunk> chunks;
+    for (uint32_t first = 0; first < count; first += step)
+    {
+        chunks.push_back({first, std::min(step, count - first)});
+    }
+    return chunks;
+}
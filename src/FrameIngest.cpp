@@ -0,0 +1,213 @@
+#include "FrameIngest.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+
+/*how long the decoder sleeps when the queue is full, the renderer drains it once per frame*/
+static const std::chrono::milliseconds FULL_QUEUE_WAIT(1);
+
+static std::vector<std::string> sortedFiles(const std::filesystem::path& directory)
+{
+    std::vector<std::string> files;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+    {
+        if (entry.is_regular_file())
+        {
+            files.push_back(entry.path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+FrameIngest::FrameIngest(size_t queueCapacity)
+    : queue(queueCapacity)
+{
+}
+
+bool FrameIngest::open(const std::string& source, uint16_t constantDepth)
+{
+    stop();
+    video.release();
+    colorFiles.clear();
+    depthFiles.clear();
+    frameWidth = 0;
+    frameHeight = 0;
+    std::filesystem::path path(source);
+    if (std::filesystem::is_directory(path))
+    {
+        std::filesystem::path colorDir = std::filesystem::is_directory(path / "color") ? path / "color" : path / "rgb";
+        colorFiles = sortedFiles(colorDir);
+        depthFiles = sortedFiles(path / "depth");
+        if (colorFiles.empty() || colorFiles.size() != depthFiles.size())
+        {
+            VD_LOG_ERROR("FrameIngest: %s needs as many images in color/ (or rgb/) as in depth/", source.c_str());
+            return false;
+        }
+        fps = 30.0;
+    }
+    else
+    {
+        if (!video.open(source))
+        {
+            VD_LOG_ERROR("FrameIngest: can not open the video %s", source.c_str());
+            return false;
+        }
+        fps = video.get(cv::CAP_PROP_FPS) > 0.0 ? video.get(cv::CAP_PROP_FPS) : 30.0;
+        int width = static_cast<int>(video.get(cv::CAP_PROP_FRAME_WIDTH));
+        int height = static_cast<int>(video.get(cv::CAP_PROP_FRAME_HEIGHT));
+        flatDepth = cv::Mat(height, width, CV_16UC1, cv::Scalar(constantDepth));
+    }
+
+    nextIndex = 0;
+    if (!decode(first))
+    {
+        VD_LOG_ERROR("FrameIngest: %s has no readable frame", source.c_str());
+        return false;
+    }
+    frameWidth = static_cast<uint32_t>(first.color.cols);
+    frameHeight = static_cast<uint32_t>(first.color.rows);
+    return true;
+}
+
+void FrameIngest::start(double pacingFps)
+{
+    assert(!first.color.empty()); // open() first
+    stop();
+    pacing = pacingFps > 0.0 ? pacingFps : fps;
+    stopRequested = false;
+    decoderDone = false;
+    thread = std::thread(&FrameIngest::decodeLoop, this);
+}
+
+void FrameIngest::stop()
+{
+    stopRequested = true;
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+bool FrameIngest::decode(IngestedFrame& frame)
+{
+    auto start = std::chrono::steady_clock::now();
+    frame.index = nextIndex;
+    if (!colorFiles.empty())
+    {
+        if (nextIndex >= colorFiles.size())
+        {
+            return false;
+        }
+        frame.color = cv::imread(colorFiles[nextIndex], cv::IMREAD_COLOR);
+        frame.depth = cv::imread(depthFiles[nextIndex], cv::IMREAD_ANYDEPTH);
+    }
+    else
+    {
+        if (!video.read(frame.color))
+        {
+            return false;
+        }
+        frame.depth = flatDepth;
+    }
+    nextIndex++;
+
+    if (frame.color.empty() || frame.depth.empty() || frame.depth.type() != CV_16UC1
+        || frame.color.type() != CV_8UC3 || frame.color.size().width != frame.depth.size().width
+        || frame.color.size().height != frame.depth.size().height)
+    {
+        VD_LOG_WARN("FrameIngest: frame %llu is not an 8-bit BGR + 16-bit depth pair of one size",
+            static_cast<unsigned long long>(frame.index));
+        return false;
+    }
+    if (frameWidth != 0
+        && (frame.color.cols != static_cast<int>(frameWidth) || frame.color.rows != static_cast<int>(frameHeight)))
+    {
+        VD_LOG_WARN("FrameIngest: frame %llu does not have the size of the first one",
+            static_cast<unsigned long long>(frame.index));
+        return false;
+    }
+    if (!frame.color.isContinuous())
+    {
+        frame.color = frame.color.clone(); // the depth projection copies whole images
+    }
+    uint64_t ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    lastDecodeNs.store(ns, std::memory_order_relaxed);
+    totalDecodeNs.fetch_add(ns, std::memory_order_relaxed);
+    timedFrames.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void FrameIngest::decodeLoop()
+{
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / pacing));
+    auto deadline = std::chrono::steady_clock::now();
+    IngestedFrame frame = std::move(first);
+    bool haveFrame = true;
+    while (!stopRequested.load(std::memory_order_relaxed))
+    {
+        if (!haveFrame)
+        {
+            haveFrame = decode(frame);
+            if (!haveFrame)
+            {
+                break; // end of the source
+            }
+        }
+
+        /*a recorded stream is played at its own rate, not as fast as it decodes*/
+        std::this_thread::sleep_until(deadline);
+        if (!queue.tryPush(std::move(frame)))
+        {
+            std::this_thread::sleep_for(FULL_QUEUE_WAIT);
+            continue;
+        }
+        haveFrame = false;
+        decodedFrames.fetch_add(1, std::memory_order_relaxed);
+        /*a decoder that fell behind (slow decode, full queue) starts over from now instead of bursting*/
+        deadline = std::max(deadline + period, std::chrono::steady_clock::now());
+    }
+    decoderDone.store(true, std::memory_order_release);
+}
+
+bool FrameIngest::takeLatest(IngestedFrame& frame)
+{
+    size_t waiting = queue.size();
+    if (waiting == 0)
+    {
+        return false;
+    }
+    if (waiting > maxQueued.load(std::memory_order_relaxed))
+    {
+        maxQueued.store(waiting, std::memory_order_relaxed);
+    }
+    /*only the newest of the waiting frames is drawn*/
+    uint64_t taken = 0;
+    while (queue.tryPop(frame))
+    {
+        taken++;
+    }
+    consumedFrames.fetch_add(1, std::memory_order_relaxed);
+    droppedFrames.fetch_add(taken - 1, std::memory_order_relaxed);
+    return true;
+}
+
+IngestStats FrameIngest::stats() const
+{
+    IngestStats stats;
+    stats.decoded = decodedFrames.load(std::memory_order_relaxed);
+    stats.consumed = consumedFrames.load(std::memory_order_relaxed);
+    stats.dropped = droppedFrames.load(std::memory_order_relaxed);
+    stats.queueDepth = queue.size();
+    stats.maxQueueDepth = maxQueued.load(std::memory_order_relaxed);
+    stats.lastDecodeMs = lastDecodeNs.load(std::memory_order_relaxed) * 1e-6;
+    uint64_t timed = timedFrames.load(std::memory_order_relaxed);
+    stats.averageDecodeMs = timed > 0 ? totalDecodeNs.load(std::memory_order_relaxed) * 1e-6 / timed : 0.0;
+    return stats;
+}
@@ -0,0 +1,342 @@
+#include "FrameProfiler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+const char* toStringFrameStage(FrameStage stage)
+{
+    switch (stage)
+    {
+    case FrameStage::FenceWait: return "fence_wait";
+    case FrameStage::Acquire: return "acquire";
+    case FrameStage::UniformUpdate: return "ubo_update";
+    case FrameStage::VertexUpdate: return "vertex_update";
+    case FrameStage::Record: return "record";
+    case FrameStage::Submit: return "submit";
+    case FrameStage::Present: return "present";
+    default: return "unknown";
+    }
+}
+
+/************************* FrameRecordRing *************************/
+
+void FrameRecordRing::push(const FrameRecord& record)
+{
+    uint64_t index = head.load(std::memory_order_relaxed);
+    Slot& slot = slots[index & (CAPACITY - 1)];
+
+    uint64_t payload[WORDS] = {};
+    memcpy(payload, &record, sizeof(FrameRecord));
+
+    /*odd sequence : write in progress*/
+    uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; i++)
+    {
+        slot.words[i].store(payload[i], std::memory_order_relaxed);
+    }
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+
+    head.store(index + 1, std::memory_order_release);
+}
+
+std::vector<FrameRecord> FrameRecordRing::snapshot(size_t maxCount) const
+{
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t count = std::min<uint64_t>({end, static_cast<uint64_t>(maxCount), static_cast<uint64_t>(CAPACITY)});
+
+    std::vector<FrameRecord> result;
+    result.reserve(count);
+    for (uint64_t index = end - count; index < end; index++)
+    {
+        const Slot& slot = slots[index & (CAPACITY - 1)];
+        uint64_t payload[WORDS];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            continue; // being overwritten right now, the writer lapped us
+        }
+        for (size_t i = 0; i < WORDS; i++)
+        {
+            payload[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before)
+        {
+            continue; // torn read
+        }
+        FrameRecord record;
+        memcpy(&record, payload, sizeof(FrameRecord));
+        result.push_back(record);
+    }
+    return result;
+}
+
+/************************* FrameProfiler *************************/
+
+void FrameProfiler::init(
+    VkPhysicalDevice physicalDevice, VkDevice device_, uint32_t queueFamilyIndex, uint32_t framesInFlight)
+{
+    device = device_;
+    pending.assign(framesInFlight, FrameRecord{});
+    pendingValid.assign(framesInFlight, false);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    /*timestampValidBits == 0 means the queue does not support timestamps at all, keep CPU timings only*/
+    uint32_t validBits = queueFamilyIndex < queueFamilyCount ? queueFamilies[queueFamilyIndex].timestampValidBits : 0;
+    if (validBits == 0 || properties.limits.timestampPeriod == 0.0f)
+    {
+        return;
+    }
+    timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+    timestampPeriodNs = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = framesInFlight * 2; // begin + end per frame slot
+    if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS)
+    {
+        queryPool = VK_NULL_HANDLE;
+    }
+}
+
+void FrameProfiler::destroy()
+{
+    if (queryPool != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(device, queryPool, nullptr);
+        queryPool = VK_NULL_HANDLE;
+    }
+}
+
+void FrameProfiler::cmdWriteBegin(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    if (!hasGpuTimestamps())
+    {
+        return;
+    }
+    /*queries have to be reset before every reuse, this is done on the GPU timeline so pre-recorded command buffers
+     * can be resubmitted*/
+    vkCmdResetQueryPool(commandBuffer, queryPool, slot * 2, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, slot * 2);
+}
+
+void FrameProfiler::cmdWriteEnd(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    if (!hasGpuTimestamps())
+    {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, slot * 2 + 1);
+}
+
+void FrameProfiler::collectGpuTime(uint32_t slot)
+{
+    if (!pendingValid[slot])
+    {
+        return;
+    }
+    FrameRecord& record = pending[slot];
+    if (hasGpuTimestamps())
+    {
+        /*the fence of this slot has signalled, results are available without waiting*/
+        uint64_t timestamps[2] = {};
+        VkResult result = vkGetQueryPoolResults(device, queryPool, slot * 2, 2, sizeof(timestamps), timestamps,
+            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS)
+        {
+            uint64_t ticks = ((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask;
+            record.gpuMs = ticks * timestampPeriodNs * 1e-6;
+        }
+    }
+    ring.push(record);
+    pendingValid[slot] = false;
+}
+
+void FrameProfiler::beginFrame(uint32_t slot)
+{
+    collectGpuTime(slot);
+}
+
+void FrameProfiler::endFrame(uint32_t slot)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (nextFrameIndex > 0)
+    {
+        /*frame time is measured start to start, so time spent outside render() (event polling...) is included*/
+        current.cpuFrameMs = std::chrono::duration<double, std::milli>(now - frameStart).count();
+    }
+    current.frameIndex = nextFrameIndex++;
+    pending[slot] = current;
+    pendingValid[slot] = true;
+    current = FrameRecord{};
+    frameStart = now;
+}
+
+void FrameProfiler::discardFrame()
+{
+    current = FrameRecord{};
+}
+
+void FrameProfiler::flushPending()
+{
+    /*oldest submission first so the ring stays in frame order*/
+    std::vector<uint32_t> slots;
+    for (uint32_t slot = 0; slot < pending.size(); slot++)
+    {
+        if (pendingValid[slot])
+        {
+            slots.push_back(slot);
+        }
+    }
+    std::sort(slots.begin(), slots.end(),
+        [this](uint32_t a, uint32_t b) { return pending[a].frameIndex < pending[b].frameIndex; });
+    for (uint32_t slot : slots)
+    {
+        collectGpuTime(slot);
+    }
+}
+
+void FrameProfiler::addStageTime(FrameStage stage, std::chrono::steady_clock::duration duration)
+{
+    current.cpuStageMs[static_cast<size_t>(stage)] += std::chrono::duration<double, std::milli>(duration).count();
+}
+
+Percentiles computePercentiles(std::vector<double>& values)
+{
+    Percentiles result;
+    if (values.empty())
+    {
+        return result;
+    }
+    std::sort(values.begin(), values.end());
+    auto at = [&values](double q) { return values[static_cast<size_t>(q * (values.size() - 1) + 0.5)]; };
+    result.p50 = at(0.50);
+    result.p95 = at(0.95);
+    result.p99 = at(0.99);
+    result.max = values.back();
+    return result;
+}
+
+FrameStats FrameProfiler::computeStats(size_t maxFrames) const
+{
+    std::vector<FrameRecord> frames = ring.snapshot(maxFrames);
+    FrameStats stats;
+    stats.frameCount = frames.size();
+
+    std::vector<double> values;
+    values.reserve(frames.size());
+    for (const auto& frame : frames)
+    {
+        values.push_back(frame.cpuFrameMs);
+    }
+    stats.cpuFrame = computePercentiles(values);
+
+    for (size_t stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+    {
+        values.clear();
+        for (const auto& frame : frames)
+        {
+            values.push_back(frame.cpuStageMs[stage]);
+        }
+        stats.cpuStages[stage] = computePercentiles(values);
+    }
+
+    values.clear();
+    for (const auto& frame : frames)
+    {
+        if (frame.gpuMs >= 0.0)
+        {
+            values.push_back(frame.gpuMs);
+        }
+    }
+    stats.gpu = computePercentiles(values);
+    return stats;
+}
+
+void FrameProfiler::dumpCsv(std::ostream& out) const
+{
+    out << "frame,cpu_frame_ms";
+    for (size_t stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+    {
+        out << "," << toStringFrameStage(static_cast<FrameStage>(stage)) << "_ms";
+    }
+    out << ",gpu_ms\n";
+    out << std::fixed << std::setprecision(4);
+    for (const auto& frame : ring.snapshot())
+    {
+        out << frame.frameIndex << "," << frame.cpuFrameMs;
+        for (double ms : frame.cpuStageMs)
+        {
+            out << "," << ms;
+        }
+        out << "," << frame.gpuMs << "\n";
+    }
+}
+
+static void writeJsonPercentiles(std::ostream& out, const Percentiles& p)
+{
+    out << "{\"p50\": " << p.p50 << ", \"p95\": " << p.p95 << ", \"p99\": " << p.p99 << ", \"max\": " << p.max << "}";
+}
+
+void FrameProfiler::dumpJson(std::ostream& out) const
+{
+    FrameStats stats = computeStats();
+    out << std::fixed << std::setprecision(4);
+    out << "{\n  \"summary\": {\n    \"frames\": " << stats.frameCount << ",\n    \"cpu_frame_ms\": ";
+    writeJsonPercentiles(out, stats.cpuFrame);
+    for (size_t stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+    {
+        out << ",\n    \"" << toStringFrameStage(static_cast<FrameStage>(stage)) << "_ms\": ";
+        writeJsonPercentiles(out, stats.cpuStages[stage]);
+    }
+    out << ",\n    \"gpu_ms\": ";
+    writeJsonPercentiles(out, stats.gpu);
+    out << "\n  },\n  \"frames\": [";
+
+    bool first = true;
+    for (const auto& frame : ring.snapshot())
+    {
+        out << (first ? "\n" : ",\n") << "    {\"frame\": " << frame.frameIndex << ", \"cpu_frame_ms\": "
+            << frame.cpuFrameMs;
+        for (size_t stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+        {
+            out << ", \"" << toStringFrameStage(static_cast<FrameStage>(stage)) << "_ms\": " << frame.cpuStageMs[stage];
+        }
+        out << ", \"gpu_ms\": " << frame.gpuMs << "}";
+        first = false;
+    }
+    out << "\n  ]\n}\n";
+}
+
+void FrameProfiler::printSummary(std::ostream& out) const
+{
+    FrameStats stats = computeStats();
+    if (stats.frameCount == 0)
+    {
+        return;
+    }
+    auto line = [&out](const char* name, const Percentiles& p) {
+        out << "  " << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(3)
+            << " p50 " << p.p50 << "  p95 " << p.p95 << "  p99 " << p.p99 << "  max " << p.max << " ms\n";
+    };
+    out << "Frame timings over the last " << stats.frameCount << " frames:\n";
+    line("frame", stats.cpuFrame);
+    for (size_t stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+    {
+        line(toStringFrameStage(static_cast<FrameStage>(stage)), stats.cpuStages[stage]);
+    }
+    if (stats.gpu.max > 0.0)
+    {
+        line("gpu", stats.gpu);
+    }
+}
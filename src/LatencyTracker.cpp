@@ -0,0 +1,48 @@
+#include "LatencyTracker.h"
+
+#include <iomanip>
+
+void LatencyTracker::sampled(uint64_t frame)
+{
+    PendingSample& sample = pending[frame % pending.size()];
+    sample.frame = frame;
+    sample.time = std::chrono::steady_clock::now();
+}
+
+void LatencyTracker::completed(uint64_t frame)
+{
+    PendingSample& sample = pending[frame % pending.size()];
+    if (frame == 0 || sample.frame != frame)
+    {
+        return;
+    }
+    sample.frame = 0;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sample.time).count();
+    if (latencies.size() < CAPACITY)
+    {
+        latencies.push_back(ms);
+    }
+    else
+    {
+        latencies[next] = ms;
+        next = (next + 1) % CAPACITY;
+    }
+}
+
+Percentiles LatencyTracker::compute() const
+{
+    std::vector<double> values = latencies;
+    return computePercentiles(values);
+}
+
+void LatencyTracker::printSummary(std::ostream& out, const char* completion) const
+{
+    if (latencies.empty())
+    {
+        return;
+    }
+    Percentiles p = compute();
+    out << "Sample to " << completion << " latency over the last " << latencies.size() << " frames:\n"
+        << "  " << std::fixed << std::setprecision(3) << "p50 " << p.p50 << "  p95 " << p.p95 << "  p99 " << p.p99
+        << "  max " << p.max << " ms\n";
+}
@@ -0,0 +1,154 @@
+#include "Logger.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+/*how often the background thread drains the queues*/
+static const std::chrono::milliseconds DRAIN_PERIOD(2);
+
+const char* toStringLogLevel(LogLevel level)
+{
+    switch (level)
+    {
+    case LogLevel::Trace: return "TRACE";
+    case LogLevel::Debug: return "DEBUG";
+    case LogLevel::Info: return "INFO";
+    case LogLevel::Warn: return "WARN";
+    case LogLevel::Error: return "ERROR";
+    default: return "UNKNOWN";
+    }
+}
+
+Logger::Logger()
+    : start(std::chrono::steady_clock::now())
+{
+    thread = std::thread(&Logger::drainLoop, this);
+}
+
+Logger::~Logger()
+{
+    stopping = true;
+    thread.join();
+}
+
+Logger& Logger::global()
+{
+    static Logger logger;
+    return logger;
+}
+
+Logger::ThreadQueueHandle::~ThreadQueueHandle()
+{
+    if (queue != nullptr)
+    {
+        queue->retired.store(true, std::memory_order_release); // the logger still holds it until it is drained
+    }
+}
+
+Logger::ThreadQueue& Logger::threadQueue()
+{
+    thread_local ThreadQueueHandle handle;
+    if (handle.queue == nullptr)
+    {
+        handle.queue = std::make_shared<ThreadQueue>();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        handle.queue->index = nextThread++;
+        queues.push_back(handle.queue);
+    }
+    return *handle.queue;
+}
+
+void Logger::log(LogLevel level, const char* format, ...)
+{
+    LogRecord record;
+    record.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+                        .count();
+    record.level = level;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(record.text, sizeof(record.text), format, args);
+    va_end(args);
+
+    ThreadQueue& queue = threadQueue();
+    record.thread = queue.index;
+    if (level < LogLevel::Error)
+    {
+        if (!queue.records.tryPush(std::move(record)))
+        {
+            droppedRecords.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+    /*an error is never dropped : the queue is emptied to make room*/
+    if (!queue.records.tryPush(std::move(record)))
+    {
+        flush();
+        queue.records.tryPush(std::move(record));
+    }
+    flush();
+}
+
+void Logger::flush()
+{
+    std::lock_guard<std::mutex> drainLock(drainMutex);
+    std::vector<std::shared_ptr<ThreadQueue>> current;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        current = queues;
+    }
+
+    batch.clear();
+    LogRecord record;
+    for (const auto& queue : current)
+    {
+        /*retired is read first : a thread that exited pushes nothing after it, its queue is empty once drained*/
+        bool retired = queue->retired.load(std::memory_order_acquire);
+        while (queue->records.tryPop(record))
+        {
+            batch.push_back(record);
+        }
+        if (retired)
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            queues.erase(std::remove(queues.begin(), queues.end(), queue), queues.end());
+        }
+    }
+    if (batch.empty())
+    {
+        return;
+    }
+
+    /*every queue is in order, the threads are interleaved by time*/
+    std::stable_sort(batch.begin(), batch.end(),
+        [](const LogRecord& a, const LogRecord& b) { return a.timeNs < b.timeNs; });
+    bool wroteOut = false;
+    bool wroteErr = false;
+    for (const LogRecord& line : batch)
+    {
+        bool toErr = line.level >= LogLevel::Warn;
+        fprintf(toErr ? stderr : stdout, "[%10.6f] [%s] [t%u] %s\n", line.timeNs * 1e-9, toStringLogLevel(line.level),
+            line.thread, line.text);
+        wroteOut = wroteOut || !toErr;
+        wroteErr = wroteErr || toErr;
+    }
+    /*one flush per batch instead of one per line*/
+    if (wroteOut)
+    {
+        fflush(stdout);
+    }
+    if (wroteErr)
+    {
+        fflush(stderr);
+    }
+}
+
+void Logger::drainLoop()
+{
+    while (!stopping.load(std::memory_order_relaxed))
+    {
+        flush();
+        std::this_thread::sleep_for(DRAIN_PERIOD);
+    }
+    flush();
+}
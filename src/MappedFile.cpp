@@ -0,0 +1,69 @@
+#include "MappedFile.h"
+#include "Logger.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        VD_LOG_ERROR("MappedFile: can not open %s", path.c_str());
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return false;
+    }
+    void* base = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file
+    if (base == MAP_FAILED)
+    {
+        VD_LOG_ERROR("MappedFile: can not map %s", path.c_str());
+        return false;
+    }
+    mapped = static_cast<const uint8_t*>(base);
+    mappedSize = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mapped)
+    {
+        munmap(const_cast<uint8_t*>(mapped), mappedSize);
+    }
+    mapped = nullptr;
+    mappedSize = 0;
+}
+
+void MappedFile::adviseSequential() const
+{
+    if (mapped)
+    {
+        madvise(const_cast<uint8_t*>(mapped), mappedSize, MADV_SEQUENTIAL);
+    }
+}
+
+#else
+
+bool MappedFile::open(const std::string& path)
+{
+    VD_LOG_ERROR("MappedFile: mapping %s is only supported on Linux", path.c_str());
+    return false;
+}
+
+void MappedFile::close() {}
+
+void MappedFile::adviseSequential() const {}
+
+#endif
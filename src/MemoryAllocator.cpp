@@ -0,0 +1,471 @@
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <stdexcept>
+
+static VkDeviceSize nextPowerOfTwo(VkDeviceSize value)
+{
+    VkDeviceSize result = 1;
+    while (result < value)
+    {
+        result <<= 1;
+    }
+    return result;
+}
+
+static VkDeviceSize previousPowerOfTwo(VkDeviceSize value)
+{
+    VkDeviceSize result = 1;
+    while ((result << 1) <= value)
+    {
+        result <<= 1;
+    }
+    return result;
+}
+
+static int countBits(uint32_t value)
+{
+    int count = 0;
+    for (; value; value &= value - 1)
+    {
+        count++;
+    }
+    return count;
+}
+
+static uint32_t log2Of(VkDeviceSize powerOfTwo)
+{
+    uint32_t result = 0;
+    while ((VkDeviceSize(1) << result) < powerOfTwo)
+    {
+        result++;
+    }
+    return result;
+}
+
+/************************* BuddyBlock *************************/
+
+MemoryAllocator::BuddyBlock::BuddyBlock(
+    VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryType, ResourceKind kind, void* mapped)
+    : memory(memory)
+    , size(size)
+    , memoryType(memoryType)
+    , kind(kind)
+    , mapped(static_cast<uint8_t*>(mapped))
+{
+    maxOrder = log2Of(size / MIN_NODE_SIZE);
+    freeLists.resize(maxOrder + 1);
+    freeLists[maxOrder].insert(0); // the whole block is one free node
+}
+
+bool MemoryAllocator::BuddyBlock::allocate(VkDeviceSize requestSize, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+    /*nodes of order k sit at multiples of their size, so rounding up to the alignment is enough to honour it*/
+    VkDeviceSize nodeSize = nextPowerOfTwo(std::max({requestSize, alignment, MIN_NODE_SIZE}));
+    if (nodeSize > size)
+    {
+        return false;
+    }
+    uint32_t order = log2Of(nodeSize / MIN_NODE_SIZE);
+
+    uint32_t available = order;
+    while (available <= maxOrder && freeLists[available].empty())
+    {
+        available++;
+    }
+    if (available > maxOrder)
+    {
+        return false;
+    }
+
+    /*lowest offset first keeps the block compact*/
+    offset = *freeLists[available].begin();
+    freeLists[available].erase(freeLists[available].begin());
+
+    /*split down, the upper halves become free nodes*/
+    while (available > order)
+    {
+        available--;
+        freeLists[available].insert(offset + (MIN_NODE_SIZE << available));
+    }
+    allocated[offset] = order;
+    nodeBytes += nodeSize;
+    return true;
+}
+
+void MemoryAllocator::BuddyBlock::free(VkDeviceSize offset)
+{
+    auto it = allocated.find(offset);
+    assert(it != allocated.end()); // double free or foreign allocation
+    uint32_t order = it->second;
+    allocated.erase(it);
+    nodeBytes -= MIN_NODE_SIZE << order;
+
+    /*merge with the buddy as long as it is free too*/
+    while (order < maxOrder)
+    {
+        VkDeviceSize buddy = offset ^ (MIN_NODE_SIZE << order);
+        auto buddyIt = freeLists[order].find(buddy);
+        if (buddyIt == freeLists[order].end())
+        {
+            break;
+        }
+        freeLists[order].erase(buddyIt);
+        offset = std::min(offset, buddy);
+        order++;
+    }
+    freeLists[order].insert(offset);
+}
+
+VkDeviceSize MemoryAllocator::BuddyBlock::largestFree() const
+{
+    for (uint32_t order = maxOrder + 1; order-- > 0;)
+    {
+        if (!freeLists[order].empty())
+        {
+            return MIN_NODE_SIZE << order;
+        }
+    }
+    return 0;
+}
+
+/************************* MemoryAllocator *************************/
+
+void MemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device_, VkDeviceSize blockSize)
+{
+    device = device_;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+    preferredBlockSize = previousPowerOfTwo(std::max(blockSize, MIN_NODE_SIZE));
+
+    blocks.resize(memoryProperties.memoryTypeCount);
+    dedicatedBytes.assign(memoryProperties.memoryTypeCount, 0);
+    dedicatedCount.assign(memoryProperties.memoryTypeCount, 0);
+    usedBytes.assign(memoryProperties.memoryTypeCount, 0);
+    allocationCount.assign(memoryProperties.memoryTypeCount, 0);
+}
+
+void MemoryAllocator::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& typeBlocks : blocks)
+    {
+        for (auto& block : typeBlocks)
+        {
+            freeDeviceMemory(block->memory, block->mapped != nullptr);
+        }
+        typeBlocks.clear();
+    }
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred, VkMemoryPropertyFlags avoided) const
+{
+    /*among the types having all required flags, take the one with most preferred and fewest avoided flags*/
+    uint32_t best = UINT32_MAX;
+    int bestScore = -1;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+    {
+        VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+        if (!(typeFilter & (1u << i)) || (flags & required) != required)
+        {
+            continue;
+        }
+        int score = 2 * countBits(flags & preferred) + (countBits(avoided) - countBits(flags & avoided));
+        if (score > bestScore)
+        {
+            best = i;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+bool MemoryAllocator::isHostVisible(uint32_t memoryType) const
+{
+    return memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+}
+
+uint32_t MemoryAllocator::chooseMemoryType(uint32_t typeFilter, MemoryUsage usage) const
+{
+    const VkMemoryPropertyFlags hostCoherent =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    uint32_t type = UINT32_MAX;
+    switch (usage)
+    {
+    case MemoryUsage::GpuOnly:
+        type = findMemoryType(typeFilter, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        if (type == UINT32_MAX)
+        {
+            type = findMemoryType(typeFilter, 0);
+        }
+        break;
+    case MemoryUsage::CpuToGpu:
+        type = findMemoryType(typeFilter, hostCoherent, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        break;
+    case MemoryUsage::CpuOnly:
+        type = findMemoryType(
+            typeFilter, hostCoherent, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        break;
+    case MemoryUsage::GpuToCpu:
+        type = findMemoryType(typeFilter, hostCoherent, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        break;
+    }
+    if (type == UINT32_MAX)
+    {
+        throw std::runtime_error("Failed to find a suitable memory type!");
+    }
+    return type;
+}
+
+VkDeviceSize MemoryAllocator::blockSizeFor(uint32_t memoryType) const
+{
+    /*small heaps (e.g. the 256MB host visible device local window) get smaller blocks*/
+    VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+    VkDeviceSize blockSize = std::min(preferredBlockSize, previousPowerOfTwo(std::max<VkDeviceSize>(heapSize / 8, 1)));
+    return std::max<VkDeviceSize>(blockSize, 1024 * 1024);
+}
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped)
+{
+    if (deviceMemoryCount >= maxAllocationCount)
+    {
+        throw std::runtime_error("maxMemoryAllocationCount reached!");
+    }
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate device memory!");
+    }
+    deviceMemoryCount++;
+
+    *mapped = nullptr;
+    if (isHostVisible(memoryType))
+    {
+        if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to map device memory!");
+        }
+    }
+    return memory;
+}
+
+void MemoryAllocator::freeDeviceMemory(VkDeviceMemory memory, bool mapped)
+{
+    if (mapped)
+    {
+        vkUnmapMemory(device, memory);
+    }
+    vkFreeMemory(device, memory, nullptr);
+    deviceMemoryCount--;
+}
+
+Allocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, ResourceKind kind)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Allocation allocation;
+    allocation.memoryType = chooseMemoryType(requirements.memoryTypeBits, usage);
+    allocation.size = requirements.size;
+    uint32_t type = allocation.memoryType;
+    VkDeviceSize blockSize = blockSizeFor(type);
+
+    if (requirements.size > blockSize / 2)
+    {
+        /*large resources get their own memory, a block would be mostly wasted on them*/
+        void* mapped;
+        allocation.memory = allocateDeviceMemory(requirements.size, type, &mapped);
+        allocation.mapped = mapped;
+        dedicatedBytes[type] += requirements.size;
+        dedicatedCount[type]++;
+    }
+    else
+    {
+        BuddyBlock* target = nullptr;
+        VkDeviceSize offset = 0;
+        for (auto& block : blocks[type])
+        {
+            if (block->kind == kind && block->allocate(requirements.size, requirements.alignment, offset))
+            {
+                target = block.get();
+                break;
+            }
+        }
+        if (target == nullptr)
+        {
+            void* mapped;
+            VkDeviceMemory memory = allocateDeviceMemory(blockSize, type, &mapped);
+            blocks[type].push_back(std::make_unique<BuddyBlock>(memory, blockSize, type, kind, mapped));
+            target = blocks[type].back().get();
+            bool ok = target->allocate(requirements.size, requirements.alignment, offset);
+            assert(ok);
+            (void) ok;
+        }
+        allocation.memory = target->memory;
+        allocation.offset = offset;
+        allocation.mapped = target->mapped ? target->mapped + offset : nullptr;
+        allocation.block = target;
+    }
+    usedBytes[type] += requirements.size;
+    allocationCount[type]++;
+    return allocation;
+}
+
+void MemoryAllocator::free(Allocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t type = allocation.memoryType;
+    if (allocation.block == nullptr)
+    {
+        freeDeviceMemory(allocation.memory, allocation.mapped != nullptr);
+        dedicatedBytes[type] -= allocation.size;
+        dedicatedCount[type]--;
+    }
+    else
+    {
+        BuddyBlock* block = static_cast<BuddyBlock*>(allocation.block);
+        block->free(allocation.offset);
+        /*give an empty block back to the driver unless it is the last one of its type*/
+        if (block->empty() && blocks[type].size() > 1)
+        {
+            freeDeviceMemory(block->memory, block->mapped != nullptr);
+            auto& typeBlocks = blocks[type];
+            typeBlocks.erase(std::find_if(typeBlocks.begin(), typeBlocks.end(),
+                [block](const std::unique_ptr<BuddyBlock>& b) { return b.get() == block; }));
+        }
+    }
+    usedBytes[type] -= allocation.size;
+    allocationCount[type]--;
+    allocation = Allocation{};
+}
+
+void MemoryAllocator::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage,
+    VkBuffer& buffer, Allocation& allocation, const std::vector<uint32_t>& queueFamilies)
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    /*more than one queue family : let them all access it without ownership transfers*/
+    if (queueFamilies.size() > 1)
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
+    else
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+    allocation = allocate(memRequirements, memoryUsage, ResourceKind::Linear);
+    vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+}
+
+void MemoryAllocator::destroyBuffer(VkBuffer& buffer, Allocation& allocation)
+{
+    vkDestroyBuffer(device, buffer, nullptr);
+    buffer = VK_NULL_HANDLE;
+    free(allocation);
+}
+
+void MemoryAllocator::createImage(
+    const VkImageCreateInfo& imageInfo, MemoryUsage memoryUsage, VkImage& image, Allocation& allocation)
+{
+    if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+    ResourceKind kind = imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear;
+    allocation = allocate(memRequirements, memoryUsage, kind);
+    vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+}
+
+void MemoryAllocator::destroyImage(VkImage& image, Allocation& allocation)
+{
+    vkDestroyImage(device, image, nullptr);
+    image = VK_NULL_HANDLE;
+    free(allocation);
+}
+
+std::vector<HeapStats> MemoryAllocator::getHeapStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<HeapStats> stats(memoryProperties.memoryHeapCount);
+    std::vector<VkDeviceSize> freeBytes(memoryProperties.memoryHeapCount, 0);
+    std::vector<VkDeviceSize> largestFree(memoryProperties.memoryHeapCount, 0);
+
+    for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+    {
+        stats[heap].heapSize = memoryProperties.memoryHeaps[heap].size;
+    }
+    for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++)
+    {
+        uint32_t heap = memoryProperties.memoryTypes[type].heapIndex;
+        HeapStats& heapStats = stats[heap];
+        heapStats.reserved += dedicatedBytes[type];
+        heapStats.blockCount += dedicatedCount[type];
+        heapStats.used += usedBytes[type];
+        heapStats.allocationCount += allocationCount[type];
+        for (const auto& block : blocks[type])
+        {
+            heapStats.reserved += block->size;
+            heapStats.blockCount++;
+            freeBytes[heap] += block->freeBytes();
+            largestFree[heap] = std::max(largestFree[heap], block->largestFree());
+        }
+    }
+    for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+    {
+        if (freeBytes[heap] > 0)
+        {
+            stats[heap].fragmentation = 1.0 - static_cast<double>(largestFree[heap]) / freeBytes[heap];
+        }
+    }
+    return stats;
+}
+
+void MemoryAllocator::printStats(std::ostream& out) const
+{
+    std::vector<HeapStats> stats = getHeapStats();
+    const double MiB = 1024.0 * 1024.0;
+    out << "Device memory:\n";
+    for (size_t heap = 0; heap < stats.size(); heap++)
+    {
+        const HeapStats& s = stats[heap];
+        if (s.blockCount == 0)
+        {
+            continue;
+        }
+        out << "  heap " << heap << std::fixed << std::setprecision(2) << " : reserved " << s.reserved / MiB
+            << " MiB, used " << s.used / MiB << " MiB in " << s.allocationCount << " allocations, " << s.blockCount
+            << " blocks, fragmentation " << s.fragmentation * 100.0 << "% (heap " << s.heapSize / MiB << " MiB)\n";
+    }
+}
@@ -0,0 +1,290 @@
+#include "OctreeStreamer.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cassert>
+#include <queue>
+#include <utility>
+
+/*slots on top of what the budget needs, so nodes can stream in while the frames in flight still draw the old ones*/
+static const uint32_t EXTRA_SLOTS = 16;
+
+void OctreeStreamer::init(MemoryAllocator* allocator_, UploadManager* uploads_,
+    std::shared_ptr<const PointOctree> octree_, uint64_t pointBudget_, const std::vector<uint32_t>& dstFamilies)
+{
+    allocator = allocator_;
+    uploads = uploads_;
+    octree = std::move(octree_);
+    pointBudget = pointBudget_;
+    slotPoints = octree->maxNodePoints();
+    assert(slotPoints > 0);
+
+    /*nodes are often smaller than a slot, twice the budget in slots leaves room for them*/
+    uint64_t budgetSlots = (pointBudget + slotPoints - 1) / slotPoints;
+    slots.resize(2 * budgetSlots + EXTRA_SLOTS);
+    VkDeviceSize bufferSize = static_cast<VkDeviceSize>(slots.size()) * slotPoints * sizeof(Vertex);
+    allocator->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        MemoryUsage::GpuOnly, buffer, bufferMemory, dstFamilies);
+    VD_LOG_INFO("Octree streaming : %zu slots of %u points (%llu MB), budget %llu points", slots.size(), slotPoints,
+        static_cast<unsigned long long>(bufferSize / (1024 * 1024)), static_cast<unsigned long long>(pointBudget));
+
+    stopLoader = false;
+    loader = std::thread(&OctreeStreamer::loaderLoop, this);
+}
+
+void OctreeStreamer::destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        stopLoader = true;
+    }
+    loaderCondition.notify_all();
+    if (loader.joinable())
+    {
+        loader.join();
+    }
+    if (buffer != VK_NULL_HANDLE)
+    {
+        uploads->wait(uploads->flush()); // no copy into the buffer may be left behind
+    }
+    allocator->destroyBuffer(buffer, bufferMemory);
+    slots.clear();
+    states.clear();
+}
+
+/*
+Reads the requested nodes, nothing else : the points go back to update(), which enqueues them on the render thread.
+At most MAX_PENDING_LOADS nodes are in flight, so are their point vectors.
+*/
+void OctreeStreamer::loaderLoop()
+{
+    for (;;)
+    {
+        Load load;
+        {
+            std::unique_lock<std::mutex> lock(loaderMutex);
+            loaderCondition.wait(lock, [this] { return stopLoader || !requests.empty(); });
+            if (stopLoader)
+            {
+                return;
+            }
+            load = std::move(requests.front());
+            requests.pop_front();
+        }
+        if (!octree->readNode(load.node, load.points))
+        {
+            VD_LOG_ERROR("OctreeStreamer: can not read node %u", load.node);
+            load.points.clear(); // drawn empty rather than retried every frame
+        }
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        loaded.push_back(std::move(load));
+    }
+}
+
+/*
+Visible nodes in order of decreasing projected spacing, within the point budget. The spacing of a node is projected at
+its center : world length * the scale of the mvp (largest of its x / y rows) / clip w, in pixels.
+*/
+void OctreeStreamer::select(const glm::mat4& mvp, float viewportHeight, uint64_t frame)
+{
+    const std::vector<PointOctree::Node>& nodes = octree->nodes();
+    selection.clear();
+    if (nodes.empty())
+    {
+        return;
+    }
+    /*glm is column major, row r of the matrix is (mvp[0][r], mvp[1][r], mvp[2][r])*/
+    float scale = std::max(glm::length(glm::vec3(mvp[0][0], mvp[1][0], mvp[2][0])),
+        glm::length(glm::vec3(mvp[0][1], mvp[1][1], mvp[2][1])));
+    float pixelsPerClipUnit = viewportHeight * 0.5f;
+
+    auto visible = [&mvp](const PointOctree::Node& node) {
+        /*outcodes of the 8 corners against the Vulkan clip volume, as cull.comp does*/
+        uint32_t outsideAll = 0x3F;
+        for (uint32_t corner = 0; corner < 8; corner++)
+        {
+            float size = node.size;
+            glm::vec3 p = node.boundsMin
+                + glm::vec3(corner & 1 ? size : 0.0f, corner & 2 ? size : 0.0f, corner & 4 ? size : 0.0f);
+            glm::vec4 c = mvp * glm::vec4(p, 1.0f);
+            uint32_t outside = (c.x < -c.w ? 1u : 0u) | (c.x > c.w ? 2u : 0u) | (c.y < -c.w ? 4u : 0u)
+                | (c.y > c.w ? 8u : 0u) | (c.z < 0.0f ? 16u : 0u) | (c.z > c.w ? 32u : 0u);
+            outsideAll &= outside;
+        }
+        return outsideAll == 0;
+    };
+    auto screenError = [&](const PointOctree::Node& node) {
+        glm::vec4 center = mvp * glm::vec4(node.boundsMin + glm::vec3(node.size * 0.5f), 1.0f);
+        float w = std::max(center.w, 1e-6f);
+        return node.spacing * scale / w * pixelsPerClipUnit;
+    };
+
+    std::priority_queue<std::pair<float, uint32_t>> candidates; // (screen error, node), largest error first
+    if (visible(nodes[0]))
+    {
+        candidates.push({screenError(nodes[0]), 0});
+    }
+    /*the nodes drawn have to fit in the slots next to the ones still streaming*/
+    size_t maxSelected = slots.size() - std::min<size_t>(slots.size(), EXTRA_SLOTS);
+    uint64_t points = 0;
+    while (!candidates.empty() && selection.size() < maxSelected)
+    {
+        uint32_t index = candidates.top().second;
+        candidates.pop();
+        const PointOctree::Node& node = nodes[index];
+        if (points + node.pointCount > pointBudget)
+        {
+            break;
+        }
+        points += node.pointCount;
+        selection.push_back(index);
+        states[index].selectedFrame = frame;
+        /*the children add the points between this node's ones, only worth it while those are visibly apart*/
+        if (screenError(node) <= maxScreenError)
+        {
+            continue;
+        }
+        for (int32_t child : node.children)
+        {
+            if (child != PointOctree::NO_NODE && visible(nodes[child]))
+            {
+                candidates.push({screenError(nodes[child]), static_cast<uint32_t>(child)});
+            }
+        }
+    }
+}
+
+/*A never used slot, else the least recently used one no selected node and no frame in flight needs anymore*/
+int32_t OctreeStreamer::acquireSlot(uint64_t frame, uint64_t completedFrames)
+{
+    int32_t best = -1;
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        const Slot& slot = slots[i];
+        if (slot.node == PointOctree::NO_NODE)
+        {
+            return static_cast<int32_t>(i);
+        }
+        const NodeState& owner = states[slot.node];
+        if (owner.residency != Residency::Resident || owner.selectedFrame == frame
+            || slot.lastUsedFrame > completedFrames)
+        {
+            continue;
+        }
+        if (best < 0 || slot.lastUsedFrame < slots[best].lastUsedFrame)
+        {
+            best = static_cast<int32_t>(i);
+        }
+    }
+    if (best >= 0)
+    {
+        NodeState& evicted = states[slots[best].node];
+        evicted.residency = Residency::Absent;
+        evicted.slot = -1;
+        slots[best].node = PointOctree::NO_NODE;
+    }
+    return best;
+}
+
+void OctreeStreamer::update(const glm::mat4& mvp, float viewportHeight, uint64_t frame, uint64_t completedFrames)
+{
+    draws.clear();
+    frameStats = Stats();
+    if (!octree->ready())
+    {
+        return; // still building
+    }
+    const std::vector<PointOctree::Node>& nodes = octree->nodes();
+    if (states.size() != nodes.size())
+    {
+        states.assign(nodes.size(), NodeState());
+    }
+
+    /*what the loader thread read is enqueued here, then what the transfer queue finished*/
+    std::vector<Load> read;
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        read.swap(loaded);
+    }
+    for (const Load& load : read)
+    {
+        UploadTicket ticket = 0;
+        if (!load.points.empty())
+        {
+            ticket = uploads->uploadBuffer(buffer, static_cast<VkDeviceSize>(load.slot) * slotPoints * sizeof(Vertex),
+                load.points.data(), load.points.size() * sizeof(Vertex));
+        }
+        states[load.node].residency = Residency::Uploading;
+        states[load.node].ticket = ticket;
+        uploading.push_back(load.node);
+    }
+    uploading.erase(std::remove_if(uploading.begin(), uploading.end(),
+                        [this](uint32_t node) {
+                            if (!uploads->isComplete(states[node].ticket))
+                            {
+                                return false;
+                            }
+                            states[node].residency = Residency::Resident;
+                            pendingLoads--;
+                            return true;
+                        }),
+        uploading.end());
+
+    select(mvp, viewportHeight, frame);
+    /*coarse levels first : a parent is looked at before its children, and loaded before them*/
+    std::stable_sort(selection.begin(), selection.end(),
+        [&nodes](uint32_t a, uint32_t b) { return nodes[a].level < nodes[b].level; });
+
+    for (uint32_t index : selection)
+    {
+        NodeState& state = states[index];
+        const PointOctree::Node& node = nodes[index];
+        bool parentDrawn = node.parent == PointOctree::NO_NODE || states[node.parent].drawnFrame == frame;
+        if (state.residency == Residency::Resident && parentDrawn)
+        {
+            state.drawnFrame = frame;
+            slots[state.slot].lastUsedFrame = frame;
+            if (node.pointCount > 0)
+            {
+                draws.push_back({node.pointCount, 1, static_cast<uint32_t>(state.slot) * slotPoints, 0});
+            }
+            frameStats.drawnPoints += node.pointCount;
+            continue;
+        }
+        if (state.residency != Residency::Absent || pendingLoads >= MAX_PENDING_LOADS)
+        {
+            continue;
+        }
+        int32_t slot = acquireSlot(frame, completedFrames);
+        if (slot < 0)
+        {
+            continue; // every spare slot is still read by a frame in flight
+        }
+        slots[slot].node = static_cast<int32_t>(index);
+        state.residency = Residency::Loading;
+        state.slot = slot;
+        pendingLoads++;
+        {
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            requests.push_back({index, slot, {}});
+        }
+        loaderCondition.notify_one();
+    }
+
+    frameStats.selectedNodes = static_cast<uint32_t>(selection.size());
+    frameStats.drawnNodes = static_cast<uint32_t>(draws.size());
+    frameStats.pendingLoads = pendingLoads;
+    for (const Slot& slot : slots)
+    {
+        frameStats.residentNodes += slot.node != PointOctree::NO_NODE
+            && states[slot.node].residency == Residency::Resident;
+    }
+}
+
+void OctreeStreamer::recordDraws(VkCommandBuffer commandBuffer) const
+{
+    for (const VkDrawIndirectCommand& draw : draws)
+    {
+        vkCmdDraw(commandBuffer, draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
+    }
+}
@@ -0,0 +1,128 @@
+#include "PipelineCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+/*VkPipelineCacheHeaderVersionOne as laid out in the cache data*/
+static const size_t HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+void PipelineCache::init(VkDevice device_, VkPhysicalDevice physicalDevice, const std::string& path_)
+{
+    device = device_;
+    path = path_;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    std::vector<char> data;
+    if (!path.empty())
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (file.is_open())
+        {
+            data.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(data.data(), data.size());
+            if (!file || !validHeader(data))
+            {
+                data.clear(); // stale (other GPU or driver) or damaged, start over
+            }
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+    if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS)
+    {
+        /*the driver may still refuse data it wrote itself, an empty cache always works*/
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        data.clear();
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+    loaded = !data.empty();
+    loadedSize = data.size();
+}
+
+bool PipelineCache::validHeader(const std::vector<char>& data) const
+{
+    if (data.size() < HEADER_SIZE)
+    {
+        return false;
+    }
+    uint32_t header[4]; // headerSize, headerVersion, vendorID, deviceID
+    memcpy(header, data.data(), sizeof(header));
+    return header[0] >= HEADER_SIZE && header[0] <= data.size()
+        && header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header[2] == properties.vendorID
+        && header[3] == properties.deviceID
+        && memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::save()
+{
+    if (cache == VK_NULL_HANDLE || path.empty())
+    {
+        return;
+    }
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS || size == 0)
+    {
+        return;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS)
+    {
+        return;
+    }
+
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), size);
+        if (!file)
+        {
+            std::remove(tempPath.c_str());
+            return; // a missing cache only costs compile time on the next run
+        }
+    }
+    std::rename(tempPath.c_str(), path.c_str());
+}
+
+void PipelineCache::destroy()
+{
+    if (cache != VK_NULL_HANDLE)
+    {
+        vkDestroyPipelineCache(device, cache, nullptr);
+        cache = VK_NULL_HANDLE;
+    }
+}
+
+void PipelineCache::recordPipeline(const char* name, double milliseconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pipelineTimes.emplace_back(name, milliseconds);
+}
+
+void PipelineCache::printSummary(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    double total = 0.0;
+    for (const auto& pipeline : pipelineTimes)
+    {
+        total += pipeline.second;
+    }
+    out << "Pipeline cache : "
+        << (loaded ? "warm (" + std::to_string(loadedSize) + " bytes from " + path + ")" : "cold") << ", "
+        << pipelineTimes.size() << " pipelines in " << std::fixed << std::setprecision(2) << total << " ms"
+        << std::endl;
+    for (const auto& pipeline : pipelineTimes)
+    {
+        out << "  " << pipeline.first << " : " << pipeline.second << " ms" << std::endl;
+    }
+}
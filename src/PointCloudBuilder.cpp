@@ -0,0 +1,386 @@
+#include "PointCloudBuilder.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+/*the AVX2 kernels are compiled for AVX2 whatever the target of the build, and only run where the CPU has it*/
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define VD_RUNTIME_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+/*Depth validity and scale, shared by both passes so they always agree on which pixels are points*/
+struct DepthParams
+{
+    float scale;
+    float minDepth;
+    float maxDepth;
+};
+
+/*8-bit color channel -> [0, 1]*/
+const std::array<float, 256>& colorTable()
+{
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> values{};
+        for (int i = 0; i < 256; i++)
+        {
+            values[i] = i / 255.0f;
+        }
+        return values;
+    }();
+    return table;
+}
+
+inline float depthAt(const uint16_t* depth, const DepthParams& params) { return *depth * params.scale; }
+inline float depthAt(const float* depth, const DepthParams&) { return *depth; }
+
+/*NaN compares false, so invalid float depth is rejected as well*/
+inline bool isValid(float z, const DepthParams& params) { return z >= params.minDepth && z <= params.maxDepth; }
+
+inline void writeVertex(Vertex* out, float x, float y, float z, const uint8_t* bgr)
+{
+    const std::array<float, 256>& toFloat = colorTable();
+    out->position = glm::vec3(x, y, z);
+    out->color = glm::vec3(toFloat[bgr[2]], toFloat[bgr[1]], toFloat[bgr[0]]);
+}
+
+/*
+Row kernels. Every instruction set has a countRow / writeRow pair working on a whole row, the vector types never cross
+a function of another instruction set. The vector loops leave the last width % lanes pixels to the scalar kernel.
+*/
+namespace scalar
+{
+template <typename DepthT> size_t countRow(const DepthT* depth, int width, const DepthParams& params)
+{
+    size_t count = 0;
+    for (int u = 0; u < width; u++)
+    {
+        count += isValid(depthAt(depth + u, params), params);
+    }
+    return count;
+}
+
+template <typename DepthT>
+Vertex* writeRow(const DepthT* depth, const uint8_t* color, int channels, int width, const float* xTable,
+    float yFactor, const DepthParams& params, Vertex* out)
+{
+    for (int u = 0; u < width; u++)
+    {
+        float z = depthAt(depth + u, params);
+        if (isValid(z, params))
+        {
+            writeVertex(out++, xTable[u] * z, yFactor * z, z, color + u * channels);
+        }
+    }
+    return out;
+}
+} // namespace scalar
+
+#if defined(__SSE2__)
+/*compaction : one vertex per set bit of mask, xs / ys / zs hold the lanes*/
+inline Vertex* writeLanes(unsigned int mask, const float* xs, const float* ys, const float* zs, const uint8_t* color,
+    int channels, Vertex* out)
+{
+    for (; mask; mask &= mask - 1)
+    {
+        int i = __builtin_ctz(mask);
+        writeVertex(out++, xs[i], ys[i], zs[i], color + i * channels);
+    }
+    return out;
+}
+
+/*4 pixels, x86-64 always has it*/
+namespace sse2
+{
+static const int WIDTH = 4;
+
+inline __m128 loadDepth(const uint16_t* depth, const DepthParams& params)
+{
+    __m128i raw = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth));
+    __m128i words = _mm_unpacklo_epi16(raw, _mm_setzero_si128()); // zero extended to 32 bits
+    return _mm_mul_ps(_mm_cvtepi32_ps(words), _mm_set1_ps(params.scale));
+}
+inline __m128 loadDepth(const float* depth, const DepthParams&) { return _mm_loadu_ps(depth); }
+
+inline unsigned int validMask(__m128 z, const DepthParams& params)
+{
+    __m128 aboveMin = _mm_cmpge_ps(z, _mm_set1_ps(params.minDepth));
+    __m128 belowMax = _mm_cmple_ps(z, _mm_set1_ps(params.maxDepth));
+    return static_cast<unsigned int>(_mm_movemask_ps(_mm_and_ps(aboveMin, belowMax)));
+}
+
+template <typename DepthT> size_t countRow(const DepthT* depth, int width, const DepthParams& params)
+{
+    size_t count = 0;
+    int u = 0;
+    for (; u + WIDTH <= width; u += WIDTH)
+    {
+        count += __builtin_popcount(validMask(loadDepth(depth + u, params), params));
+    }
+    return count + scalar::countRow(depth + u, width - u, params);
+}
+
+template <typename DepthT>
+Vertex* writeRow(const DepthT* depth, const uint8_t* color, int channels, int width, const float* xTable,
+    float yFactor, const DepthParams& params, Vertex* out)
+{
+    alignas(16) float xs[WIDTH], ys[WIDTH], zs[WIDTH];
+    int u = 0;
+    for (; u + WIDTH <= width; u += WIDTH)
+    {
+        __m128 z = loadDepth(depth + u, params);
+        unsigned int mask = validMask(z, params);
+        if (mask == 0)
+        {
+            continue; // holes are common (sky, out of range), skip them without touching the color
+        }
+        _mm_store_ps(xs, _mm_mul_ps(z, _mm_loadu_ps(xTable + u)));
+        _mm_store_ps(ys, _mm_mul_ps(z, _mm_set1_ps(yFactor)));
+        _mm_store_ps(zs, z);
+        out = writeLanes(mask, xs, ys, zs, color + u * channels, channels, out);
+    }
+    return scalar::writeRow(
+        depth + u, color + u * channels, channels, width - u, xTable + u, yFactor, params, out);
+}
+} // namespace sse2
+#endif
+
+#if defined(VD_RUNTIME_AVX2)
+/*8 pixels. Everything up to the matching pop is compiled for AVX2 (and POPCNT, which every AVX2 CPU has)*/
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,popcnt"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,popcnt")
+#endif
+namespace avx2
+{
+static const int WIDTH = 8;
+
+inline __m256 loadDepth(const uint16_t* depth, const DepthParams& params)
+{
+    __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(raw)), _mm256_set1_ps(params.scale));
+}
+inline __m256 loadDepth(const float* depth, const DepthParams&) { return _mm256_loadu_ps(depth); }
+
+inline unsigned int validMask(__m256 z, const DepthParams& params)
+{
+    __m256 aboveMin = _mm256_cmp_ps(z, _mm256_set1_ps(params.minDepth), _CMP_GE_OQ);
+    __m256 belowMax = _mm256_cmp_ps(z, _mm256_set1_ps(params.maxDepth), _CMP_LE_OQ);
+    return static_cast<unsigned int>(_mm256_movemask_ps(_mm256_and_ps(aboveMin, belowMax)));
+}
+
+template <typename DepthT> size_t countRow(const DepthT* depth, int width, const DepthParams& params)
+{
+    size_t count = 0;
+    int u = 0;
+    for (; u + WIDTH <= width; u += WIDTH)
+    {
+        count += __builtin_popcount(validMask(loadDepth(depth + u, params), params));
+    }
+    return count + scalar::countRow(depth + u, width - u, params);
+}
+
+template <typename DepthT>
+Vertex* writeRow(const DepthT* depth, const uint8_t* color, int channels, int width, const float* xTable,
+    float yFactor, const DepthParams& params, Vertex* out)
+{
+    alignas(32) float xs[WIDTH], ys[WIDTH], zs[WIDTH];
+    int u = 0;
+    for (; u + WIDTH <= width; u += WIDTH)
+    {
+        __m256 z = loadDepth(depth + u, params);
+        unsigned int mask = validMask(z, params);
+        if (mask == 0)
+        {
+            continue; // holes are common (sky, out of range), skip them without touching the color
+        }
+        _mm256_store_ps(xs, _mm256_mul_ps(z, _mm256_loadu_ps(xTable + u)));
+        _mm256_store_ps(ys, _mm256_mul_ps(z, _mm256_set1_ps(yFactor)));
+        _mm256_store_ps(zs, z);
+        out = writeLanes(mask, xs, ys, zs, color + u * channels, channels, out);
+    }
+    return scalar::writeRow(
+        depth + u, color + u * channels, channels, width - u, xTable + u, yFactor, params, out);
+}
+} // namespace avx2
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif
+
+enum class RowKernels
+{
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+/*the widest kernels the CPU running the program supports, looked up once*/
+RowKernels rowKernels()
+{
+#if defined(__AVX2__)
+    return RowKernels::Avx2;
+#elif defined(VD_RUNTIME_AVX2)
+    static const RowKernels kernels = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")
+        ? RowKernels::Avx2
+        : RowKernels::Sse2;
+    return kernels;
+#elif defined(__SSE2__)
+    return RowKernels::Sse2;
+#else
+    return RowKernels::Scalar;
+#endif
+}
+
+template <typename DepthT>
+size_t countRow(RowKernels kernels, const DepthT* depth, int width, const DepthParams& params)
+{
+    switch (kernels)
+    {
+#if defined(VD_RUNTIME_AVX2)
+    case RowKernels::Avx2: return avx2::countRow(depth, width, params);
+#endif
+#if defined(__SSE2__)
+    case RowKernels::Sse2: return sse2::countRow(depth, width, params);
+#endif
+    default: return scalar::countRow(depth, width, params);
+    }
+}
+
+template <typename DepthT>
+Vertex* writeRow(RowKernels kernels, const DepthT* depth, const uint8_t* color, int channels, int width,
+    const float* xTable, float yFactor, const DepthParams& params, Vertex* out)
+{
+    switch (kernels)
+    {
+#if defined(VD_RUNTIME_AVX2)
+    case RowKernels::Avx2: return avx2::writeRow(depth, color, channels, width, xTable, yFactor, params, out);
+#endif
+#if defined(__SSE2__)
+    case RowKernels::Sse2: return sse2::writeRow(depth, color, channels, width, xTable, yFactor, params, out);
+#endif
+    default: return scalar::writeRow(depth, color, channels, width, xTable, yFactor, params, out);
+    }
+}
+
+} // namespace
+
+PointCloudBuilder::PointCloudBuilder(ThreadPool& pool)
+    : pool(pool)
+{
+}
+
+void PointCloudBuilder::prepareTables(int width, int height, const CameraIntrinsics& intrinsics)
+{
+    xTable.resize(width);
+    yTable.resize(height);
+    for (int u = 0; u < width; u++)
+    {
+        xTable[u] = (u - intrinsics.cx) / intrinsics.fx;
+    }
+    for (int v = 0; v < height; v++)
+    {
+        yTable[v] = (v - intrinsics.cy) / intrinsics.fy;
+    }
+}
+
+size_t PointCloudBuilder::build(const cv::Mat& color, const cv::Mat& depth, const CameraIntrinsics& intrinsics,
+    Vertex* out, size_t capacity)
+{
+    if (color.rows != depth.rows || color.cols != depth.cols)
+    {
+        throw std::runtime_error("PointCloudBuilder: color and depth sizes differ!");
+    }
+    if (color.type() != CV_8UC3 && color.type() != CV_8UC4)
+    {
+        throw std::runtime_error("PointCloudBuilder: color must be CV_8UC3 or CV_8UC4!");
+    }
+    if (depth.type() != CV_16UC1 && depth.type() != CV_32FC1)
+    {
+        throw std::runtime_error("PointCloudBuilder: depth must be CV_16UC1 or CV_32FC1!");
+    }
+    if (intrinsics.fx == 0.0f || intrinsics.fy == 0.0f)
+    {
+        throw std::runtime_error("PointCloudBuilder: invalid intrinsics!");
+    }
+
+    const int width = depth.cols;
+    const int height = depth.rows;
+    const int channels = color.channels();
+    const bool floatDepth = depth.type() == CV_32FC1;
+    const DepthParams params = {intrinsics.depthScale, intrinsics.minDepth, intrinsics.maxDepth};
+    const RowKernels kernels = rowKernels();
+    prepareTables(width, height, intrinsics);
+
+    /*a few bands per thread so a slow band (many valid pixels) does not hold the others back*/
+    size_t rowsPerBand = std::max<size_t>(8, height / (pool.concurrency() * 4));
+    size_t bandCount = (height + rowsPerBand - 1) / rowsPerBand;
+    bandCounts.assign(bandCount, 0);
+
+    /*pass 1 : valid pixels per band*/
+    pool.parallelFor(0, bandCount, 1, [&](size_t bandBegin, size_t bandEnd) {
+        for (size_t band = bandBegin; band < bandEnd; band++)
+        {
+            int rowEnd = static_cast<int>(std::min<size_t>(height, (band + 1) * rowsPerBand));
+            size_t count = 0;
+            for (int v = static_cast<int>(band * rowsPerBand); v < rowEnd; v++)
+            {
+                count += floatDepth ? countRow(kernels, depth.ptr<float>(v), width, params)
+                                    : countRow(kernels, depth.ptr<uint16_t>(v), width, params);
+            }
+            bandCounts[band] = count;
+        }
+    });
+
+    /*exclusive prefix sum : output offset of every band*/
+    size_t total = 0;
+    for (size_t& count : bandCounts)
+    {
+        size_t bandSize = count;
+        count = total;
+        total += bandSize;
+    }
+    if (total > capacity)
+    {
+        throw std::runtime_error("PointCloudBuilder: output buffer too small!");
+    }
+
+    /*pass 2 : write every band at its offset*/
+    pool.parallelFor(0, bandCount, 1, [&](size_t bandBegin, size_t bandEnd) {
+        for (size_t band = bandBegin; band < bandEnd; band++)
+        {
+            Vertex* bandOut = out + bandCounts[band];
+            int rowEnd = static_cast<int>(std::min<size_t>(height, (band + 1) * rowsPerBand));
+            for (int v = static_cast<int>(band * rowsPerBand); v < rowEnd; v++)
+            {
+                const uint8_t* colorRow = color.ptr<uint8_t>(v);
+                bandOut = floatDepth ? writeRow(kernels, depth.ptr<float>(v), colorRow, channels, width,
+                                           xTable.data(), yTable[v], params, bandOut)
+                                     : writeRow(kernels, depth.ptr<uint16_t>(v), colorRow, channels, width,
+                                           xTable.data(), yTable[v], params, bandOut);
+            }
+        }
+    });
+    return total;
+}
+
+size_t PointCloudBuilder::build(
+    const cv::Mat& color, const cv::Mat& depth, const CameraIntrinsics& intrinsics, std::vector<Vertex>& vertices)
+{
+    vertices.resize(maxVertexCount(depth));
+    size_t count = build(color, depth, intrinsics, vertices.data(), vertices.size());
+    vertices.resize(count);
+    return count;
+}
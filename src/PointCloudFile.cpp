@@ -0,0 +1,387 @@
+#include "PointCloudFile.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+/*points converted per task, large enough to amortize the task, small enough to spread a chunk over the pool*/
+static const size_t CONVERT_GRAIN = 16384;
+/*a header longer than this is not a header*/
+static const size_t MAX_HEADER_SIZE = 64 * 1024;
+
+bool PointCloudFile::open(const std::string& path)
+{
+    close();
+    if (!file.open(path))
+    {
+        return false;
+    }
+    file.adviseSequential();
+    mapped = file.data();
+    mappedSize = file.size();
+
+    std::string header(reinterpret_cast<const char*>(mapped), std::min(mappedSize, MAX_HEADER_SIZE));
+    bool parsed = false;
+    try
+    {
+        parsed = header.compare(0, 3, "ply") == 0 ? parsePly(header) : parsePcd(header);
+    }
+    catch (const std::exception&)
+    {
+        parsed = false; // a number that does not parse (std::stoull)
+    }
+    /*the counts come from the file : compared by division, a product could wrap around*/
+    if (parsed && (stride == 0 || payloadOffset > mappedSize || points > (mappedSize - payloadOffset) / stride))
+    {
+        VD_LOG_ERROR("PointCloudFile: %s is truncated", path.c_str());
+        parsed = false;
+    }
+    if (!parsed)
+    {
+        VD_LOG_ERROR("PointCloudFile: %s is not a supported binary PLY / PCD file", path.c_str());
+        close();
+        return false;
+    }
+    floatPositions = position[0].type == Scalar::Float32 && position[1].type == Scalar::Float32
+        && position[2].type == Scalar::Float32 && position[1].offset == position[0].offset + 4
+        && position[2].offset == position[0].offset + 8;
+    return true;
+}
+
+void PointCloudFile::close()
+{
+    file.close();
+    mapped = nullptr;
+    mappedSize = 0;
+    points = 0;
+    stride = 0;
+    payloadOffset = 0;
+    for (Field* field : {&position[0], &position[1], &position[2], &color[0], &color[1], &color[2], &packedColor})
+    {
+        *field = Field();
+    }
+}
+
+bool PointCloudFile::parseScalar(const std::string& name, Scalar& type, size_t& size)
+{
+    static const struct
+    {
+        const char* names[2];
+        Scalar type;
+        size_t size;
+    } scalars[] = {
+        {{"char", "int8"}, Scalar::Int8, 1},
+        {{"uchar", "uint8"}, Scalar::UInt8, 1},
+        {{"short", "int16"}, Scalar::Int16, 2},
+        {{"ushort", "uint16"}, Scalar::UInt16, 2},
+        {{"int", "int32"}, Scalar::Int32, 4},
+        {{"uint", "uint32"}, Scalar::UInt32, 4},
+        {{"float", "float32"}, Scalar::Float32, 4},
+        {{"double", "float64"}, Scalar::Float64, 8},
+    };
+    for (const auto& scalar : scalars)
+    {
+        if (name == scalar.names[0] || name == scalar.names[1])
+        {
+            type = scalar.type;
+            size = scalar.size;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ply
+format binary_little_endian 1.0
+element vertex N
+property float x
+...
+end_header
+*/
+bool PointCloudFile::parsePly(const std::string& header)
+{
+    size_t end = header.find("end_header");
+    size_t newline = end == std::string::npos ? end : header.find('\n', end);
+    if (newline == std::string::npos)
+    {
+        return false;
+    }
+    payloadOffset = newline + 1;
+
+    std::istringstream lines(header.substr(0, end));
+    std::string line;
+    bool binary = false;
+    bool vertexDone = false;  // the vertex element was closed, the rest of the header does not matter
+    bool inElement = false;
+    bool inVertex = false;
+    uint64_t elementCount = 0;
+    size_t elementSize = 0;
+    bool elementHasList = false;
+    /*elements in front of the vertices are skipped, which needs their size*/
+    auto closeElement = [&]() {
+        if (!inElement || vertexDone)
+        {
+            return true;
+        }
+        if (inVertex)
+        {
+            vertexDone = true;
+            stride = elementSize;
+        }
+        else
+        {
+            if (elementSize != 0 && elementCount > (std::numeric_limits<size_t>::max() - payloadOffset) / elementSize)
+            {
+                return false;
+            }
+            payloadOffset += elementCount * elementSize;
+        }
+        return !elementHasList;
+    };
+    while (std::getline(lines, line))
+    {
+        std::istringstream words(line);
+        std::string keyword;
+        words >> keyword;
+        if (keyword == "format")
+        {
+            std::string format;
+            words >> format;
+            binary = format == "binary_little_endian";
+        }
+        else if (keyword == "element" && !vertexDone)
+        {
+            if (!closeElement())
+            {
+                return false;
+            }
+            std::string name;
+            words >> name >> elementCount;
+            inElement = true;
+            inVertex = name == "vertex";
+            elementSize = 0;
+            elementHasList = false;
+            if (inVertex)
+            {
+                points = elementCount;
+            }
+        }
+        else if (keyword == "property" && inElement && !vertexDone)
+        {
+            std::string typeName, name;
+            words >> typeName >> name;
+            Scalar type;
+            size_t size;
+            if (typeName == "list")
+            {
+                elementHasList = true;
+                continue;
+            }
+            if (!parseScalar(typeName, type, size))
+            {
+                return false;
+            }
+            static const char* names[] = {"x", "y", "z", "red", "green", "blue"};
+            for (int i = 0; i < 6 && inVertex; i++)
+            {
+                if (name == names[i])
+                {
+                    Field& field = i < 3 ? position[i] : color[i - 3];
+                    field.offset = elementSize;
+                    field.type = type;
+                    field.present = true;
+                }
+            }
+            elementSize += size;
+        }
+    }
+    if (!closeElement())
+    {
+        return false;
+    }
+    return binary && vertexDone && position[0].present && position[1].present && position[2].present;
+}
+
+/*
+# .PCD v0.7
+FIELDS x y z rgb
+SIZE 4 4 4 4
+TYPE F F F U
+COUNT 1 1 1 1
+POINTS N
+DATA binary
+*/
+bool PointCloudFile::parsePcd(const std::string& header)
+{
+    std::vector<std::string> fields, sizes, types, counts;
+    uint64_t width = 0, height = 1;
+    bool pointsGiven = false;
+    size_t lineStart = 0;
+    while (lineStart < header.size())
+    {
+        size_t lineEnd = header.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+        {
+            return false;
+        }
+        std::istringstream words(header.substr(lineStart, lineEnd - lineStart));
+        lineStart = lineEnd + 1;
+        std::string keyword, word;
+        words >> keyword;
+        std::vector<std::string> values;
+        while (words >> word)
+        {
+            values.push_back(word);
+        }
+        if (keyword == "FIELDS")
+        {
+            fields = values;
+        }
+        else if (keyword == "SIZE")
+        {
+            sizes = values;
+        }
+        else if (keyword == "TYPE")
+        {
+            types = values;
+        }
+        else if (keyword == "COUNT")
+        {
+            counts = values;
+        }
+        else if (keyword == "WIDTH" && !values.empty())
+        {
+            width = std::stoull(values[0]);
+        }
+        else if (keyword == "HEIGHT" && !values.empty())
+        {
+            height = std::stoull(values[0]);
+        }
+        else if (keyword == "POINTS" && !values.empty())
+        {
+            points = std::stoull(values[0]);
+            pointsGiven = true;
+        }
+        else if (keyword == "DATA")
+        {
+            if (values.empty() || values[0] != "binary")
+            {
+                return false;
+            }
+            payloadOffset = lineStart;
+            break;
+        }
+    }
+    if (payloadOffset == 0 || fields.empty() || sizes.size() != fields.size() || types.size() != fields.size())
+    {
+        return false;
+    }
+    if (!pointsGiven)
+    {
+        points = width * height;
+    }
+
+    for (size_t i = 0; i < fields.size(); i++)
+    {
+        size_t size = std::stoul(sizes[i]);
+        size_t count = i < counts.size() ? std::stoul(counts[i]) : 1;
+        std::string typeName = types[i] == "F" ? "float" : types[i] == "U" ? "uint" : "int";
+        typeName += std::to_string(8 * size);
+        Field field;
+        field.offset = stride;
+        field.present = parseScalar(typeName, field.type, size);
+        if (!field.present)
+        {
+            return false;
+        }
+        if (fields[i] == "x" || fields[i] == "y" || fields[i] == "z")
+        {
+            position[fields[i][0] - 'x'] = field;
+        }
+        else if ((fields[i] == "rgb" || fields[i] == "rgba") && size == 4)
+        {
+            packedColor = field;
+        }
+        if (count > (std::numeric_limits<size_t>::max() - stride) / size)
+        {
+            return false;
+        }
+        stride += size * count;
+    }
+    return position[0].present && position[1].present && position[2].present;
+}
+
+template <typename T> static float load(const uint8_t* p)
+{
+    T value;
+    memcpy(&value, p, sizeof(T)); // records are packed, fields are not aligned
+    return static_cast<float>(value);
+}
+
+float PointCloudFile::readScalar(const uint8_t* p, Scalar type)
+{
+    switch (type)
+    {
+    case Scalar::Int8: return load<int8_t>(p);
+    case Scalar::UInt8: return load<uint8_t>(p);
+    case Scalar::Int16: return load<int16_t>(p);
+    case Scalar::UInt16: return load<uint16_t>(p);
+    case Scalar::Int32: return load<int32_t>(p);
+    case Scalar::UInt32: return load<uint32_t>(p);
+    case Scalar::Float32: return load<float>(p);
+    case Scalar::Float64: return load<double>(p);
+    }
+    return 0.0f;
+}
+
+void PointCloudFile::convert(uint64_t first, uint64_t count, Vertex* out, ThreadPool& pool) const
+{
+    assert(first + count <= points);
+    const uint8_t* records = mapped + payloadOffset + first * stride;
+    /*integer colors are 8-bit (PLY uchar), float colors already are in [0, 1]*/
+    float colorScale[3];
+    for (int c = 0; c < 3; c++)
+    {
+        colorScale[c] = color[c].type == Scalar::Float32 || color[c].type == Scalar::Float64 ? 1.0f : 1.0f / 255.0f;
+    }
+
+    pool.parallelFor(0, static_cast<size_t>(count), CONVERT_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const uint8_t* record = records + i * stride;
+            Vertex& vertex = out[i];
+            if (floatPositions)
+            {
+                memcpy(&vertex.position, record + position[0].offset, sizeof(glm::vec3));
+            }
+            else
+            {
+                vertex.position = glm::vec3(readScalar(record + position[0].offset, position[0].type),
+                    readScalar(record + position[1].offset, position[1].type),
+                    readScalar(record + position[2].offset, position[2].type));
+            }
+
+            if (packedColor.present)
+            {
+                uint32_t rgb;
+                memcpy(&rgb, record + packedColor.offset, 4);
+                vertex.color = glm::vec3((rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF) * (1.0f / 255.0f);
+            }
+            else if (color[0].present && color[1].present && color[2].present)
+            {
+                vertex.color = glm::vec3(readScalar(record + color[0].offset, color[0].type) * colorScale[0],
+                    readScalar(record + color[1].offset, color[1].type) * colorScale[1],
+                    readScalar(record + color[2].offset, color[2].type) * colorScale[2]);
+            }
+            else
+            {
+                vertex.color = glm::vec3(1.0f);
+            }
+        }
+    });
+}
@@ -0,0 +1,275 @@
+#include "PointOctree.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <unordered_set>
+
+static const char OCTREE_MAGIC[8] = {'V', 'D', 'O', 'C', 'T', 'R', 'E', 'E'};
+static const uint32_t OCTREE_VERSION = 1;
+
+static_assert(std::is_trivially_copyable<PointOctree::Node>::value, "the node table is written as is");
+static_assert(std::is_trivially_copyable<Vertex>::value, "the points are written as is");
+
+void PointOctree::build(std::vector<Vertex> points, const OctreeBuildOptions& options)
+{
+    assert(options.maxNodePoints > 0 && options.gridResolution > 0);
+    isReady.store(false, std::memory_order_release);
+    nodeCapacity = options.maxNodePoints;
+    nodeTable.clear();
+    nodePoints.clear();
+    nodePoints.reserve(points.size());
+    totalPoints = 0;
+
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    for (const Vertex& point : points)
+    {
+        lo = glm::min(lo, point.position);
+        hi = glm::max(hi, point.position);
+    }
+    if (!points.empty())
+    {
+        glm::vec3 extent = hi - lo;
+        /*a cube, slightly larger so that the points on the far faces still fall inside*/
+        float size = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f)) * 1.0001f;
+        buildNode(points, lo, size, 0, NO_NODE, options);
+    }
+    totalPoints = nodePoints.size();
+    isReady.store(true, std::memory_order_release);
+}
+
+std::future<void> PointOctree::buildAsync(std::vector<Vertex> points, const OctreeBuildOptions& options)
+{
+    isReady.store(false, std::memory_order_release);
+    nodeCapacity = options.maxNodePoints;
+    return std::async(std::launch::async,
+        [this, options](std::vector<Vertex> cloud) { build(std::move(cloud), options); }, std::move(points));
+}
+
+/*
+Keeps the first point of every occupied grid cell (up to maxNodePoints), hands the others to the octant they fall in
+and recurses. points is released before the children are built, the peak memory is about twice the cloud.
+*/
+int32_t PointOctree::buildNode(std::vector<Vertex>& points, const glm::vec3& boundsMin, float size, uint32_t level,
+    int32_t parent, const OctreeBuildOptions& options)
+{
+    int32_t index = static_cast<int32_t>(nodeTable.size());
+    Node node{};
+    node.boundsMin = boundsMin;
+    node.size = size;
+    node.spacing = size / options.gridResolution;
+    node.level = level;
+    node.parent = parent;
+    std::fill(std::begin(node.children), std::end(node.children), NO_NODE);
+    node.pointOffset = nodePoints.size();
+
+    std::array<std::vector<Vertex>, 8> octants;
+    if (points.size() <= options.maxNodePoints)
+    {
+        nodePoints.insert(nodePoints.end(), points.begin(), points.end());
+    }
+    else if (level >= options.maxDepth)
+    {
+        /*no room to go deeper, a regular subsample stands for the rest*/
+        for (uint32_t i = 0; i < options.maxNodePoints; i++)
+        {
+            nodePoints.push_back(points[static_cast<size_t>(i) * points.size() / options.maxNodePoints]);
+        }
+    }
+    else
+    {
+        float cellScale = options.gridResolution / size;
+        float half = size * 0.5f;
+        uint32_t cellMax = options.gridResolution - 1;
+        std::unordered_set<uint64_t> occupied;
+        occupied.reserve(std::min<size_t>(points.size(), options.maxNodePoints) * 2);
+        auto cellOf = [&](float coordinate) {
+            return std::min<uint64_t>(static_cast<uint64_t>(std::max(coordinate * cellScale, 0.0f)), cellMax);
+        };
+        for (const Vertex& point : points)
+        {
+            glm::vec3 local = point.position - boundsMin;
+            uint64_t key = (cellOf(local.z) * options.gridResolution + cellOf(local.y)) * options.gridResolution
+                + cellOf(local.x);
+            if (nodePoints.size() - node.pointOffset < options.maxNodePoints && occupied.insert(key).second)
+            {
+                nodePoints.push_back(point);
+                continue;
+            }
+            uint32_t octant = (local.x >= half ? 1 : 0) | (local.y >= half ? 2 : 0) | (local.z >= half ? 4 : 0);
+            octants[octant].push_back(point);
+        }
+    }
+    node.pointCount = static_cast<uint32_t>(nodePoints.size() - node.pointOffset);
+    nodeTable.push_back(node);
+    points = std::vector<Vertex>();
+
+    float half = size * 0.5f;
+    for (uint32_t octant = 0; octant < 8; octant++)
+    {
+        if (octants[octant].empty())
+        {
+            continue;
+        }
+        glm::vec3 childMin = boundsMin
+            + glm::vec3(octant & 1 ? half : 0.0f, octant & 2 ? half : 0.0f, octant & 4 ? half : 0.0f);
+        int32_t child = buildNode(octants[octant], childMin, half, level + 1, index, options);
+        nodeTable[index].children[octant] = child; // nodeTable may have grown, no reference kept across the call
+    }
+    return index;
+}
+
+/*
+Header, node table, then the points of every node one node after the other. Native byte order, the file is meant to
+be read back on the machine (or kind of machine) that wrote it.
+*/
+bool PointOctree::save(const std::string& path) const
+{
+    assert(ready() && nodePoints.size() == totalPoints); // an opened octree has its points in its own file already
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        VD_LOG_ERROR("PointOctree: can not write %s", path.c_str());
+        return false;
+    }
+    FileHeader header{};
+    memcpy(header.magic, OCTREE_MAGIC, sizeof(OCTREE_MAGIC));
+    header.version = OCTREE_VERSION;
+    header.maxNodePoints = nodeCapacity;
+    header.nodeCount = nodeTable.size();
+    header.pointCount = totalPoints;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(nodeTable.data()), nodeTable.size() * sizeof(Node));
+    out.write(reinterpret_cast<const char*>(nodePoints.data()), nodePoints.size() * sizeof(Vertex));
+    return static_cast<bool>(out);
+}
+
+bool PointOctree::open(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(fileMutex);
+    isReady.store(false, std::memory_order_release);
+    nodeTable.clear();
+    nodePoints = std::vector<Vertex>();
+    file.close();
+    file.clear();
+    file.open(path, std::ios::binary | std::ios::ate);
+    uint64_t fileSize = file ? static_cast<uint64_t>(file.tellg()) : 0;
+    file.seekg(0);
+
+    FileHeader header{};
+    const char* reason = nullptr;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || memcmp(header.magic, OCTREE_MAGIC, sizeof(OCTREE_MAGIC)) != 0 || header.version != OCTREE_VERSION)
+    {
+        reason = "is not an octree file";
+    }
+    else
+    {
+        reason = checkHeader(header, fileSize);
+    }
+    if (!reason)
+    {
+        nodeTable.resize(header.nodeCount); // bounded by the file size now
+        reason = file.read(reinterpret_cast<char*>(nodeTable.data()), nodeTable.size() * sizeof(Node))
+            ? checkNodes(header)
+            : "is truncated";
+    }
+    if (reason)
+    {
+        VD_LOG_ERROR("PointOctree: %s %s", path.c_str(), reason);
+        nodeTable.clear();
+        file.close();
+        return false;
+    }
+    nodeCapacity = header.maxNodePoints;
+    totalPoints = header.pointCount;
+    pointsFileOffset = sizeof(FileHeader) + header.nodeCount * sizeof(Node);
+    isReady.store(true, std::memory_order_release);
+    return true;
+}
+
+const char* PointOctree::checkHeader(const FileHeader& header, uint64_t fileSize)
+{
+    if (header.maxNodePoints == 0)
+    {
+        return "has no room for points in its nodes";
+    }
+    /*compared by division, a huge count can not overflow*/
+    uint64_t available = fileSize - sizeof(FileHeader);
+    if (header.nodeCount > available / sizeof(Node)
+        || header.nodeCount > static_cast<uint64_t>(std::numeric_limits<int32_t>::max()))
+    {
+        return "has more nodes than fit in it";
+    }
+    if (header.pointCount > (available - header.nodeCount * sizeof(Node)) / sizeof(Vertex))
+    {
+        return "is truncated";
+    }
+    return nullptr;
+}
+
+const char* PointOctree::checkNodes(const FileHeader& header) const
+{
+    uint64_t pointSum = 0;
+    for (size_t i = 0; i < nodeTable.size(); i++)
+    {
+        const Node& node = nodeTable[i];
+        if (node.pointCount > header.maxNodePoints)
+        {
+            return "has a node larger than its streaming slots";
+        }
+        if (node.pointOffset > header.pointCount || node.pointCount > header.pointCount - node.pointOffset)
+        {
+            return "has a node past the end of its points";
+        }
+        pointSum += node.pointCount;
+        /*nodes are stored depth first : the root first, a parent always in front of its children, no cycle possible*/
+        bool parentValid = i == 0 ? node.parent == NO_NODE : node.parent >= 0 && static_cast<size_t>(node.parent) < i;
+        if (!parentValid)
+        {
+            return "has a broken hierarchy";
+        }
+        for (int32_t child : node.children)
+        {
+            if (child != NO_NODE
+                && (child < 0 || static_cast<size_t>(child) <= i || static_cast<size_t>(child) >= nodeTable.size()
+                    || nodeTable[child].parent != static_cast<int32_t>(i)))
+            {
+                return "has a broken hierarchy";
+            }
+        }
+    }
+    if (pointSum != header.pointCount)
+    {
+        return "does not hold pointCount points in its nodes";
+    }
+    return nullptr;
+}
+
+bool PointOctree::readNode(uint32_t node, std::vector<Vertex>& out) const
+{
+    if (node >= nodeTable.size())
+    {
+        return false;
+    }
+    const Node& info = nodeTable[node];
+    out.resize(info.pointCount);
+    if (info.pointCount == 0)
+    {
+        return true;
+    }
+    if (!nodePoints.empty())
+    {
+        std::copy_n(nodePoints.begin() + info.pointOffset, info.pointCount, out.begin());
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(fileMutex);
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(pointsFileOffset + info.pointOffset * sizeof(Vertex)));
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(out.data()), out.size() * sizeof(Vertex)));
+}
@@ -0,0 +1,310 @@
+#include "SceneCache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef VD_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include "DrawList.h"
+#include "Logger.h"
+#include "ThreadPool.h"
+#include "VertexPacking.h"
+
+static const char SCENE_MAGIC[8] = {'V', 'D', 'S', 'C', 'E', 'N', 'E', '\0'};
+
+/*zeros up to the next section boundary*/
+static void padTo(std::ofstream& out, uint64_t alignment)
+{
+    static const char zeros[SceneCache::SECTION_ALIGNMENT] = {};
+    uint64_t position = static_cast<uint64_t>(out.tellp());
+    uint64_t padding = (alignment - position % alignment) % alignment;
+    out.write(zeros, static_cast<std::streamsize>(padding));
+}
+
+bool SceneCache::write(const std::string& path, const std::vector<Vertex>& vertices,
+    const std::vector<uint32_t>& indices, VkPrimitiveTopology topology, VertexFormat format, uint32_t chunkIndices,
+    SceneCompression compression)
+{
+#ifndef VD_HAVE_LZ4
+    if (compression == SceneCompression::LZ4)
+    {
+        VD_LOG_WARN("SceneCache: built without LZ4, %s is written uncompressed", path.c_str());
+        compression = SceneCompression::None;
+    }
+#endif
+
+    /*the payloads exactly as the GPU reads them*/
+    const void* vertexData = vertices.data();
+    std::vector<ColorVertex> colorVertices;
+    std::vector<PackedVertex> packedVertices;
+    std::vector<PackedChunk> packedChunks;
+    if (format == VertexFormat::ColorUnorm8)
+    {
+        colorVertices.resize(vertices.size());
+        packVertices(vertices.data(), vertices.size(), colorVertices.data());
+        vertexData = colorVertices.data();
+    }
+    else if (format == VertexFormat::Packed16)
+    {
+        packedVertices.resize(vertices.size());
+        packedChunks.resize(std::max<size_t>(packedChunkCount(vertices.size()), 1)); // a storage buffer is never empty
+        packVertices(vertices.data(), vertices.size(), packedVertices.data(), packedChunks.data());
+        vertexData = packedVertices.data();
+    }
+
+    std::vector<ChunkCuller::Chunk> chunks;
+    for (const DrawChunk& draw : splitDrawList(static_cast<uint32_t>(indices.size()), topology, chunkIndices))
+    {
+        ChunkCuller::Chunk chunk{};
+        chunk.firstIndex = draw.firstIndex;
+        chunk.indexCount = draw.indexCount;
+        chunks.push_back(chunk);
+    }
+    ChunkCuller::computeBounds(chunks, vertices, indices);
+
+    const void* sectionData[SECTION_COUNT] = {vertexData, packedChunks.data(), indices.data(), chunks.data()};
+    uint64_t sectionBytes[SECTION_COUNT] = {vertexStride(format) * vertices.size(),
+        sizeof(PackedChunk) * packedChunks.size(), sizeof(uint32_t) * indices.size(),
+        sizeof(ChunkCuller::Chunk) * chunks.size()};
+
+    FileHeader header{};
+    memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+    header.version = VERSION;
+    header.vertexFormat = static_cast<uint32_t>(format);
+    header.topology = static_cast<uint32_t>(topology);
+    header.vertexStride = static_cast<uint32_t>(vertexStride(format));
+    header.vertexCount = vertices.size();
+    header.indexCount = indices.size();
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        VD_LOG_ERROR("SceneCache: can not write %s", path.c_str());
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header)); // rewritten once the sections are placed
+    for (int section = 0; section < SECTION_COUNT; section++)
+    {
+        padTo(out, SECTION_ALIGNMENT);
+        SectionEntry& entry = header.sections[section];
+        entry.offset = static_cast<uint64_t>(out.tellp());
+        entry.rawSize = sectionBytes[section];
+        const char* data = static_cast<const char*>(sectionData[section]);
+        bool compress = compression == SceneCompression::LZ4 && section != DrawChunks && entry.rawSize > 0;
+        if (!compress)
+        {
+            out.write(data, static_cast<std::streamsize>(entry.rawSize));
+            entry.storedSize = entry.rawSize;
+            continue;
+        }
+#ifdef VD_HAVE_LZ4
+        /*blocks are independent, compressed in parallel*/
+        entry.blockCount = (entry.rawSize + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        std::vector<std::vector<char>> blocks(entry.blockCount);
+        ThreadPool::global().parallelFor(0, blocks.size(), 1, [&](size_t blockBegin, size_t blockEnd) {
+            for (size_t b = blockBegin; b < blockEnd; b++)
+            {
+                int rawSize = static_cast<int>(std::min<uint64_t>(BLOCK_SIZE, entry.rawSize - b * BLOCK_SIZE));
+                blocks[b].resize(LZ4_compressBound(rawSize));
+                int storedSize = LZ4_compress_default(data + b * BLOCK_SIZE, blocks[b].data(), rawSize,
+                    static_cast<int>(blocks[b].size()));
+                blocks[b].resize(storedSize);
+            }
+        });
+        std::vector<BlockEntry> table(blocks.size());
+        uint64_t blockOffset = table.size() * sizeof(BlockEntry);
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            table[b].offset = blockOffset;
+            table[b].storedSize = static_cast<uint32_t>(blocks[b].size());
+            table[b].rawSize = static_cast<uint32_t>(std::min<uint64_t>(BLOCK_SIZE, entry.rawSize - b * BLOCK_SIZE));
+            blockOffset += blocks[b].size();
+        }
+        out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(BlockEntry));
+        for (const std::vector<char>& block : blocks)
+        {
+            out.write(block.data(), block.size());
+        }
+        entry.storedSize = blockOffset;
+#endif
+    }
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return static_cast<bool>(out);
+}
+
+bool SceneCache::open(const std::string& path)
+{
+    chunkTable.clear();
+    if (!file.open(path))
+    {
+        return false;
+    }
+    if (file.size() < sizeof(FileHeader))
+    {
+        VD_LOG_ERROR("SceneCache: %s is not a scene cache", path.c_str());
+        file.close();
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    const char* reason = nullptr;
+    if (memcmp(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0)
+    {
+        reason = "is not a scene cache";
+    }
+    else if (header.version != VERSION
+        || header.vertexFormat > static_cast<uint32_t>(VertexFormat::Packed16)
+        || header.vertexStride != vertexStride(vertexFormat()))
+    {
+        reason = "was written by another version, convert the scene again";
+    }
+    if (!reason)
+    {
+        reason = checkLayout();
+    }
+    if (reason)
+    {
+        VD_LOG_ERROR("SceneCache: %s %s", path.c_str(), reason);
+        file.close();
+        return false;
+    }
+
+    const SectionEntry& drawChunks = header.sections[DrawChunks];
+    chunkTable.resize(drawChunks.rawSize / sizeof(ChunkCuller::Chunk));
+    memcpy(chunkTable.data(), file.data() + drawChunks.offset, chunkTable.size() * sizeof(ChunkCuller::Chunk));
+    /*a draw past the index buffer would have the GPU read outside of it*/
+    for (const ChunkCuller::Chunk& chunk : chunkTable)
+    {
+        if (static_cast<uint64_t>(chunk.firstIndex) + chunk.indexCount > header.indexCount)
+        {
+            VD_LOG_ERROR("SceneCache: %s has a draw past the end of its indices", path.c_str());
+            chunkTable.clear();
+            file.close();
+            return false;
+        }
+    }
+    file.adviseSequential();
+    return true;
+}
+
+const char* SceneCache::checkLayout() const
+{
+    if (header.topology > static_cast<uint32_t>(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN))
+    {
+        return "has an unknown topology";
+    }
+    /*the payload sizes follow from the counts, compared by division so a huge count can not overflow*/
+    uint64_t stride = header.vertexStride;
+    const SectionEntry* sections = header.sections;
+    if (sections[Vertices].rawSize % stride != 0 || sections[Vertices].rawSize / stride != header.vertexCount)
+    {
+        return "does not hold vertexCount vertices";
+    }
+    if (sections[Indices].rawSize % sizeof(uint32_t) != 0
+        || sections[Indices].rawSize / sizeof(uint32_t) != header.indexCount)
+    {
+        return "does not hold indexCount indices";
+    }
+    uint64_t packedChunks = vertexFormat() == VertexFormat::Packed16
+        ? std::max<uint64_t>(packedChunkCount(header.vertexCount), 1)
+        : 0;
+    if (sections[VertexChunks].rawSize % sizeof(PackedChunk) != 0
+        || sections[VertexChunks].rawSize / sizeof(PackedChunk) != packedChunks)
+    {
+        return "does not hold one PackedChunk per vertex chunk";
+    }
+    if (sections[DrawChunks].rawSize % sizeof(ChunkCuller::Chunk) != 0)
+    {
+        return "has a torn draw list";
+    }
+
+    for (int section = 0; section < SECTION_COUNT; section++)
+    {
+        const SectionEntry& entry = sections[section];
+        if (entry.offset % SECTION_ALIGNMENT != 0 || entry.offset > file.size()
+            || entry.storedSize > file.size() - entry.offset)
+        {
+            return "is truncated";
+        }
+        if (entry.blockCount == 0)
+        {
+            if (entry.storedSize != entry.rawSize)
+            {
+                return "has a raw section whose stored and raw sizes differ";
+            }
+            continue;
+        }
+#ifndef VD_HAVE_LZ4
+        return "is LZ4 compressed and this build has no LZ4";
+#else
+        if (section == DrawChunks)
+        {
+            return "has a compressed draw list"; // read in place by open()
+        }
+        /*the block table, then every block inside the section, together as long as the raw section*/
+        if (entry.blockCount > entry.storedSize / sizeof(BlockEntry))
+        {
+            return "has a block table past its section";
+        }
+        const BlockEntry* blocks = reinterpret_cast<const BlockEntry*>(file.data() + entry.offset);
+        uint64_t tableSize = entry.blockCount * sizeof(BlockEntry);
+        uint64_t rawTotal = 0;
+        for (uint64_t b = 0; b < entry.blockCount; b++)
+        {
+            const BlockEntry& block = blocks[b];
+            if (block.offset < tableSize || block.offset > entry.storedSize
+                || block.storedSize > entry.storedSize - block.offset)
+            {
+                return "has an LZ4 block outside of its section";
+            }
+            if (block.rawSize == 0 || block.rawSize > BLOCK_SIZE)
+            {
+                return "has an LZ4 block of an invalid size";
+            }
+            rawTotal += block.rawSize;
+        }
+        if (rawTotal != entry.rawSize)
+        {
+            return "has LZ4 blocks that do not add up to their section";
+        }
+#endif
+    }
+    return nullptr;
+}
+
+UploadTicket SceneCache::upload(Section section, UploadManager& uploads, VkBuffer dst) const
+{
+    const SectionEntry& entry = header.sections[section];
+    const uint8_t* base = file.data() + entry.offset;
+    if (entry.blockCount == 0)
+    {
+        return uploads.uploadBuffer(dst, 0, base, entry.rawSize); // page aligned, straight from the mapping
+    }
+#ifdef VD_HAVE_LZ4
+    const BlockEntry* blocks = reinterpret_cast<const BlockEntry*>(base);
+    UploadTicket ticket = 0;
+    VkDeviceSize dstOffset = 0;
+    for (uint64_t b = 0; b < entry.blockCount; b++)
+    {
+        const BlockEntry& block = blocks[b];
+        ticket = uploads.uploadBuffer(dst, dstOffset, block.rawSize, [&](void* staging) {
+            int size = LZ4_decompress_safe(reinterpret_cast<const char*>(base + block.offset),
+                static_cast<char*>(staging), static_cast<int>(block.storedSize), static_cast<int>(block.rawSize));
+            if (size != static_cast<int>(block.rawSize))
+            {
+                throw std::runtime_error("SceneCache: corrupted LZ4 block!");
+            }
+        });
+        dstOffset += block.rawSize;
+    }
+    return ticket;
+#else
+    assert(false); // open() refuses compressed files
+    return 0;
+#endif
+}
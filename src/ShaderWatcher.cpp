@@ -0,0 +1,146 @@
+#include "ShaderWatcher.h"
+#include "Logger.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifndef VD_GLSLC
+#define VD_GLSLC "glslc"
+#endif
+
+/*a save is a burst of events, wait this long after the last one before reporting*/
+static const int DEBOUNCE_MS = 100;
+
+#ifdef __linux__
+
+bool ShaderWatcher::start(const std::string& directory, Callback onChange)
+{
+    stop();
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0)
+    {
+        VD_LOG_ERROR("ShaderWatcher: inotify_init1 failed");
+        return false;
+    }
+    if (inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        VD_LOG_ERROR("ShaderWatcher: can not watch %s", directory.c_str());
+        close(inotifyFd);
+        inotifyFd = -1;
+        return false;
+    }
+    if (pipe(wakeFd) != 0)
+    {
+        close(inotifyFd);
+        inotifyFd = -1;
+        return false;
+    }
+    callback = std::move(onChange);
+    thread = std::thread(&ShaderWatcher::loop, this);
+    return true;
+}
+
+void ShaderWatcher::stop()
+{
+    if (thread.joinable())
+    {
+        char wake = 1;
+        (void)!write(wakeFd[1], &wake, 1);
+        thread.join();
+    }
+    for (int* fd : {&inotifyFd, &wakeFd[0], &wakeFd[1]})
+    {
+        if (*fd >= 0)
+        {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void ShaderWatcher::loop()
+{
+    alignas(inotify_event) char buffer[4096];
+    std::set<std::string> changed;
+    for (;;)
+    {
+        pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {wakeFd[0], POLLIN, 0}};
+        /*block until something happens, then only as long as the burst lasts*/
+        int ready = poll(fds, 2, changed.empty() ? -1 : DEBOUNCE_MS);
+        if (ready < 0 || (fds[1].revents & POLLIN))
+        {
+            return;
+        }
+        if (ready == 0)
+        {
+            for (const std::string& fileName : changed)
+            {
+                callback(fileName);
+            }
+            changed.clear();
+            continue;
+        }
+
+        ssize_t length;
+        while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* p = buffer; p < buffer + length;)
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                if (event->len > 0)
+                {
+                    changed.insert(event->name);
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+#else
+
+bool ShaderWatcher::start(const std::string& directory, Callback)
+{
+    VD_LOG_WARN("ShaderWatcher: watching %s is only supported on Linux", directory.c_str());
+    return false;
+}
+
+void ShaderWatcher::stop() {}
+
+void ShaderWatcher::loop() {}
+
+#endif
+
+std::vector<uint32_t> compileGlsl(const std::string& path)
+{
+    std::filesystem::path spirvPath = std::filesystem::temp_directory_path()
+        / (std::filesystem::path(path).filename().string() + ".hot.spv");
+    std::string command = std::string("\"") + VD_GLSLC + "\" --target-env=vulkan1.0 -O -o \"" + spirvPath.string()
+        + "\" \"" + path + "\"";
+    if (std::system(command.c_str()) != 0)
+    {
+        return {};
+    }
+
+    std::ifstream file(spirvPath, std::ios::binary | std::ios::ate);
+    std::vector<uint32_t> words;
+    if (file.is_open())
+    {
+        size_t size = static_cast<size_t>(file.tellg());
+        words.resize(size / sizeof(uint32_t));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(words.data()), words.size() * sizeof(uint32_t));
+    }
+    std::error_code ignored;
+    std::filesystem::remove(spirvPath, ignored);
+    return words;
+}
@@ -0,0 +1,447 @@
+#include "StreamingTexture.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "ThreadPool.h"
+
+/*rows converted per task*/
+static const size_t ROW_GRAIN = 16;
+
+/*BGR -> RGBA (alpha 255) of one row*/
+static void bgrToRgba(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+    size_t i = 0;
+#if defined(__AVX2__) || defined(__SSSE3__)
+    /*4 pixels : 12 bytes of a 16 byte load, spread to 16 bytes, the holes are the alpha*/
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+#endif
+#if defined(__AVX2__)
+    /*8 pixels, 4 in each 128-bit lane : the byte shuffle does not cross lanes. The second load reads up to 3i + 28*/
+    const __m256i shuffle8 = _mm256_broadcastsi128_si256(shuffle);
+    const __m256i alpha8 = _mm256_broadcastsi128_si256(alpha);
+    for (; i + 10 <= pixels; i += 8)
+    {
+        __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * i));
+        __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * i + 12));
+        __m256i bgr = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * i),
+            _mm256_or_si256(_mm256_shuffle_epi8(bgr, shuffle8), alpha8));
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSSE3__)
+    /*the load reads up to 3i + 16*/
+    for (; i + 6 <= pixels; i += 4)
+    {
+        __m128i bgr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i), _mm_or_si128(_mm_shuffle_epi8(bgr, shuffle), alpha));
+    }
+#endif
+    for (; i < pixels; i++)
+    {
+        dst[4 * i + 0] = src[3 * i + 2];
+        dst[4 * i + 1] = src[3 * i + 1];
+        dst[4 * i + 2] = src[3 * i + 0];
+        dst[4 * i + 3] = 255;
+    }
+}
+
+void StreamingTexture::setExtent(uint32_t width_, uint32_t height_)
+{
+    width = width_;
+    height = height_;
+}
+
+void StreamingTexture::init(VkPhysicalDevice physicalDevice, VkDevice device_, MemoryAllocator* allocator_,
+    uint32_t framesInFlight, VkDescriptorPool descriptorPool, VkRenderPass renderPass, VkShaderModule vertShader,
+    VkShaderModule fragShader, PipelineCache* pipelineCache)
+{
+    assert(width > 0 && height > 0); // setExtent() first
+    device = device_;
+    allocator = allocator_;
+
+    chooseFormat(physicalDevice);
+    createImage();
+
+    /*a region is a multiple of 256 texels : every region offset is a multiple of the texel size and of 4, as
+     * vkCmdCopyBufferToImage wants, and of optimalBufferCopyOffsetAlignment*/
+    VkDeviceSize texelAlignment = 256 * static_cast<VkDeviceSize>(texelSize);
+    regionSize = (static_cast<VkDeviceSize>(width) * height * texelSize + texelAlignment - 1) / texelAlignment
+        * texelAlignment;
+    allocator->createBuffer(regionSize * framesInFlight, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CpuOnly,
+        stagingBuffer, stagingMemory);
+    regionPending.assign(framesInFlight, false);
+
+    createDescriptor(descriptorPool);
+    createPipeline(renderPass, vertShader, fragShader, pipelineCache);
+}
+
+/*
+B8G8R8 needs no conversion and a quarter less staging, but its support is optional. R8G8B8A8_UNORM is always sampled,
+blitted and linearly filtered.
+*/
+void StreamingTexture::chooseFormat(VkPhysicalDevice physicalDevice)
+{
+    const VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT
+        | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_B8G8R8_UNORM, &properties);
+    if ((properties.optimalTilingFeatures & needed) == needed)
+    {
+        imageFormat = VK_FORMAT_B8G8R8_UNORM;
+        texelSize = 3;
+    }
+    else
+    {
+        imageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        texelSize = 4;
+    }
+    levels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+}
+
+void StreamingTexture::createImage()
+{
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = imageFormat;
+    imageInfo.extent = {width, height, 1};
+    imageInfo.mipLevels = levels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    /*level 0 is copied to, every level is blitted from (to the next one) and to (from the previous one)*/
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // graphics queue only
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    allocator->createImage(imageInfo, MemoryUsage::GpuOnly, image, imageMemory);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = imageFormat;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1};
+    if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the texture image view!");
+    }
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(levels);
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the texture sampler!");
+    }
+}
+
+void StreamingTexture::createDescriptor(VkDescriptorPool descriptorPool)
+{
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the texture descriptor set layout!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
+    if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate the texture descriptor set!");
+    }
+
+    /*the image is only sampled once recordUpload() left it in SHADER_READ_ONLY_OPTIMAL*/
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.sampler = sampler;
+    imageInfo.imageView = imageView;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = descriptorSet;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+}
+
+void StreamingTexture::createPipeline(
+    VkRenderPass renderPass, VkShaderModule vertShader, VkShaderModule fragShader, PipelineCache* pipelineCache)
+{
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the overlay pipeline layout!");
+    }
+
+    VkPipelineShaderStageCreateInfo stages[2] = {};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = vertShader;
+    stages[0].pName = "main";
+    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = fragShader;
+    stages[1].pName = "main";
+
+    /*the quad comes from gl_VertexIndex, no vertex buffer*/
+    VkPipelineVertexInputStateCreateInfo vertexInput{};
+    vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.lineWidth = 1.0f;
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkPipelineColorBlendAttachmentState blendAttachment{};
+    blendAttachment.colorWriteMask
+        = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &blendAttachment;
+    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = stages;
+    pipelineInfo.pVertexInputState = &vertexInput;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.subpass = 0;
+    auto start = std::chrono::steady_clock::now();
+    if (vkCreateGraphicsPipelines(device, pipelineCache->handle(), 1, &pipelineInfo, nullptr, &pipeline)
+        != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the overlay pipeline!");
+    }
+    pipelineCache->recordPipeline(
+        "overlay", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+void StreamingTexture::destroy()
+{
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr); // the set goes with the renderer's pool
+    vkDestroySampler(device, sampler, nullptr);
+    vkDestroyImageView(device, imageView, nullptr);
+    allocator->destroyImage(image, imageMemory);
+    allocator->destroyBuffer(stagingBuffer, stagingMemory);
+    pipeline = VK_NULL_HANDLE;
+    pipelineLayout = VK_NULL_HANDLE;
+    descriptorSetLayout = VK_NULL_HANDLE;
+    sampler = VK_NULL_HANDLE;
+    imageView = VK_NULL_HANDLE;
+    uploaded = false;
+}
+
+void StreamingTexture::submitImage(const cv::Mat& image_)
+{
+    assert(image_.type() == CV_8UC3);
+    assert(image_.cols == static_cast<int>(width) && image_.rows == static_cast<int>(height));
+    std::lock_guard<std::mutex> lock(imageMutex);
+    latestImage = image_;
+    latestGeneration++;
+}
+
+void StreamingTexture::prepareFrame(uint32_t slot)
+{
+    cv::Mat frame;
+    {
+        std::lock_guard<std::mutex> lock(imageMutex);
+        if (stagedGeneration == latestGeneration)
+        {
+            return; // the image already holds it, or an earlier frame slot uploads it
+        }
+        frame = latestImage;
+        stagedGeneration = latestGeneration;
+    }
+
+    /*the slot's previous upload is done (its fence signalled), its region can be overwritten*/
+    uint8_t* region = static_cast<uint8_t*>(stagingMemory.mapped) + slot * regionSize;
+    bool native = imageFormat == VK_FORMAT_B8G8R8_UNORM;
+    ThreadPool::global().parallelFor(0, height, ROW_GRAIN, [&](size_t rowBegin, size_t rowEnd) {
+        for (size_t row = rowBegin; row < rowEnd; row++)
+        {
+            const uint8_t* src = frame.ptr<uint8_t>(static_cast<int>(row));
+            uint8_t* dst = region + row * width * texelSize;
+            if (native)
+            {
+                memcpy(dst, src, static_cast<size_t>(width) * 3);
+            }
+            else
+            {
+                bgrToRgba(src, dst, width);
+            }
+        }
+    });
+    regionPending[slot] = true;
+}
+
+void StreamingTexture::recordUpload(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    if (!regionPending[slot])
+    {
+        return;
+    }
+    regionPending[slot] = false;
+
+    /*every level is rewritten, the previous content is dropped (UNDEFINED). The earlier frames only have to be done
+     * sampling it : an execution dependency on their fragment shaders*/
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+        nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy copyRegion{};
+    copyRegion.bufferOffset = slot * regionSize;
+    copyRegion.bufferRowLength = 0; // tightly packed
+    copyRegion.bufferImageHeight = 0;
+    copyRegion.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    copyRegion.imageOffset = {0, 0, 0};
+    copyRegion.imageExtent = {width, height, 1};
+    vkCmdCopyBufferToImage(
+        commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+    /*level i - 1 becomes a blit source once written, level i is half of it*/
+    int32_t levelWidth = static_cast<int32_t>(width);
+    int32_t levelHeight = static_cast<int32_t>(height);
+    barrier.subresourceRange.levelCount = 1;
+    for (uint32_t level = 1; level < levels; level++)
+    {
+        barrier.subresourceRange.baseMipLevel = level - 1;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+            nullptr, 0, nullptr, 1, &barrier);
+
+        int32_t nextWidth = std::max(levelWidth / 2, 1);
+        int32_t nextHeight = std::max(levelHeight / 2, 1);
+        VkImageBlit blit{};
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+        blit.srcOffsets[0] = {0, 0, 0};
+        blit.srcOffsets[1] = {levelWidth, levelHeight, 1};
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+        blit.dstOffsets[0] = {0, 0, 0};
+        blit.dstOffsets[1] = {nextWidth, nextHeight, 1};
+        vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+
+    /*to the fragment shader : the blit sources are in TRANSFER_SRC, the last level still in TRANSFER_DST*/
+    VkImageMemoryBarrier toShader[2] = {barrier, barrier};
+    toShader[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levels - 1, 0, 1};
+    toShader[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toShader[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    toShader[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toShader[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    toShader[1].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, levels - 1, 1, 0, 1};
+    toShader[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toShader[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    toShader[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toShader[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    bool hasMips = levels > 1;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+        nullptr, 0, nullptr, hasMips ? 2 : 1, hasMips ? toShader : toShader + 1);
+    uploaded = true;
+}
+
+void StreamingTexture::recordOverlay(VkCommandBuffer commandBuffer, VkExtent2D target)
+{
+    if (!uploaded)
+    {
+        return;
+    }
+    /*a quarter of the width, the aspect ratio of the image, never taller than the target*/
+    float overlayWidth = target.width / 4.0f;
+    float overlayHeight = overlayWidth * height / width;
+    if (overlayHeight > target.height)
+    {
+        overlayWidth *= target.height / overlayHeight;
+        overlayHeight = static_cast<float>(target.height);
+    }
+    VkViewport viewport = {};
+    viewport.x = target.width - overlayWidth;
+    viewport.y = 0.0f;
+    viewport.width = overlayWidth;
+    viewport.height = overlayHeight;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    VkRect2D scissor = {};
+    scissor.offset = {static_cast<int32_t>(viewport.x), 0};
+    scissor.extent = {target.width - static_cast<uint32_t>(viewport.x), static_cast<uint32_t>(overlayHeight)};
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    vkCmdBindDescriptorSets(
+        commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdDraw(commandBuffer, 4, 1, 0, 0);
+}
@@ -0,0 +1,173 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+
+TaskGraph::TaskId TaskGraph::add(
+    const std::string& name, std::function<void()> func, std::initializer_list<TaskId> dependencies, Affinity affinity)
+{
+    TaskId id = tasks.size();
+    Task task;
+    task.func = std::move(func);
+    task.affinity = affinity;
+    for (TaskId dependency : dependencies)
+    {
+        assert(dependency < id); // dependencies are added first, so the graph can not have cycles
+        tasks[dependency].dependents.push_back(id);
+        task.pendingDependencies++;
+    }
+    tasks.push_back(std::move(task));
+    TaskTiming timing;
+    timing.name = name;
+    taskTimings.push_back(timing);
+    return id;
+}
+
+void TaskGraph::run(ThreadPool& threadPool)
+{
+    start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    finished = 0;
+    failure = nullptr;
+    pool = &threadPool;
+    maxHelpers = threadPool.concurrency() - 1;
+    activeHelpers = 0;
+    for (TaskId id = 0; id < tasks.size(); id++)
+    {
+        if (tasks[id].pendingDependencies == 0)
+        {
+            (tasks[id].affinity == Affinity::MainThread ? readyMain : readyAny).push_back(id);
+        }
+    }
+
+    spawnHelpers(lock);
+    work(lock);
+    /*the helpers still hold this graph*/
+    condition.wait(lock, [this] { return activeHelpers == 0; });
+    lock.unlock();
+
+    wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (failure)
+    {
+        std::rethrow_exception(failure);
+    }
+}
+
+void TaskGraph::work(std::unique_lock<std::mutex>& lock)
+{
+    for (;;)
+    {
+        condition.wait(lock, [this] { return finished == tasks.size() || !readyAny.empty() || !readyMain.empty(); });
+        if (finished == tasks.size())
+        {
+            return;
+        }
+        std::deque<TaskId>& queue = !readyMain.empty() ? readyMain : readyAny;
+        TaskId id = queue.front();
+        queue.pop_front();
+
+        lock.unlock();
+        execute(id, true);
+        lock.lock();
+
+        complete(id);
+        spawnHelpers(lock);
+    }
+}
+
+void TaskGraph::help()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!readyAny.empty())
+    {
+        TaskId id = readyAny.front();
+        readyAny.pop_front();
+
+        lock.unlock();
+        execute(id, false);
+        lock.lock();
+
+        complete(id);
+        spawnHelpers(lock);
+    }
+    activeHelpers--;
+    condition.notify_all();
+}
+
+void TaskGraph::complete(TaskId id)
+{
+    finished++;
+    for (TaskId dependent : tasks[id].dependents)
+    {
+        if (--tasks[dependent].pendingDependencies == 0)
+        {
+            (tasks[dependent].affinity == Affinity::MainThread ? readyMain : readyAny).push_back(dependent);
+        }
+    }
+    condition.notify_all();
+}
+
+void TaskGraph::spawnHelpers(std::unique_lock<std::mutex>& lock)
+{
+    /*a helper that finds the queue already emptied by the others just returns*/
+    size_t count = std::min(readyAny.size(), maxHelpers - activeHelpers);
+    if (count == 0)
+    {
+        return;
+    }
+    activeHelpers += count;
+    lock.unlock();
+    for (size_t i = 0; i < count; i++)
+    {
+        pool->submit([this] { help(); });
+    }
+    lock.lock();
+}
+
+void TaskGraph::execute(TaskId id, bool mainThread)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (failure)
+        {
+            return; // a dependency may be half done, skip everything that is left
+        }
+    }
+    auto taskStart = std::chrono::steady_clock::now();
+    try
+    {
+        tasks[id].func();
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!failure)
+        {
+            failure = std::current_exception();
+        }
+    }
+    auto taskEnd = std::chrono::steady_clock::now();
+
+    TaskTiming& timing = taskTimings[id]; // only this thread touches it until run() returns
+    timing.startMs = std::chrono::duration<double, std::milli>(taskStart - start).count();
+    timing.durationMs = std::chrono::duration<double, std::milli>(taskEnd - taskStart).count();
+    timing.mainThread = mainThread;
+}
+
+void TaskGraph::printTimings(std::ostream& out, const char* title) const
+{
+    double sumMs = 0.0;
+    for (const TaskTiming& timing : taskTimings)
+    {
+        sumMs += timing.durationMs;
+    }
+    out << title << " : " << std::fixed << std::setprecision(3) << wallMs << " ms (" << sumMs
+        << " ms of work over " << taskTimings.size() << " steps)\n";
+    for (const TaskTiming& timing : taskTimings)
+    {
+        out << "  " << std::left << std::setw(24) << timing.name << std::right << " start " << std::setw(9)
+            << timing.startMs << "  took " << std::setw(9) << timing.durationMs << " ms"
+            << (timing.mainThread ? "  [main]" : "") << "\n";
+    }
+}
@@ -0,0 +1,126 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        size_t hardware = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        threadCount = hardware - 1;
+    }
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::global()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::workerLoop()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+            {
+                return; // stopping, and everything queued has run
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+    auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+    std::future<void> future = packaged->get_future();
+    if (workers.empty())
+    {
+        (*packaged)(); // no workers, run inline
+        return future;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.emplace_back([packaged] { (*packaged)(); });
+    }
+    condition.notify_one();
+    return future;
+}
+
+void ThreadPool::parallelFor(
+    size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& func)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+    size_t chunkCount = (end - begin + grain - 1) / grain;
+    if (chunkCount == 1 || workers.empty())
+    {
+        func(begin, end);
+        return;
+    }
+
+    /*chunks are claimed from a shared counter, so the caller and the workers balance the load themselves*/
+    struct Shared
+    {
+        std::atomic<size_t> nextChunk{0};
+        std::atomic<size_t> doneChunks{0};
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    auto shared = std::make_shared<Shared>();
+    auto work = [shared, begin, end, grain, chunkCount, &func] {
+        for (size_t chunk = shared->nextChunk++; chunk < chunkCount; chunk = shared->nextChunk++)
+        {
+            size_t chunkBegin = begin + chunk * grain;
+            func(chunkBegin, std::min(end, chunkBegin + grain));
+            if (++shared->doneChunks == chunkCount)
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                shared->done.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min(workers.size(), chunkCount - 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < helpers; i++)
+        {
+            tasks.emplace_back(work);
+        }
+    }
+    condition.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->done.wait(lock, [&shared, chunkCount] { return shared->doneChunks == chunkCount; });
+}
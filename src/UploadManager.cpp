@@ -0,0 +1,270 @@
+#include "UploadManager.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+// keeps every source offset texel and optimalBufferCopyOffset friendly
+static const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+void UploadManager::init(VkDevice device_, MemoryAllocator* allocator_, uint32_t transferFamily_,
+    VkQueue transferQueue_, uint32_t graphicsFamily_, VkDeviceSize stagingSize_)
+{
+    device = device_;
+    allocator = allocator_;
+    transferFamily = transferFamily_;
+    transferQueue = transferQueue_;
+    graphicsFamily = graphicsFamily_;
+    stagingSize = stagingSize_;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = transferFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the upload command pool!");
+    }
+
+    std::vector<VkCommandBuffer> commandBuffers(MAX_BATCHES);
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = MAX_BATCHES;
+    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate the upload command buffers!");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    freeBatches.resize(MAX_BATCHES);
+    for (uint32_t i = 0; i < MAX_BATCHES; i++)
+    {
+        freeBatches[i].commandBuffer = commandBuffers[i];
+        if (vkCreateFence(device, &fenceInfo, nullptr, &freeBatches[i].fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create an upload fence!");
+        }
+    }
+
+    allocator->createBuffer(
+        stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CpuOnly, stagingBuffer, stagingMemory);
+}
+
+void UploadManager::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    submitLocked();
+    while (!submitted.empty())
+    {
+        waitOldest();
+    }
+    for (auto& batch : freeBatches)
+    {
+        vkDestroyFence(device, batch.fence, nullptr);
+    }
+    freeBatches.clear();
+    vkDestroyCommandPool(device, commandPool, nullptr); // frees the command buffers too
+    commandPool = VK_NULL_HANDLE;
+    allocator->destroyBuffer(stagingBuffer, stagingMemory);
+}
+
+std::vector<uint32_t> UploadManager::sharingFamilies() const
+{
+    if (usesDedicatedQueue())
+    {
+        return {graphicsFamily, transferFamily};
+    }
+    return {graphicsFamily};
+}
+
+UploadTicket UploadManager::uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    UploadTicket ticket = completedTicket;
+
+    /*uploads bigger than the ring are split, at most half of the ring per piece so the pieces can pipeline*/
+    while (size > 0)
+    {
+        VkDeviceSize chunk = std::min(size, stagingSize / 2);
+        uint64_t position = reserveStaging(chunk);
+        Batch& batch = recordingBatch();
+
+        VkDeviceSize stagingOffset = position % stagingSize;
+        memcpy(static_cast<uint8_t*>(stagingMemory.mapped) + stagingOffset, src, chunk);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = stagingOffset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = chunk;
+        vkCmdCopyBuffer(batch.commandBuffer, stagingBuffer, dst, 1, &copyRegion);
+
+        batch.stagingEnd = stagingHead;
+        ticket = batch.ticket;
+        src += chunk;
+        dstOffset += chunk;
+        size -= chunk;
+    }
+    return ticket;
+}
+
+UploadTicket UploadManager::uploadBuffer(
+    VkBuffer dst, VkDeviceSize dstOffset, VkDeviceSize size, const std::function<void(void* staging)>& fill)
+{
+    assert(size > 0 && size <= stagingSize / 2);
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t position = reserveStaging(size);
+    Batch& batch = recordingBatch();
+
+    VkDeviceSize stagingOffset = position % stagingSize;
+    fill(static_cast<uint8_t*>(stagingMemory.mapped) + stagingOffset);
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = stagingOffset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(batch.commandBuffer, stagingBuffer, dst, 1, &copyRegion);
+
+    batch.stagingEnd = stagingHead;
+    return batch.ticket;
+}
+
+uint64_t UploadManager::reserveStaging(VkDeviceSize size)
+{
+    assert(size <= stagingSize);
+    for (;;)
+    {
+        retireCompleted();
+
+        uint64_t position = (stagingHead + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+        VkDeviceSize offset = position % stagingSize;
+        if (offset + size > stagingSize)
+        {
+            position += stagingSize - offset; // a copy never wraps, skip the end of the ring
+        }
+        if (position + size - stagingTail <= stagingSize)
+        {
+            stagingHead = position + size;
+            return position;
+        }
+
+        /*ring full : the recording batch holds part of it, submit it so it can be recycled, then wait*/
+        if (isRecording)
+        {
+            submitLocked();
+        }
+        else
+        {
+            assert(!submitted.empty());
+            waitOldest();
+        }
+    }
+}
+
+UploadManager::Batch& UploadManager::recordingBatch()
+{
+    if (isRecording)
+    {
+        return recording;
+    }
+    while (freeBatches.empty())
+    {
+        waitOldest();
+    }
+    recording = freeBatches.back();
+    freeBatches.pop_back();
+    recording.ticket = nextTicket;
+    recording.stagingEnd = stagingHead;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(recording.commandBuffer, &beginInfo); // implicitly resets the command buffer
+    isRecording = true;
+    return recording;
+}
+
+UploadTicket UploadManager::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return submitLocked();
+}
+
+UploadTicket UploadManager::submitLocked()
+{
+    if (!isRecording)
+    {
+        return nextTicket - 1;
+    }
+    vkEndCommandBuffer(recording.commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &recording.commandBuffer;
+    if (vkQueueSubmit(transferQueue, 1, &submitInfo, recording.fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to submit an upload batch!");
+    }
+
+    submitted.push_back(recording);
+    isRecording = false;
+    return nextTicket++;
+}
+
+/*Batches are retired in submission order only, so completedTicket covers every older ticket too*/
+void UploadManager::retireCompleted()
+{
+    while (!submitted.empty() && vkGetFenceStatus(device, submitted.front().fence) == VK_SUCCESS)
+    {
+        Batch batch = submitted.front();
+        submitted.pop_front();
+        vkResetFences(device, 1, &batch.fence);
+        completedTicket = batch.ticket;
+        stagingTail = batch.stagingEnd;
+        freeBatches.push_back(batch);
+    }
+}
+
+void UploadManager::waitOldest()
+{
+    vkWaitForFences(device, 1, &submitted.front().fence, VK_TRUE, UINT64_MAX);
+    retireCompleted();
+}
+
+bool UploadManager::isComplete(UploadTicket ticket)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ticket > completedTicket)
+    {
+        retireCompleted();
+    }
+    return ticket <= completedTicket;
+}
+
+void UploadManager::wait(UploadTicket ticket)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ticket <= completedTicket)
+    {
+        return;
+    }
+    if (isRecording && ticket >= recording.ticket)
+    {
+        submitLocked();
+    }
+    while (ticket > completedTicket && !submitted.empty())
+    {
+        waitOldest();
+    }
+}
+
+UploadTicket UploadManager::currentTicket()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return isRecording ? recording.ticket : nextTicket;
+}
@@ -0,0 +1,164 @@
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+static const float SNORM16_MAX = 32767.0f;
+
+static_assert(sizeof(ColorVertex) == 16, "ColorVertex must match its binding stride");
+static_assert(sizeof(PackedVertex) == 12, "PackedVertex must match its binding stride");
+static_assert(sizeof(PackedChunk) == 32, "PackedChunk must match the std430 layout of shader_packed.vert");
+
+/*
+All loads of a Vertex read 4 floats starting at position : position.xyz plus color.r, which always lies inside the same
+Vertex, so the last vertex of the array is never read past.
+*/
+#if defined(__SSE2__)
+inline __m128 loadPosition(const Vertex& vertex) { return _mm_loadu_ps(&vertex.position.x); }
+
+/*r, g, b, a=1 -> RGBA8, rounded and saturated*/
+inline void storeColor(const Vertex& vertex, uint8_t* out)
+{
+    __m128 color = _mm_mul_ps(
+        _mm_set_ps(1.0f, vertex.color.z, vertex.color.y, vertex.color.x), _mm_set1_ps(255.0f));
+    __m128i words = _mm_packs_epi32(_mm_cvtps_epi32(color), _mm_setzero_si128());
+    int packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, _mm_setzero_si128()));
+    std::memcpy(out, &packed, 4);
+}
+#else
+inline uint8_t toUnorm8(float value)
+{
+    return static_cast<uint8_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 255.0f));
+}
+
+inline void storeColor(const Vertex& vertex, uint8_t* out)
+{
+    out[0] = toUnorm8(vertex.color.x);
+    out[1] = toUnorm8(vertex.color.y);
+    out[2] = toUnorm8(vertex.color.z);
+    out[3] = 255;
+}
+#endif
+
+/*bounding box of [begin, end) as center (offset) and half extent (scale)*/
+PackedChunk chunkBounds(const Vertex* begin, const Vertex* end)
+{
+    glm::vec3 low(std::numeric_limits<float>::max());
+    glm::vec3 high(-std::numeric_limits<float>::max());
+#if defined(__SSE2__)
+    __m128 minimum = _mm_set1_ps(std::numeric_limits<float>::max());
+    __m128 maximum = _mm_set1_ps(-std::numeric_limits<float>::max());
+    for (const Vertex* vertex = begin; vertex != end; vertex++)
+    {
+        __m128 position = loadPosition(*vertex);
+        minimum = _mm_min_ps(minimum, position);
+        maximum = _mm_max_ps(maximum, position);
+    }
+    alignas(16) float lows[4], highs[4];
+    _mm_store_ps(lows, minimum);
+    _mm_store_ps(highs, maximum);
+    low = glm::vec3(lows[0], lows[1], lows[2]);
+    high = glm::vec3(highs[0], highs[1], highs[2]);
+#else
+    for (const Vertex* vertex = begin; vertex != end; vertex++)
+    {
+        low = glm::min(low, vertex->position);
+        high = glm::max(high, vertex->position);
+    }
+#endif
+    PackedChunk chunk;
+    chunk.offset = glm::vec4((low + high) * 0.5f, 0.0f);
+    chunk.scale = glm::vec4((high - low) * 0.5f, 0.0f);
+    return chunk;
+}
+
+void packChunk(const Vertex* begin, const Vertex* end, const PackedChunk& chunk, PackedVertex* out)
+{
+    /*a flat axis (scale 0) quantizes to 0, the shader gets the offset back*/
+    glm::vec3 inverse;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        inverse[axis] = chunk.scale[axis] > 0.0f ? SNORM16_MAX / chunk.scale[axis] : 0.0f;
+    }
+#if defined(__SSE2__)
+    /*w lane : (color.r - 0) * 0 = 0*/
+    __m128 offset = _mm_set_ps(0.0f, chunk.offset.z, chunk.offset.y, chunk.offset.x);
+    __m128 factor = _mm_set_ps(0.0f, inverse.z, inverse.y, inverse.x);
+    for (const Vertex* vertex = begin; vertex != end; vertex++, out++)
+    {
+        __m128i quantized = _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(loadPosition(*vertex), offset), factor));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out->position), _mm_packs_epi32(quantized, quantized));
+        storeColor(*vertex, out->color);
+    }
+#else
+    for (const Vertex* vertex = begin; vertex != end; vertex++, out++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float value = (vertex->position[axis] - chunk.offset[axis]) * inverse[axis];
+            value = std::min(std::max(value, -SNORM16_MAX), SNORM16_MAX);
+            out->position[axis] = static_cast<int16_t>(std::lround(value));
+        }
+        out->position[3] = 0;
+        storeColor(*vertex, out->color);
+    }
+#endif
+}
+
+} // namespace
+
+void packVertices(const Vertex* vertices, size_t count, ColorVertex* out, ThreadPool& pool)
+{
+    pool.parallelFor(0, count, PACK_CHUNK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            out[i].position = vertices[i].position;
+            storeColor(vertices[i], out[i].color);
+        }
+    });
+}
+
+void packVertices(const Vertex* vertices, size_t count, PackedVertex* out, PackedChunk* chunks, ThreadPool& pool)
+{
+    pool.parallelFor(0, packedChunkCount(count), 1, [&](size_t chunkBegin, size_t chunkEnd) {
+        for (size_t chunk = chunkBegin; chunk < chunkEnd; chunk++)
+        {
+            size_t begin = chunk * PACK_CHUNK_SIZE;
+            size_t end = std::min(count, begin + PACK_CHUNK_SIZE);
+            chunks[chunk] = chunkBounds(vertices + begin, vertices + end);
+            packChunk(vertices + begin, vertices + end, chunks[chunk], out + begin);
+        }
+    });
+}
+
+size_t vertexStride(VertexFormat format)
+{
+    switch (format)
+    {
+    case VertexFormat::Float32: return sizeof(Vertex);
+    case VertexFormat::ColorUnorm8: return sizeof(ColorVertex);
+    case VertexFormat::Packed16: return sizeof(PackedVertex);
+    }
+    throw std::runtime_error("unknown vertex format!");
+}
+
+glm::vec3 unpackPosition(const PackedVertex& vertex, const PackedChunk& chunk)
+{
+    glm::vec3 position;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float snorm = std::max(vertex.position[axis] / SNORM16_MAX, -1.0f);
+        position[axis] = chunk.offset[axis] + snorm * chunk.scale[axis];
+    }
+    return position;
+}
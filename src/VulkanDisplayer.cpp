@@ -1,11 +1,15 @@
 #include "VulkanDisplayer.h"
+#include "Shaders.h"
+#include "TaskGraph.h"
+#include "ThreadPool.h"
 
 #include <cstdint>
 #include <vulkan/vulkan.h>
 #include <string.h>
 #include <vulkan/vulkan_core.h>
 #include <set>
-#include <fstream>
+#include <algorithm>
+#include <chrono>
 #include <glm/gtc/type_ptr.hpp>
 
 /*Initializing GLFW window passes*/
@@ -33,6 +37,41 @@ const std::vector<const char*> validationLayers = {
 const std::vector<const char*> deviceExtensions
     = {VK_KHR_SWAPCHAIN_EXTENSION_NAME}; // The device extensions we will be using. It is the one provided by the Vulkan
                                          // SDK
+/*Low latency pacing gives up on a present wait after this long (nothing is presented while the window is hidden)*/
+static const uint64_t PRESENT_WAIT_TIMEOUT_NS = 100000000;
+
+static bool hasInstanceExtension(const char* name)
+{
+    uint32_t extensionCount;
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+    for (const auto& extension : availableExtensions)
+    {
+        if (strcmp(extension.extensionName, name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool hasDeviceExtension(VkPhysicalDevice physicalDevice, const char* name)
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+    for (const auto& extension : availableExtensions)
+    {
+        if (strcmp(extension.extensionName, name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 const char* toStringMessageSeverity(VkDebugUtilsMessageSeverityFlagBitsEXT s)
 {
     switch (s)
@@ -71,28 +110,85 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityF
 {
     auto ms = toStringMessageSeverity(messageSeverity);
     auto mt = toStringMessageType(messageType);
-    printf("[%s: %s]\n%s\n", ms, mt, pCallbackData->pMessage);
+    /*from the driver's threads as well, the logger keeps them off the console until its own thread writes*/
+    switch (messageSeverity)
+    {
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
+        VD_LOG_ERROR("[%s: %s] %s", ms, mt, pCallbackData->pMessage);
+        break;
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
+        VD_LOG_WARN("[%s: %s] %s", ms, mt, pCallbackData->pMessage);
+        break;
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
+        VD_LOG_INFO("[%s: %s] %s", ms, mt, pCallbackData->pMessage);
+        break;
+    default: VD_LOG_DEBUG("[%s: %s] %s", ms, mt, pCallbackData->pMessage); break;
+    }
 
     return VK_FALSE;
 }
 void VulkanDisplayer::run()
 {
-    initWindow();
+    /*There is no window at all in headless mode, glfw is not even initialized*/
+    if (!isHeadless())
+    {
+        initWindow();
+    }
     initVulkan();
+    if (!shaderSourceDir.empty())
+    {
+        shaderWatcher.start(shaderSourceDir, [this](const std::string& fileName) { reloadShader(fileName); });
+    }
     main_loop();
     cleanup();
 }
 
+bool VulkanDisplayer::shouldStop()
+{
+    if (stopRequested)
+    {
+        return true;
+    }
+    if (frameLimit != 0 && frameCount >= frameLimit)
+    {
+        return true;
+    }
+    return !isHeadless() && glfwWindowShouldClose(window);
+}
+
 void VulkanDisplayer::main_loop()
 {
-    /*The function checks repeatedly at the start of the loop if glfw has been instructed to stop*/
-    while (!glfwWindowShouldClose(window))
+    auto startTime = std::chrono::steady_clock::now();
+    /*The function checks repeatedly at the start of the loop if glfw has been instructed to stop, or the frame limit
+     * has been reached, or requestStop() has been called*/
+    while (!shouldStop())
     {
+        if (lowLatencyEnabled)
+        {
+            waitForPreviousFrame(); // right before the inputs are read, not after
+        }
+        latency.sampled(frameCount + 1);
+
         /*Checks continously for any changes that have been made and submits them immmedietely*/
-        glfwPollEvents();
+        if (!isHeadless())
+        {
+            glfwPollEvents();
+        }
 
         // processKeyboardInput(window, ubo, cameraForwardVector, cameraUpVector);
 
+        /*the decoder thread produced the frames, only the newest one is copied here*/
+        IngestedFrame ingested;
+        if (frameIngest && frameIngest->takeLatest(ingested))
+        {
+            submitDepthFrame(ingested.depth.ptr<uint16_t>(), ingested.color.ptr<uint8_t>(),
+                static_cast<uint32_t>(ingested.color.channels()), ingestIntrinsics);
+            if (colorOverlayEnabled)
+            {
+                submitColorImage(ingested.color); // a new cv::Mat every frame, referenced until uploaded
+            }
+        }
+
         /*Displays the triangle to the screen*/
         render();
         // std::cout << "Rendering : " << currentFrame << std::endl;
@@ -101,17 +197,183 @@ void VulkanDisplayer::main_loop()
 
     /*This functions ensures all resources have been successfuly deallocated before continuing*/
     vkDeviceWaitIdle(device);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    if (isHeadless() && seconds > 0.0)
+    {
+        Logger::global().flush();
+        std::cout << "Rendered " << frameCount << " frames in " << seconds << " s (" << frameCount / seconds
+                  << " fps)" << std::endl;
+    }
+}
+
+/*
+Low latency pacing, before main_loop() samples the inputs of a frame. Instead of recording up to framesInFlight frames
+ahead, queued behind the swapchain images, the render thread waits until the previous frame is on screen
+(VK_KHR_present_wait) or, without it, until the GPU finished it. The window events, the ingested frame and the uniforms
+of the next frame are read as late as they can be, and the frame still has a whole refresh to be recorded and drawn.
+*/
+void VulkanDisplayer::waitForPreviousFrame()
+{
+    if (frameCount == 0)
+    {
+        return;
+    }
+    if (presentWaitEnabled && lastPresentId == frameCount && lastPresentSwapChain == swapChain)
+    {
+        if (waitForPresent(device, swapChain, lastPresentId, PRESENT_WAIT_TIMEOUT_NS) == VK_SUCCESS)
+        {
+            latency.completed(lastPresentId);
+            return;
+        }
+        /*timed out or out of date, the fence is enough to pace*/
+    }
+    int previous = (currentFrame + static_cast<int>(framesInFlight) - 1) % static_cast<int>(framesInFlight);
+    vkWaitForFences(device, 1, &inFlightFences[previous], VK_TRUE, UINT64_MAX);
+    if (!presentWaitEnabled)
+    {
+        latency.completed(slotSubmittedFrames[previous]);
+    }
+}
+
+void VulkanDisplayer::setFramesInFlight(uint32_t frames)
+{
+    assert(frames >= 1 && frames <= MAX_FRAMES_IN_FLIGHT);
+    framesInFlight = frames;
 }
 
+void VulkanDisplayer::updateVertices(uint32_t first, const Vertex* data, uint32_t count)
+{
+    assert(geometryUsage == GeometryUsage::Dynamic); // static geometry lives in device local memory only
+    assert(static_cast<uint64_t>(first) + count <= vertices.size());
+    std::lock_guard<std::mutex> lock(vertexMutex);
+    std::copy(data, data + count, vertices.begin() + first);
+    for (auto& dirty : vertexDirtyRanges)
+    {
+        dirty.add(first, static_cast<uint64_t>(first) + count);
+    }
+}
+
+/*Called once the fence of currentFrame signalled : its buffer is not read anymore, patch the ranges it missed*/
 void VulkanDisplayer::updateVertexBuffer(uint32_t currentFrame)
 {
-    // NOT IMPLEMENTED
+    if (depthProjectionEnabled)
+    {
+        depthProjector.prepareFrame(currentFrame); // raw depth + color only, the GPU makes the vertices
+        return;
+    }
+    if (octreeEnabled)
+    {
+        /*frameMvp is this frame's, slots last drawn by a completed frame can take new nodes*/
+        octreeStreamer.update(frameMvp, (float) swapChainExtent.height, frameCount + 1, completedFrames);
+        return;
+    }
+    if (geometryUsage != GeometryUsage::Dynamic)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(vertexMutex);
+    uint8_t* mapped = static_cast<uint8_t*>(streamingVertexMemory[currentFrame].mapped);
+    for (const Range& range : vertexDirtyRanges[currentFrame].take())
+    {
+        memcpy(mapped + range.begin * sizeof(Vertex), vertices.data() + range.begin,
+            (range.end - range.begin) * sizeof(Vertex));
+    }
+}
+
+void VulkanDisplayer::enableDepthProjection(uint32_t width, uint32_t height)
+{
+    assert(!is_initialized);
+    depthProjectionEnabled = true;
+    depthProjector.setExtent(width, height);
+    topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    /*non indexed draw : point i is vertex i, the number of points drawn comes from the indirect command*/
+    vertices.clear();
+    indices.clear();
 }
-void VulkanDisplayer::updateUniformBuffer(uint32_t currentFrame)
+
+void VulkanDisplayer::setPointCloudFile(std::shared_ptr<const PointCloudFile> file)
 {
-    VkSurfaceCapabilitiesKHR capabilities{};
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities);
+    assert(!is_initialized && file);
+    assert(file->pointCount() <= UINT32_MAX); // draw parameters are 32-bit
+    pointFile = std::move(file);
+    topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    vertices.clear();
+    indices.clear();
+}
+
+void VulkanDisplayer::setSceneCache(std::shared_ptr<const SceneCache> cache)
+{
+    assert(!is_initialized && cache && geometryUsage == GeometryUsage::Static);
+    sceneCache = std::move(cache);
+    vertexFormat = sceneCache->vertexFormat();
+    topology = sceneCache->topology();
+    vertices.clear();
+    indices.clear();
+}
+
+void VulkanDisplayer::enableOctree(std::shared_ptr<const PointOctree> octree_, uint64_t pointBudget)
+{
+    assert(!is_initialized && octree_);
+    octreeEnabled = true;
+    octree = std::move(octree_);
+    octreePointBudget = pointBudget;
+    topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    /*one non indexed draw per node, straight from the slots of the streaming buffer*/
+    vertices.clear();
+    indices.clear();
+}
+
+void VulkanDisplayer::enableColorOverlay(uint32_t width, uint32_t height)
+{
+    assert(!is_initialized);
+    colorOverlayEnabled = true;
+    colorTexture.setExtent(width, height);
+}
 
+void VulkanDisplayer::submitColorImage(const cv::Mat& image)
+{
+    colorTexture.submitImage(image);
+}
+
+void VulkanDisplayer::setFrameIngest(std::shared_ptr<FrameIngest> ingest, const CameraIntrinsics& intrinsics)
+{
+    assert(!is_initialized && depthProjectionEnabled && ingest);
+    assert(ingest->width() * ingest->height() == depthProjector.pixelCount());
+    frameIngest = std::move(ingest);
+    ingestIntrinsics = intrinsics;
+}
+
+void VulkanDisplayer::submitDepthFrame(
+    const uint16_t* depth, const uint8_t* color, uint32_t colorChannels, const CameraIntrinsics& intrinsics)
+{
+    depthProjector.submitFrame(depth, color, colorChannels, intrinsics);
+}
+
+VkBuffer VulkanDisplayer::frameVertexBuffer(uint32_t frame) const
+{
+    if (depthProjectionEnabled)
+    {
+        return depthProjector.vertexBuffer(frame);
+    }
+    if (octreeEnabled)
+    {
+        return octreeStreamer.vertexBuffer();
+    }
+    return geometryUsage == GeometryUsage::Dynamic ? streamingVertexBuffers[frame] : vertexBuffer;
+}
+
+VertexFormat VulkanDisplayer::activeVertexFormat() const
+{
+    /*the streaming buffers, the compute shader and the octree nodes hold Vertex as is*/
+    if (depthProjectionEnabled || octreeEnabled || geometryUsage == GeometryUsage::Dynamic)
+    {
+        return VertexFormat::Float32;
+    }
+    return vertexFormat;
+}
+void VulkanDisplayer::updateUniformBuffer(uint32_t currentFrame)
+{
     UniformObject ubo{};
     float ratio = (float) swapChainExtent.width / (float) swapChainExtent.height;
     // getPrerotationMatrix(capabilities, pretransformFlag, ubo.mvp, ratio);
@@ -125,35 +387,124 @@ void VulkanDisplayer::updateUniformBuffer(uint32_t currentFrame)
     static float currentAngleDegrees = 0.0f;
     currentAngleDegrees += 1.0f;
     ubo.mvp = glm::rotate(ubo.mvp, glm::radians(currentAngleDegrees), glm::vec3(0.0f, 0.0f, 1.0f));
-    void* data;
-    vkMapMemory(device, uniformBufferMemory[currentFrame], 0, sizeof(ubo), 0, &data);
-    memcpy(data, glm::value_ptr(ubo.mvp), sizeof(glm::mat4));
-    vkUnmapMemory(device, uniformBufferMemory[currentFrame]);
-    std::cout << "Update Uniform Buffer : " << currentFrame << std::endl;
+    writeUniform(currentFrame, 0, ubo);
+    frameMvp = ubo.mvp;
+}
+
+/*Byte offset of a uniform slot inside the ring, this is the dynamic offset passed to vkCmdBindDescriptorSets*/
+uint32_t VulkanDisplayer::uniformOffset(uint32_t frame, uint32_t slot) const
+{
+    assert(frame < MAX_FRAMES_IN_FLIGHT && slot < UNIFORM_SLOTS_PER_FRAME);
+    return static_cast<uint32_t>((frame * UNIFORM_SLOTS_PER_FRAME + slot) * uniformSlotStride);
+}
+
+/*The memory is host coherent and stays mapped, a plain memcpy is all it takes*/
+uint32_t VulkanDisplayer::writeUniform(uint32_t frame, uint32_t slot, const UniformObject& data)
+{
+    uint32_t offset = uniformOffset(frame, slot);
+    memcpy(uniformBufferMapped + offset, &data, sizeof(UniformObject));
+    return offset;
 }
 
+/*
+The steps form a dependency graph (TaskGraph) : what only needs the device runs on the worker threads while the main
+thread goes on with the swapchain, and the CPU side of the vertex data is prepared before the device even exists.
+GLFW calls (instance extensions, surface, framebuffer size) stay on the main thread. The time of every step is printed
+once the graph finished.
+*/
 void VulkanDisplayer::initVulkan()
 {
-    createInstance();
-    setupDebugCallback();
-    createSurface();
-    pickPhysicalDevice();
-    createLogicalDevice();
+    typedef TaskGraph::Affinity Affinity;
+    TaskGraph startup;
+    QueueFamilyIndices queueFamilies;
+
+    auto instanceStep = startup.add("createInstance", [this] { createInstance(); }, {}, Affinity::MainThread);
+    auto debugStep = startup.add("setupDebugCallback", [this] { setupDebugCallback(); }, {instanceStep});
+    auto surfaceStep = startup.add(
+        "createSurface",
+        [this] {
+            if (!isHeadless())
+            {
+                createSurface();
+            }
+        },
+        {instanceStep}, Affinity::MainThread);
+    auto physicalDeviceStep
+        = startup.add("pickPhysicalDevice", [this] { pickPhysicalDevice(); }, {debugStep, surfaceStep});
+    auto deviceStep = startup.add(
+        "createLogicalDevice",
+        [this, &queueFamilies] {
+            createLogicalDevice();
+            queueFamilies = findQueueFamilies(physicalDevice);
+        },
+        {physicalDeviceStep});
+
+    auto allocatorStep = startup.add("allocator", [this] { allocator.init(physicalDevice, device); }, {deviceStep});
+    auto cacheStep = startup.add(
+        "pipelineCache", [this] { pipelineCache.init(device, physicalDevice, pipelineCachePath); }, {deviceStep});
+    auto uploadsStep = startup.add(
+        "uploads",
+        [this, &queueFamilies] {
+            uploads.init(device, &allocator, queueFamilies.transferFamily.value(), transferQueue,
+                queueFamilies.graphicsFamily.value());
+        },
+        {allocatorStep});
+    startup.add(
+        "profiler",
+        [this, &queueFamilies] {
+            profiler.init(physicalDevice, device, queueFamilies.graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT);
+        },
+        {deviceStep});
+
+    /*swapchain chain : the extent comes from the window, main thread*/
     // establishDisplaySizeIdentity();
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createDescriptorSetLayout();
-    createGraphicsPipeline();
-    createFramebuffers();
-    createCommandPool();
-    createVertexBuffer();
-    createIndexBuffer();
-    createUniformBuffer();
-    createDescriptorPool();
-    createDescriptorSets();
-    createCommandBuffers();
-    createSemaphores();
+    auto swapchainStep = startup.add(
+        "createSwapChain",
+        [this] {
+            if (isHeadless())
+            {
+                createOffscreenTargets();
+            }
+            else
+            {
+                createSwapChain();
+            }
+        },
+        {allocatorStep}, Affinity::MainThread);
+    auto viewsStep = startup.add("createImageViews", [this] { createImageViews(); }, {swapchainStep});
+    auto renderPassStep = startup.add("createRenderPass", [this] { createRenderPass(); }, {swapchainStep});
+    startup.add("createFramebuffers", [this] { createFramebuffers(); }, {viewsStep, renderPassStep});
+
+    /*pipelines : shader modules + compilation, the slowest steps on a cold cache*/
+    auto setLayoutStep
+        = startup.add("createDescriptorSetLayout", [this] { createDescriptorSetLayout(); }, {deviceStep});
+    startup.add("createGraphicsPipeline", [this] { createGraphicsPipeline(); },
+        {renderPassStep, setLayoutStep, cacheStep});
+    startup.add("createComputePipeline", [this] { createComputePipeline(); }, {allocatorStep, cacheStep});
+    auto drawListStep = startup.add("buildDrawList", [this] { buildDrawList(); });
+    startup.add("createCullingPipeline", [this] { createCullingPipeline(); }, {allocatorStep, cacheStep, drawListStep});
+
+    /*geometry : CPU preparation first, then the uploads, one after the other on the upload manager*/
+    auto prepareStep = startup.add("prepareVertexData", [this] { prepareVertexData(); });
+    auto vertexDataStep
+        = startup.add("createVertexBuffer", [this] { createVertexBuffer(); }, {uploadsStep, prepareStep});
+    startup.add("createIndexBuffer", [this] { createIndexBuffer(); }, {vertexDataStep});
+    auto uniformsStep = startup.add("createUniformBuffer", [this] { createUniformBuffer(); }, {allocatorStep});
+
+    auto poolStep = startup.add("createDescriptorPool", [this] { createDescriptorPool(); }, {deviceStep});
+    auto setsStep = startup.add("createDescriptorSets", [this] { createDescriptorSets(); },
+        {poolStep, setLayoutStep, uniformsStep, vertexDataStep});
+    /*allocates from descriptorPool too, a pool is used by one thread at a time*/
+    startup.add("createColorOverlay", [this] { createColorOverlay(); },
+        {allocatorStep, cacheStep, renderPassStep, setsStep});
+    auto commandPoolStep = startup.add("createCommandPool", [this] { createCommandPool(); }, {deviceStep});
+    startup.add("createCommandBuffers", [this] { createCommandBuffers(); }, {commandPoolStep, drawListStep});
+    startup.add("createSemaphores", [this] { createSemaphores(); }, {deviceStep});
+
+    startup.run();
+    Logger::global().flush(); // the lines the startup steps logged come first
+    startup.printTimings(std::cout, "initVulkan()");
+    pipelineCache.printSummary(std::cout);
     is_initialized = true;
 }
 
@@ -163,23 +514,99 @@ void VulkanDisplayer::render()
     {
         return;
     }
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    {
+        FrameProfiler::ScopedTimer timer(profiler, FrameStage::FenceWait);
+        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    }
+    /*the last submission of this slot is done, and with it every earlier one : release what they were using*/
+    completedFrames = std::max(completedFrames, slotSubmittedFrames[currentFrame]);
+    if (!presentWaitEnabled)
+    {
+        latency.completed(slotSubmittedFrames[currentFrame]);
+    }
+    deletionQueue.collect(completedFrames);
+    /*the previous submission of this slot is done, its GPU timestamps can be read*/
+    profiler.beginFrame(currentFrame);
+    /*one upload submit per frame, with everything enqueued since the last one*/
+    uploads.flush();
+    applyReloadedPipeline();
+    if (isHeadless())
+    {
+        /*No swapchain to acquire from or present to, the offscreen image of this frame slot is the target*/
+        {
+            FrameProfiler::ScopedTimer timer(profiler, FrameStage::UniformUpdate);
+            updateUniformBuffer(currentFrame);
+        }
+        {
+            FrameProfiler::ScopedTimer timer(profiler, FrameStage::VertexUpdate);
+            updateVertexBuffer(currentFrame);
+            if (colorOverlayEnabled)
+            {
+                colorTexture.prepareFrame(currentFrame);
+            }
+        }
+        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+        uploads.wait(geometryTicket); // no-op once the geometry landed
+        {
+            FrameProfiler::ScopedTimer timer(profiler, FrameStage::Record);
+            vkResetCommandPool(device, frameCommandPools[currentFrame], 0);
+            recordCommandBuffer(currentFrame, currentFrame); // one offscreen image per frame slot
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+
+        {
+            FrameProfiler::ScopedTimer timer(profiler, FrameStage::Submit);
+            VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]));
+        }
+        slotSubmittedFrames[currentFrame] = ++frameCount;
+        profiler.endFrame(currentFrame);
+        currentFrame = (currentFrame + 1) % static_cast<int>(framesInFlight);
+        return;
+    }
+    if (swapChainOutOfDate && !recreateSwapChain())
+    {
+        profiler.discardFrame();
+        glfwWaitEventsTimeout(0.05); // minimized, nothing to draw to
+        return;
+    }
     uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(
-        device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
-    std::cout << "imageIndex : " << imageIndex << std::endl;
+    VkResult result;
+    {
+        FrameProfiler::ScopedTimer timer(profiler, FrameStage::Acquire);
+        result = vkAcquireNextImageKHR(
+            device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    }
     if (result == VK_ERROR_OUT_OF_DATE_KHR)
     {
+        profiler.discardFrame();
         recreateSwapChain();
         return;
     }
     assert(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR); // failed to acquire swap chain image
-    updateUniformBuffer(currentFrame);                           // update uniform buffer
-    // TODO: updateVertexBuffer(currentFrame);
+    VD_LOG_TRACE("imageIndex : %u", imageIndex);
+    {
+        FrameProfiler::ScopedTimer timer(profiler, FrameStage::UniformUpdate);
+        updateUniformBuffer(currentFrame); // update uniform buffer
+    }
+    {
+        FrameProfiler::ScopedTimer timer(profiler, FrameStage::VertexUpdate);
+        updateVertexBuffer(currentFrame);
+        if (colorOverlayEnabled)
+        {
+            colorTexture.prepareFrame(currentFrame);
+        }
+    }
     vkResetFences(device, 1, &inFlightFences[currentFrame]);
-    // vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-
-    // recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    uploads.wait(geometryTicket); // no-op once the geometry landed
+    {
+        FrameProfiler::ScopedTimer timer(profiler, FrameStage::Record);
+        vkResetCommandPool(device, frameCommandPools[currentFrame], 0);
+        recordCommandBuffer(currentFrame, imageIndex);
+    }
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -195,7 +622,11 @@ void VulkanDisplayer::render()
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]));
+    {
+        FrameProfiler::ScopedTimer timer(profiler, FrameStage::Submit);
+        VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]));
+    }
+    slotSubmittedFrames[currentFrame] = ++frameCount;
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -208,17 +639,32 @@ void VulkanDisplayer::render()
     presentInfo.pSwapchains = swapChains;
     presentInfo.pImageIndices = &imageIndex;
     presentInfo.pResults = nullptr;
+    /*the frame number is the present id, waited on by waitForPreviousFrame()*/
+    VkPresentIdKHR presentId{};
+    uint64_t presentIdValue = frameCount;
+    if (presentWaitEnabled)
+    {
+        presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+        presentId.swapchainCount = 1;
+        presentId.pPresentIds = &presentIdValue;
+        presentInfo.pNext = &presentId;
+    }
 
-    result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    {
+        FrameProfiler::ScopedTimer timer(profiler, FrameStage::Present);
+        result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    }
+    if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+    {
+        lastPresentId = frameCount;
+        lastPresentSwapChain = swapChain; // before a recreation replaces it
+    }
+    profiler.endFrame(currentFrame);
     // if (result == VK_SUBOPTIMAL_KHR)
     // {
     //     orientationChanged = true;
     // }
     // else
-    if (result == VK_ERROR_OUT_OF_DATE_KHR)
-    {
-        recreateSwapChain();
-    }
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
     {
         recreateSwapChain();
@@ -227,16 +673,50 @@ void VulkanDisplayer::render()
     {
         assert(result == VK_SUCCESS); // failed to present swap chain image!
     }
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    currentFrame = (currentFrame + 1) % static_cast<int>(framesInFlight);
 }
 
-void VulkanDisplayer::recreateSwapChain()
+/*
+Render thread, when the swapchain no longer matches the surface (resize). The new swapchain is created from the old one
+(oldSwapchain, the presentation engine can hand its images over), and the old swapchain, views and framebuffers go to
+the deletion queue : nothing waits for the device, the frames in flight finish with the old images.
+The render pass (same format) and the pipeline (dynamic viewport and scissor) stay, the next frames are recorded
+against the new framebuffers.
+Returns false if the window has no area (minimized), the recreation is then retried every frame.
+*/
+bool VulkanDisplayer::recreateSwapChain()
 {
-    vkDeviceWaitIdle(device);
-    cleanupSwapChain();
-    createSwapChain();
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities);
+    VkExtent2D extent = chooseSwapExtent(capabilities);
+    swapChainOutOfDate = extent.width == 0 || extent.height == 0;
+    if (swapChainOutOfDate)
+    {
+        return false;
+    }
+
+    VkSwapchainKHR oldSwapChain = swapChain;
+    std::vector<VkImageView> oldImageViews;
+    std::vector<VkFramebuffer> oldFramebuffers;
+    oldImageViews.swap(swapChainImageViews);
+    oldFramebuffers.swap(swapChainFramebuffers);
+
+    createSwapChain(); // retires swapChain through oldSwapchain
     createImageViews();
     createFramebuffers();
+
+    deletionQueue.push(frameCount, [this, oldSwapChain, oldImageViews, oldFramebuffers] {
+        for (VkFramebuffer framebuffer : oldFramebuffers)
+        {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+        for (VkImageView imageView : oldImageViews)
+        {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+        vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
+    });
+    return true;
 }
 
 void VulkanDisplayer::cleanupSwapChain()
@@ -245,14 +725,18 @@ void VulkanDisplayer::cleanupSwapChain()
     {
         vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
     }
-    vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    vkDestroyRenderPass(device, renderPass, nullptr);
     for (size_t i = 0; i < swapChainImageViews.size(); i++)
     {
         vkDestroyImageView(device, swapChainImageViews[i], nullptr);
     }
+    if (isHeadless())
+    {
+        for (size_t i = 0; i < offscreenImages.size(); i++)
+        {
+            allocator.destroyImage(offscreenImages[i], offscreenImageMemory[i]);
+        }
+        return;
+    }
     vkDestroySwapchainKHR(device, swapChain, nullptr);
 }
 
@@ -283,17 +767,28 @@ bool VulkanDisplayer::checkValidationLayerSupport()
     return true;
 }
 
-/* here extentions are supported by glfw */
+/* here extentions are supported by glfw, headless mode needs no surface extensions */
 std::vector<const char*> VulkanDisplayer::getRequiredExtensions()
 {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char*> extensions;
+    if (!isHeadless())
+    {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
     if (enableValidationLayers)
     {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
+    /*the present wait features are queried through it, the instance is Vulkan 1.0*/
+    if (lowLatencyEnabled && !isHeadless()
+        && hasInstanceExtension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+    {
+        extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+        properties2Enabled = true;
+    }
     return extensions;
 }
 
@@ -344,8 +839,9 @@ void VulkanDisplayer::createInstance()
     }
     else
     {
-        /*Do not use validation layers, as they are not enabled*/
-        createInfo.enabledExtensionCount = 0;
+        /*Do not use validation layers, as they are not enabled. The extensions stay : the surface and
+         * properties2 ones are needed without them too*/
+        createInfo.enabledLayerCount = 0;
     }
     // Create the instance
     VK_CHECK(vkCreateInstance(&createInfo, nullptr, &instance));
@@ -401,27 +897,49 @@ QueueFamilyIndices VulkanDisplayer::findQueueFamilies(VkPhysicalDevice device)
     int i = 0;
     for (const auto& queueFamily : queueFamilies)
     {
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !indices.graphicsFamily.has_value())
         {
             indices.graphicsFamily = i;
         }
+        /*Transfer without graphics is the copy engine, prefer the one without compute too*/
+        if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+        {
+            if (!indices.transferFamily.has_value() || !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT))
+            {
+                indices.transferFamily = i;
+            }
+        }
 
+        /*Without a surface (headless) there is nothing to present to*/
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-        if (presentSupport)
+        if (surface != VK_NULL_HANDLE)
         {
-            indices.presentFamily = i;
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
         }
-
-        if (indices.isComplete())
+        if (presentSupport && !indices.presentFamily.has_value())
         {
-            break;
+            indices.presentFamily = i;
         }
 
         i++;
     }
+    /*Graphics queues always support transfers*/
+    if (!indices.transferFamily.has_value())
+    {
+        indices.transferFamily = indices.graphicsFamily;
+    }
     return indices;
 }
+std::vector<const char*> VulkanDisplayer::getRequiredDeviceExtensions()
+{
+    /*The swapchain extension is only needed when we present*/
+    if (isHeadless())
+    {
+        return {};
+    }
+    return deviceExtensions;
+}
+
 bool VulkanDisplayer::checkDeviceExtensionSupport(VkPhysicalDevice device)
 {
     uint32_t extensionCount;
@@ -430,7 +948,8 @@ bool VulkanDisplayer::checkDeviceExtensionSupport(VkPhysicalDevice device)
     std::vector<VkExtensionProperties> availableExtensions(extensionCount);
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+    std::vector<const char*> extensions = getRequiredDeviceExtensions();
+    std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
     for (const auto& extension : availableExtensions)
     {
@@ -474,6 +993,10 @@ bool VulkanDisplayer::isDeviceSuitable(VkPhysicalDevice device)
 {
     QueueFamilyIndices indices = findQueueFamilies(device);
     bool extensionsSupported = checkDeviceExtensionSupport(device);
+    if (isHeadless())
+    {
+        return indices.isComplete(false) && extensionsSupported;
+    }
     bool swapChainAdequate = false;
     if (extensionsSupported)
     {
@@ -511,7 +1034,12 @@ void VulkanDisplayer::createLogicalDevice()
 {
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value()};
+    if (indices.presentFamily.has_value())
+    {
+        uniqueQueueFamilies.insert(indices.presentFamily.value());
+    }
+    uniqueQueueFamilies.insert(indices.transferFamily.value());
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies)
     {
@@ -524,14 +1052,68 @@ void VulkanDisplayer::createLogicalDevice()
     }
 
     VkPhysicalDeviceFeatures deviceFeatures{};
+    std::vector<const char*> enabledExtensions = getRequiredDeviceExtensions();
+    if (gpuCullingEnabled)
+    {
+        /*optional, the culled draws fall back to plain indirect draws without them*/
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        multiDrawIndirectEnabled = supportedFeatures.multiDrawIndirect == VK_TRUE;
+
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+        for (const auto& extension : availableExtensions)
+        {
+            if (strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+            {
+                enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+                drawIndirectCountEnabled = true;
+            }
+        }
+    }
+
+    /*optional, low latency pacing waits on the fences without them*/
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    presentIdFeatures.pNext = &presentWaitFeatures;
+    PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 = nullptr;
+    if (properties2Enabled)
+    {
+        getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+            vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+    }
+    if (getFeatures2 != nullptr && hasDeviceExtension(physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME)
+        && hasDeviceExtension(physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+    {
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &presentIdFeatures;
+        getFeatures2(physicalDevice, &features2);
+        presentWaitEnabled = presentIdFeatures.presentId == VK_TRUE && presentWaitFeatures.presentWait == VK_TRUE;
+    }
+    if (presentWaitEnabled)
+    {
+        enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    }
+    if (lowLatencyEnabled)
+    {
+        VD_LOG_INFO("Low latency pacing on %s", presentWaitEnabled ? "VK_KHR_present_wait" : "the frame fences");
+    }
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = presentWaitEnabled ? &presentIdFeatures : nullptr; // both feature structs, chained
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
     if (enableValidationLayers)
     {
         createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -543,9 +1125,18 @@ void VulkanDisplayer::createLogicalDevice()
     }
 
     VK_CHECK(vkCreateDevice(physicalDevice, &createInfo, nullptr, &device));
+    if (presentWaitEnabled)
+    {
+        waitForPresent
+            = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device, "vkWaitForPresentKHR"));
+    }
 
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-    vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    if (indices.presentFamily.has_value())
+    {
+        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    }
+    vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
 }
 
 /*
@@ -593,6 +1184,17 @@ This setting handles the way we would present our iamges to the screen.
 */
 VkPresentModeKHR VulkanDisplayer::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
 {
+    /*The mode asked for with setPresentMode(), if the surface has it*/
+    if (requestedPresentMode.has_value())
+    {
+        if (std::find(availablePresentModes.begin(), availablePresentModes.end(), *requestedPresentMode)
+            != availablePresentModes.end())
+        {
+            return *requestedPresentMode;
+        }
+        VD_LOG_WARN("Present mode %d is not supported by the surface", static_cast<int>(*requestedPresentMode));
+    }
+
     // Our preffered option
     VkPresentModeKHR bestMode
         = VK_PRESENT_MODE_FIFO_KHR; // Implemented as a queue. The swap chain presents the first image in that queue,
@@ -675,6 +1277,11 @@ void VulkanDisplayer::createSwapChain()
         + 1; // Try to have the minimum amount + 1. The minimum amount would usualy be a single image (1) to implement
              // double-buffering we would therefore required 2.
 
+    if (lowLatencyEnabled)
+    {
+        imageCount = swapChainSupport.capabilities.minImageCount; // no image queued ahead of the one on screen
+    }
+
     if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
     {
         imageCount = swapChainSupport.capabilities
@@ -710,16 +1317,14 @@ void VulkanDisplayer::createSwapChain()
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    createInfo.oldSwapchain = swapChain; // VK_NULL_HANDLE the first time, the caller destroys the old one
 
     VK_CHECK(vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain));
 
     vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
     swapChainImages.resize(imageCount);
 
-    std::cout << "########################################" << std::endl;
-    std::cout << "imageCount : " << imageCount << std::endl;
-    std::cout << "########################################" << std::endl;
+    VD_LOG_DEBUG("imageCount : %u", imageCount);
 
     vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
 
@@ -727,14 +1332,45 @@ void VulkanDisplayer::createSwapChain()
     swapChainExtent = extent;
 }
 
-void VulkanDisplayer::createImageViews()
+/*
+Headless replacement of createSwapChain(): a plain VkImage per frame in flight that we render into.
+They are created as TRANSFER_SRC as well so the result can be read back.
+*/
+void VulkanDisplayer::createOffscreenTargets()
 {
-    swapChainImageViews.resize(swapChainImages.size());
-    for (size_t i = 0; i < swapChainImages.size(); i++)
+    swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM; // always supported as a color attachment
+    swapChainExtent = {static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT)};
+
+    offscreenImages.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreenImageMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = swapChainImageFormat;
+        imageInfo.extent = {swapChainExtent.width, swapChainExtent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        allocator.createImage(imageInfo, MemoryUsage::GpuOnly, offscreenImages[i], offscreenImageMemory[i]);
+    }
+}
+
+void VulkanDisplayer::createImageViews()
+{
+    const std::vector<VkImage>& images = isHeadless() ? offscreenImages : swapChainImages;
+    swapChainImageViews.resize(images.size());
+    for (size_t i = 0; i < images.size(); i++)
     {
         VkImageViewCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        createInfo.image = swapChainImages[i];
+        createInfo.image = images[i];
         createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
         createInfo.format = swapChainImageFormat;
         createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -763,7 +1399,9 @@ void VulkanDisplayer::createRenderPass()
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    /*Offscreen images are never presented, leave them ready to be copied out instead*/
+    colorAttachment.finalLayout
+        = isHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
@@ -799,52 +1437,36 @@ void VulkanDisplayer::createDescriptorSetLayout()
     // 因为我们这里uniform中只有一个ubo，不需要其他的数据，如纹理等，所以只需要一个binding
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
 
-    std::array<VkDescriptorSetLayoutBinding, 1> bindings = {uboLayoutBinding};
+    /*packed positions are decoded with the bounds of their chunk*/
+    VkDescriptorSetLayoutBinding chunkLayoutBinding{};
+    chunkLayoutBinding.binding = 1;
+    chunkLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    chunkLayoutBinding.descriptorCount = 1;
+    chunkLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    chunkLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, chunkLayoutBinding};
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.bindingCount = activeVertexFormat() == VertexFormat::Packed16 ? 2 : 1;
     layoutInfo.pBindings = bindings.data();
 
     VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout));
 }
 
-std::vector<char> VulkanDisplayer::readFile(const std::string& filename) // Pass in the file path
-{
-    /*Read the file as binary data, and begin reading it from the back*/
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-    /*If a link to the file has not been successfully associated with as stream*/
-    if (!file.is_open())
-    {
-        throw std::runtime_error("Failed to open file!");
-    }
-
-    /*The returned position at the end of the file and be used to set the file size*/
-    size_t fileSize = (size_t) file.tellg();
-    std::vector<char> buffer(fileSize); // And a buffer capable of holding the binary data
-
-    file.seekg(0);                      // Extracts the beginning of the file
-    file.read(buffer.data(), fileSize); // Read in filesize bytes from position pointed to by buffer.data() This would
-                                        // point to the start of the file
-
-    file.close(); // Close the file for reading
-
-    return buffer;
-}
-
-VkShaderModule VulkanDisplayer::createShaderModule(const std::vector<char>& code) // Pass in the bytecode
+VkShaderModule VulkanDisplayer::createShaderModule(const uint32_t* code, size_t codeSize) // Pass in the bytecode
 {
     VkShaderModuleCreateInfo createInfo = {};
 
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();                                 // Size in bytes
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data()); // Pointer to the data
+    createInfo.codeSize = codeSize; // Size in bytes
+    createInfo.pCode = code;        // The words compiled into the binary, already 4 byte aligned
 
     /*Create the vk shader module*/
     VkShaderModule shaderModule;
@@ -857,15 +1479,13 @@ VkShaderModule VulkanDisplayer::createShaderModule(const std::vector<char>& code
 
     return shaderModule;
 }
-void VulkanDisplayer::createGraphicsPipeline()
+/*
+Everything of the graphics pipeline but its layout. Also called from the shader watcher thread on a hot reload, so it
+only reads state that does not change after initVulkan()
+*/
+VkPipeline VulkanDisplayer::buildGraphicsPipeline(
+    VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, const char* name)
 {
-    auto vertShaderCode = readFile("shaders/shader.vert.spv");
-    auto fragShaderCode = readFile("shaders/shader.frag.spv");
-    // VkShaderModule 是一个代表可编程着色器的 Vulkan
-    // 对象。着色器用于对图形数据执行各种操作，例如转换顶点、给像素着色和计算全局效果。
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
     vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
@@ -882,19 +1502,14 @@ void VulkanDisplayer::createGraphicsPipeline()
 
     /*Gets the binding descriptions which we have created. It recieves information about the layout of the bindings ( if
      * there are more than one) and the layout of the attributes contained in the bound array*/
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
-    // 设置 vertex shader中 in 中的各个项
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-    vertexInputInfo.sType
-        = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO; // Specify it is per vertex instead of per instance
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions
-        = &bindingDescription; // Most likely passing information of the binding to be used, such as the index in teh
-                               // array, the elements it is build from(Vertex) and if it is per vertex or per instance
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(
-        attributeDescriptions.size()); // The amount of attributes in a single instance ( Vertex, in our case)
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    // 设置 vertex shader中 in 中的各个项，由顶点结构体的字段列表在编译期生成
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    switch (activeVertexFormat())
+    {
+    case VertexFormat::Float32: vertexInputInfo = VertexLayout<Vertex>::inputState(); break;
+    case VertexFormat::ColorUnorm8: vertexInputInfo = VertexLayout<ColorVertex>::inputState(); break;
+    case VertexFormat::Packed16: vertexInputInfo = VertexLayout<PackedVertex>::inputState(); break;
+    }
 
     /*
     Describes the type of geometry which will be drawn
@@ -903,39 +1518,18 @@ void VulkanDisplayer::createGraphicsPipeline()
     */
     VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
     inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; // Triangle from every 3 vertices without reuse
+    /*TRIANGLE_LIST : Triangle from every 3 vertices without reuse, POINT_LIST : point clouds*/
+    inputAssembly.topology = topology;
     inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-    /*
-    The viewport is the region of the framebuffer we
-    will be rendering to. This would most often
-    be the entirety of our screen.
-    */
-    VkViewport viewport = {};
-    viewport.x = 0.0f; // From the top left corner.
-    viewport.y = 0.0f;
-    viewport.width
-        = (float) swapChainExtent
-              .width; // The width we have for our images in the swap chain. Done to match the window resolutions.
-    viewport.height = (float) swapChainExtent.height; // The height we have for our images in the swap chain
-    viewport.minDepth = 0.0f; // The min depth and max depth should stick to 0,0 and 1,0 if we are not doing anything
-                              // that requires depth buffering.
-    viewport.maxDepth = 1.0f;
-
-    /*The scissor recatangle defines which pixels of the image will be stoed in the framebuffer*/
-    VkRect2D scissor = {};
-
-    /*In this case we want one which renders the entire framebuffer so we specify no offsets*/
-    scissor.offset = {0, 0};
-    scissor.extent = swapChainExtent;
-
-    /*Combines the viewport and scissor rectangle into a viewport state*/
+    /*Combines the viewport and scissor rectangle into a viewport state. Both are dynamic, set when the command buffer
+     * is recorded, so the pipeline survives a swapchain resize*/
     VkPipelineViewportStateCreateInfo viewportState = {};
     viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
+    viewportState.pViewports = nullptr;
     viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
+    viewportState.pScissors = nullptr;
 
     /*
     The rasterizer will take all of the non-clipped vertices
@@ -1012,23 +1606,12 @@ void VulkanDisplayer::createGraphicsPipeline()
     colorBlending.blendConstants[2] = 0.0f;
     colorBlending.blendConstants[3] = 0.0f;
 
-    // Maybe mention that some parts of the pipeline here can actually be changed dynamically??
-
-    /*
-    You can use uniform values in shaders, which are globals similar to dynamic state variables that can be changed
-    at drawing time to alter the behavior of your shaders without having to recreate them.
-    They are commonly used to pass the transformation matrix to the vertex shader,
-    or to create texture samplers in the fragment shader.
-    */
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount
-        = 1; // This specifies the amount of descriptor layouts the pipeline will make use of.
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pPushConstantRanges = 0;
-
-    VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+    /*Parts of the pipeline that are given when recording instead*/
+    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState = {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
 
     /*
     The graphics pipeline now combines all information
@@ -1048,7 +1631,7 @@ void VulkanDisplayer::createGraphicsPipeline()
     pipelineInfo.pMultisampleState = &multisampling;
     pipelineInfo.pDepthStencilState = nullptr;
     pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = nullptr;
+    pipelineInfo.pDynamicState = &dynamicState;
 
     pipelineInfo.layout = pipelineLayout;
 
@@ -1059,8 +1642,52 @@ void VulkanDisplayer::createGraphicsPipeline()
     /*Saves time as it would have most of it's functionality to be similar and just copies it in*/
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    /*The VK_NULL_HANDLE is for a pipeline cache*/
-    VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline));
+    /*A warm cache (same GPU and driver as the previous run) skips the shader compilation*/
+    VkPipeline pipeline;
+    auto start = std::chrono::steady_clock::now();
+    if (vkCreateGraphicsPipelines(device, pipelineCache.handle(), 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the graphics pipeline!");
+    }
+    pipelineCache.recordPipeline(
+        name, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return pipeline;
+}
+
+void VulkanDisplayer::createGraphicsPipeline()
+{
+    // VkShaderModule 是一个代表可编程着色器的 Vulkan
+    // 对象。着色器用于对图形数据执行各种操作，例如转换顶点、给像素着色和计算全局效果。
+    // SPIR-V在构建时嵌入可执行文件(Shaders.h)，与工作目录无关
+    if (activeVertexFormat() == VertexFormat::Packed16)
+    {
+        vertSpirv.assign(std::begin(shaders::shader_packed_vert), std::end(shaders::shader_packed_vert));
+    }
+    else
+    {
+        vertSpirv.assign(std::begin(shaders::shader_vert), std::end(shaders::shader_vert));
+    }
+    fragSpirv.assign(std::begin(shaders::shader_frag), std::end(shaders::shader_frag));
+    VkShaderModule vertShaderModule = createShaderModule(vertSpirv.data(), vertSpirv.size() * sizeof(uint32_t));
+    VkShaderModule fragShaderModule = createShaderModule(fragSpirv.data(), fragSpirv.size() * sizeof(uint32_t));
+
+    /*
+    You can use uniform values in shaders, which are globals similar to dynamic state variables that can be changed
+    at drawing time to alter the behavior of your shaders without having to recreate them.
+    They are commonly used to pass the transformation matrix to the vertex shader,
+    or to create texture samplers in the fragment shader.
+    */
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount
+        = 1; // This specifies the amount of descriptor layouts the pipeline will make use of.
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = 0;
+
+    VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+    graphicsPipeline = buildGraphicsPipeline(vertShaderModule, fragShaderModule, "graphics");
 
     /*Once the data has been passed along the graphics pipeline, we don't really require the buffers anymore hence free
      * their memory*/
@@ -1068,6 +1695,95 @@ void VulkanDisplayer::createGraphicsPipeline()
     vkDestroyShaderModule(device, vertShaderModule, nullptr);
 }
 /*
+Chunk bounds on the CPU once, the culling itself on the GPU every frame. Dynamic geometry would outdate the bounds and
+depth projection has no draw list, culling is turned off for them.
+*/
+void VulkanDisplayer::createCullingPipeline()
+{
+    if (!gpuCullingEnabled)
+    {
+        return;
+    }
+    if (geometryUsage == GeometryUsage::Dynamic || drawChunks.empty() || !indexedDraws())
+    {
+        VD_LOG_WARN("GPU culling needs static indexed geometry with a list/point topology, culling disabled");
+        gpuCullingEnabled = false;
+        return;
+    }
+    std::vector<ChunkCuller::Chunk> chunks;
+    if (sceneCache)
+    {
+        chunks = sceneCache->chunks(); // bounds computed when the cache was written
+    }
+    else
+    {
+        chunks.resize(drawChunks.size());
+        for (size_t i = 0; i < drawChunks.size(); i++)
+        {
+            chunks[i].firstIndex = drawChunks[i].firstIndex;
+            chunks[i].indexCount = drawChunks[i].indexCount;
+        }
+        ChunkCuller::computeBounds(chunks, vertices, indices);
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    bool multiDraw = multiDrawIndirectEnabled && chunks.size() <= properties.limits.maxDrawIndirectCount;
+    PFN_vkCmdDrawIndexedIndirectCountKHR drawIndirectCount = drawIndirectCountEnabled
+        ? reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+              vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"))
+        : nullptr;
+
+    VkShaderModule cullShaderModule = createShaderModule(shaders::cull_comp);
+    culler.init(device, &allocator, MAX_FRAMES_IN_FLIGHT, chunks, cullShaderModule, &pipelineCache, drawIndirectCount,
+        multiDraw);
+    vkDestroyShaderModule(device, cullShaderModule, nullptr);
+    VD_LOG_INFO("GPU culling : %zu chunks, drawn with %s", chunks.size(),
+        drawIndirectCount && multiDraw ? "vkCmdDrawIndexedIndirectCountKHR"
+            : multiDraw                ? "one multi draw vkCmdDrawIndexedIndirect"
+                                       : "one vkCmdDrawIndexedIndirect per chunk");
+}
+
+/*
+The compute pipeline of the depth projection. It runs on the graphics queue, in the same command buffer as the draw,
+so a pipeline barrier is all the synchronization it needs.
+*/
+void VulkanDisplayer::createComputePipeline()
+{
+    if (!depthProjectionEnabled)
+    {
+        return;
+    }
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    if (!(queueFamilies[findQueueFamilies(physicalDevice).graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT))
+    {
+        throw std::runtime_error("The graphics queue does not support compute!");
+    }
+
+    VkShaderModule compShaderModule = createShaderModule(shaders::depth_to_points_comp);
+    depthProjector.init(device, &allocator, MAX_FRAMES_IN_FLIGHT, compShaderModule, &pipelineCache);
+    vkDestroyShaderModule(device, compShaderModule, nullptr);
+}
+
+void VulkanDisplayer::createColorOverlay()
+{
+    if (!colorOverlayEnabled)
+    {
+        return;
+    }
+    VkShaderModule vertShaderModule = createShaderModule(shaders::overlay_vert);
+    VkShaderModule fragShaderModule = createShaderModule(shaders::overlay_frag);
+    colorTexture.init(physicalDevice, device, &allocator, MAX_FRAMES_IN_FLIGHT, descriptorPool, renderPass,
+        vertShaderModule, fragShaderModule, &pipelineCache);
+    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    VD_LOG_INFO("Color overlay : %s texture, %u mip levels",
+        colorTexture.format() == VK_FORMAT_B8G8R8_UNORM ? "B8G8R8" : "R8G8B8A8", colorTexture.mipLevels());
+}
+/*
 A framebuffer is a set of valid
 VkImage that we use using the framebuffer.
 */
@@ -1115,183 +1831,229 @@ void VulkanDisplayer::createCommandPool()
     VkCommandPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value(); // draw commands
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // Hints how new commands are being recoreded. If
-                                                                      // they often change or they persist.
-
-    VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool));
-}
-
-void VulkanDisplayer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-    VkBuffer& buffer, VkDeviceMemory& bufferMemory)
-{
-    VkBufferCreateInfo bufferInfo{};
-    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = size;
-    bufferInfo.usage = usage;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    VK_CHECK(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer));
-
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    VK_CHECK(vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory));
-
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);
-}
-
-uint32_t VulkanDisplayer::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
-{
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    /*Per frame command buffers : one pool per frame slot, reset as a whole once the slot's fence signalled. Cheaper
+     * than resetting the buffers one by one, and no pool is ever touched by two frames*/
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    for (VkCommandPool& framePool : frameCommandPools)
+    {
+        VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &framePool));
+    }
 
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    /*Parallel recording : a pool per recording job and frame slot, a pool can only be used by one thread at a time*/
+    size_t jobs = std::min<size_t>(recordingThreads, ThreadPool::global().concurrency());
+    for (std::vector<VkCommandPool>& jobPools : secondaryCommandPools)
     {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        jobPools.resize(jobs);
+        for (VkCommandPool& jobPool : jobPools)
         {
-            return i;
+            VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &jobPool));
         }
     }
-
-    assert(false); // failed to find suitable memory type!
-    return -1;
 }
 
-VkCommandBuffer VulkanDisplayer::beginSingleTimeCommands()
+/*Buffers are sub-allocated from the pooled allocator, see MemoryAllocator*/
+void VulkanDisplayer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage,
+    VkBuffer& buffer, Allocation& allocation, const std::vector<uint32_t>& queueFamilies)
 {
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO; // Creates and sets up the command buffer
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool; // Tells to which command pool the buffer belongs to
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO; // Weqather commands will be associated with graphics
-                                                                   // commands etc
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    allocator.createBuffer(size, usage, memoryUsage, buffer, allocation, queueFamilies);
+}
 
-    return commandBuffer;
+/*Static geometry in its GPU format. CPU only, runs while the device is being created*/
+void VulkanDisplayer::prepareVertexData()
+{
+    if (sceneCache)
+    {
+        return; // packed when the cache was written
+    }
+    switch (activeVertexFormat())
+    {
+    case VertexFormat::Float32:
+        break; // uploaded straight from vertices
+    case VertexFormat::ColorUnorm8:
+        colorVertices.resize(vertices.size());
+        packVertices(vertices.data(), vertices.size(), colorVertices.data());
+        break;
+    case VertexFormat::Packed16:
+        packedVertices.resize(vertices.size());
+        /*at least one chunk, a storage buffer can not be empty*/
+        packedChunks.resize(std::max<size_t>(packedChunkCount(vertices.size()), 1));
+        packVertices(vertices.data(), vertices.size(), packedVertices.data(), packedChunks.data());
+        break;
+    }
 }
 
-void VulkanDisplayer::endSingleTimeCommands(VkCommandBuffer commandBuffer)
+/*
+Static geometry : the copy is only enqueued here, it runs on the transfer queue while the rest of initVulkan() goes on.
+render() waits for geometryTicket before the first frame that draws it.
+Dynamic geometry : every frame slot gets its own host visible buffer, written directly.
+*/
+void VulkanDisplayer::createVertexBuffer()
 {
-    vkEndCommandBuffer(commandBuffer);
+    if (depthProjectionEnabled)
+    {
+        return; // written by the compute shader
+    }
+    if (octreeEnabled)
+    {
+        octreeStreamer.init(&allocator, &uploads, octree, octreePointBudget, uploads.sharingFamilies());
+        return;
+    }
+    if (pointFile)
+    {
+        uploadPointCloudFile();
+        return;
+    }
+    if (sceneCache)
+    {
+        uploadSceneCache();
+        return;
+    }
+    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+    if (geometryUsage == GeometryUsage::Dynamic)
+    {
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::CpuToGpu,
+                streamingVertexBuffers[i], streamingVertexMemory[i]);
+            memcpy(streamingVertexMemory[i].mapped, vertices.data(), (size_t) bufferSize);
+        }
+        return;
+    }
 
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    const void* data = vertices.data();
+    if (activeVertexFormat() == VertexFormat::ColorUnorm8)
+    {
+        data = colorVertices.data();
+    }
+    else if (activeVertexFormat() == VertexFormat::Packed16)
+    {
+        data = packedVertices.data();
+    }
+    bufferSize = vertexStride(activeVertexFormat()) * vertices.size();
 
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphicsQueue);
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        MemoryUsage::GpuOnly, vertexBuffer, vertexBufferMemory, uploads.sharingFamilies());
+    geometryTicket = uploads.uploadBuffer(vertexBuffer, 0, data, bufferSize);
 
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    if (!packedChunks.empty())
+    {
+        VkDeviceSize chunkSize = sizeof(PackedChunk) * packedChunks.size();
+        createBuffer(chunkSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            MemoryUsage::GpuOnly, vertexChunkBuffer, vertexChunkMemory, uploads.sharingFamilies());
+        geometryTicket = uploads.uploadBuffer(vertexChunkBuffer, 0, packedChunks.data(), chunkSize);
+    }
+
+    /*the packed copies only had to live until they were in the staging ring*/
+    colorVertices = std::vector<ColorVertex>();
+    packedVertices = std::vector<PackedVertex>();
+    packedChunks = std::vector<PackedChunk>();
 }
 
-/*Copies over data from a buffer specifed as source to one specifed as destination. It must pass the amount of data to
- * be transferred*/
-void VulkanDisplayer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+/*
+Streams the points of the mapped file into the vertex buffer. Each chunk is converted by the thread pool directly into
+the staging ring (at most half of it per chunk), when the ring is full the upload manager submits and waits for the
+oldest batch : memory use stays bounded whatever the size of the file, and the conversion of a chunk overlaps with the
+transfer of the previous ones.
+*/
+void VulkanDisplayer::uploadPointCloudFile()
 {
-    /*Memory transfer operations are executed using command Buffers*/
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(); // REcords a command buffer
-
-    VkBufferCopy copyRegion = {};
-    copyRegion.size = size; // Size of the region we want to copy
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-    endSingleTimeCommands(commandBuffer); // Once it's done, we do not need it anymore so free memory associated with it
+    auto start = std::chrono::steady_clock::now();
+    uint64_t pointCount = pointFile->pointCount();
+    VkDeviceSize bufferSize = std::max<VkDeviceSize>(pointCount * sizeof(Vertex), sizeof(Vertex));
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        MemoryUsage::GpuOnly, vertexBuffer, vertexBufferMemory, uploads.sharingFamilies());
+
+    uint64_t chunkPoints = uploads.getStagingSize() / 2 / sizeof(Vertex);
+    for (uint64_t first = 0; first < pointCount; first += chunkPoints)
+    {
+        uint64_t count = std::min(chunkPoints, pointCount - first);
+        geometryTicket = uploads.uploadBuffer(vertexBuffer, first * sizeof(Vertex), count * sizeof(Vertex),
+            [&](void* staging) { pointFile->convert(first, count, static_cast<Vertex*>(staging)); });
+    }
+    uploads.wait(geometryTicket);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    double megabytes = pointCount * sizeof(Vertex) / (1024.0 * 1024.0);
+    VD_LOG_INFO("Point cloud file : %llu points, %.1f MB uploaded in %.1f ms (%.1f MB/s)",
+        static_cast<unsigned long long>(pointCount), megabytes, ms, megabytes * 1000.0 / std::max(ms, 1e-3));
 }
 
-void VulkanDisplayer::createVertexBuffer()
+/*
+Every section of the cache is already in its GPU layout, the mapped ranges go to the upload manager as they are (or
+are decompressed into the staging ring). Buffers are never empty, a section may be.
+*/
+void VulkanDisplayer::uploadSceneCache()
 {
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-    vertexBuffer.resize(MAX_FRAMES_IN_FLIGHT);
-    vertexBufferMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    VkBuffer stagingBuffer{};
-    VkDeviceMemory stagingBufferMemory{};
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    auto start = std::chrono::steady_clock::now();
+    createBuffer(std::max<VkDeviceSize>(sceneCache->sectionSize(SceneCache::Vertices), 4),
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::GpuOnly, vertexBuffer,
+        vertexBufferMemory, uploads.sharingFamilies());
+    geometryTicket = sceneCache->upload(SceneCache::Vertices, uploads, vertexBuffer);
+    if (activeVertexFormat() == VertexFormat::Packed16)
     {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-            stagingBufferMemory);
-
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, vertices.data(), (size_t) bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
-        // TODO: 关于usage，可能需要修改，因为这里的顶点我们需要每次都去修改
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer[i], vertexBufferMemory[i]);
-
-        copyBuffer(stagingBuffer, vertexBuffer[i], bufferSize);
-
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        createBuffer(std::max<VkDeviceSize>(sceneCache->sectionSize(SceneCache::VertexChunks), 4),
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly,
+            vertexChunkBuffer, vertexChunkMemory, uploads.sharingFamilies());
+        geometryTicket = sceneCache->upload(SceneCache::VertexChunks, uploads, vertexChunkBuffer);
     }
+    createBuffer(std::max<VkDeviceSize>(sceneCache->sectionSize(SceneCache::Indices), 4),
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, MemoryUsage::GpuOnly, indexBuffer,
+        indexBufferMemory, uploads.sharingFamilies());
+    geometryTicket = sceneCache->upload(SceneCache::Indices, uploads, indexBuffer);
+    uploads.wait(geometryTicket);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    VD_LOG_INFO("Scene cache : %llu vertices, %llu indices, %zu chunks uploaded in %.1f ms",
+        static_cast<unsigned long long>(sceneCache->vertexCount()),
+        static_cast<unsigned long long>(sceneCache->indexCount()), sceneCache->chunks().size(), ms);
 }
 
 void VulkanDisplayer::createIndexBuffer()
 {
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-    indexBuffer.resize(MAX_FRAMES_IN_FLIGHT);
-    indexBufferMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    VkBuffer stagingBuffer{};
-    VkDeviceMemory stagingBufferMemory{};
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    if (sceneCache)
     {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-            stagingBufferMemory);
-
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, indices.data(), (size_t) bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
-
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer[i], indexBufferMemory[i]);
-
-        copyBuffer(stagingBuffer, indexBuffer[i], bufferSize);
-
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        return; // uploaded with the vertices, see uploadSceneCache()
     }
+    if (!indexedDraws())
+    {
+        uploads.flush();
+        return; // non indexed draws
+    }
+    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        MemoryUsage::GpuOnly, indexBuffer, indexBufferMemory, uploads.sharingFamilies());
+    geometryTicket = uploads.uploadBuffer(indexBuffer, 0, indices.data(), bufferSize);
+    uploads.flush();
 }
 
 void VulkanDisplayer::createUniformBuffer()
 {
-    VkDeviceSize bufferSize = sizeof(UniformObject); // The buffer size would be the size of the struct
-    uniformBuffer.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBufferMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer[i],
-            uniformBufferMemory[i]);
-    }
+    /*Dynamic offsets must be multiples of minUniformBufferOffsetAlignment (a power of two)*/
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+    uniformSlotStride = (sizeof(UniformObject) + alignment - 1) & ~(alignment - 1);
+
+    VkDeviceSize bufferSize = uniformSlotStride * UNIFORM_SLOTS_PER_FRAME * MAX_FRAMES_IN_FLIGHT;
+    createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryUsage::CpuToGpu, uniformBuffer,
+        uniformBufferMemory);
+
+    /*The allocator keeps host visible memory mapped for its whole lifetime*/
+    uniformBufferMapped = static_cast<uint8_t*>(uniformBufferMemory.mapped);
 }
 
 void VulkanDisplayer::createDescriptorPool()
 {
-    VkDescriptorPoolSize poolSizes[2];
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    VkDescriptorPoolSize poolSizes[3];
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; // packed vertex chunks
+    poolSizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = 2;
+    poolInfo.poolSizeCount = 3;
     poolInfo.pPoolSizes = poolSizes;
     poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2;
 
@@ -1300,115 +2062,379 @@ void VulkanDisplayer::createDescriptorPool()
 
 void VulkanDisplayer::createDescriptorSets()
 {
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    allocInfo.pSetLayouts = layouts.data();
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
+
+    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+
+    /*The descriptor covers one UniformObject, the dynamic offset given at bind time picks the frame / object slot*/
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = uniformBuffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(UniformObject);
+    // only uniform buffer here
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    std::vector<VkWriteDescriptorSet> descriptorWrites = {descriptorWrite};
+
+    VkDescriptorBufferInfo chunkInfo{};
+    if (activeVertexFormat() == VertexFormat::Packed16)
+    {
+        chunkInfo.buffer = vertexChunkBuffer;
+        chunkInfo.offset = 0;
+        chunkInfo.range = VK_WHOLE_SIZE;
+
+        VkWriteDescriptorSet chunkWrite = descriptorWrite;
+        chunkWrite.dstBinding = 1;
+        chunkWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        chunkWrite.pBufferInfo = &chunkInfo;
+        descriptorWrites.push_back(chunkWrite);
+    }
 
-    descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()));
+    vkUpdateDescriptorSets(
+        device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+void VulkanDisplayer::createCommandBuffers()
+{
+    /*Recorded in render() every frame, against the image that was acquired*/
+    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    for (size_t i = 0; i < commandBuffers.size(); i++)
     {
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffer[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformObject);
-        // only uniform buffer here
-        VkWriteDescriptorSet descriptorWrite{};
-        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.dstSet = descriptorSets[i];
-        descriptorWrite.dstBinding = 0;
-        descriptorWrite.dstArrayElement = 0;
-        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.pBufferInfo = &bufferInfo;
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = frameCommandPools[i];
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffers[i]));
 
-        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+        /*one secondary command buffer per recording job, executed by the primary one*/
+        secondaryCommandBuffers[i].resize(secondaryCommandPools[i].size());
+        for (size_t job = 0; job < secondaryCommandPools[i].size(); job++)
+        {
+            allocInfo.commandPool = secondaryCommandPools[i][job];
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &secondaryCommandBuffers[i][job]));
+        }
     }
 }
 
-void VulkanDisplayer::createCommandBuffers()
+/*
+Watcher thread : compiles the saved shader and builds a pipeline with it and the current other stage. render() picks
+it up at its next frame. A shader that does not compile or link leaves the current pipeline in place.
+*/
+void VulkanDisplayer::reloadShader(const std::string& fileName)
 {
-    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = commandBuffers.size();
+    const char* vertName = activeVertexFormat() == VertexFormat::Packed16 ? "shader_packed.vert" : "shader.vert";
+    bool vertex = fileName == vertName;
+    if (!vertex && fileName != "shader.frag")
+    {
+        return; // not a stage of the graphics pipeline
+    }
+    VD_LOG_INFO("Shader hot reload : %s changed, recompiling", fileName.c_str());
+    std::vector<uint32_t> spirv = compileGlsl(shaderSourceDir + "/" + fileName);
+    if (spirv.empty())
+    {
+        VD_LOG_WARN("Shader hot reload : %s failed to compile, keeping the current pipeline", fileName.c_str());
+        return;
+    }
+    const std::vector<uint32_t>& vert = vertex ? spirv : vertSpirv;
+    const std::vector<uint32_t>& frag = vertex ? fragSpirv : spirv;
+    /*the driver may still reject the SPIR-V : nothing thrown here may leave the watcher thread*/
+    VkShaderModule vertShaderModule = VK_NULL_HANDLE;
+    VkShaderModule fragShaderModule = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    try
+    {
+        vertShaderModule = createShaderModule(vert.data(), vert.size() * sizeof(uint32_t));
+        fragShaderModule = createShaderModule(frag.data(), frag.size() * sizeof(uint32_t));
+        pipeline = buildGraphicsPipeline(vertShaderModule, fragShaderModule, "graphics (hot reload)");
+    }
+    catch (const std::exception& e)
+    {
+        VD_LOG_WARN("Shader hot reload : %s keeping the current pipeline", e.what());
+    }
+    /*no-ops for the modules that were not created*/
+    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    if (pipeline == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    (vertex ? vertSpirv : fragSpirv) = std::move(spirv);
 
-    VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()));
+    /*a pipeline render() did not pick up yet is bound by no command buffer, the new one simply replaces it*/
+    VkPipeline unused = pendingPipeline.exchange(pipeline, std::memory_order_acq_rel);
+    if (unused != VK_NULL_HANDLE)
+    {
+        vkDestroyPipeline(device, unused, nullptr);
+    }
+}
 
-    /*Begin recording command buffers*/
-    for (size_t i = 0; i < commandBuffers.size(); i++)
+/*
+Render thread, once per frame before recording. Swaps in the pipeline the shader watcher thread built. The frames in
+flight keep drawing with the old one, it goes to the deletion queue.
+*/
+void VulkanDisplayer::applyReloadedPipeline()
+{
+    VkPipeline reloaded = pendingPipeline.exchange(VK_NULL_HANDLE, std::memory_order_acquire);
+    if (reloaded == VK_NULL_HANDLE)
     {
-        VkCommandBufferBeginInfo beginInfo = {};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags
-            = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT; // How we're going to use the command buffer. Can be
-                                                            // resubmitted while pending execution, in this case.
-        beginInfo.pInheritanceInfo = nullptr;
+        return;
+    }
+    VkPipeline replaced = graphicsPipeline;
+    deletionQueue.push(frameCount, [this, replaced] { vkDestroyPipeline(device, replaced, nullptr); });
+    graphicsPipeline = reloaded;
+}
 
-        vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
+/*
+Records the draw of frame slot frame into swapchain image imageIndex (the offscreen image of the slot when headless).
+Called every frame once the pool of the slot was reset, so whatever changed since the last frame (pipeline, swapchain,
+draw parameters) is simply recorded as it is now.
+*/
+void VulkanDisplayer::recordCommandBuffer(uint32_t frame, uint32_t imageIndex)
+{
+    VkCommandBuffer commandBuffer = commandBuffers[frame];
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // recorded again before the next submit
+    beginInfo.pInheritanceInfo = nullptr;
 
-        /*Bind the correct framebuffer for each image, and reuse the same renderpass as we only have one we're
-         * interested in*/
-        VkRenderPassBeginInfo renderPassInfo = {};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[i];
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
-        /*Keep the rendering area to the same dimensions as the whole window*/
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = swapChainExtent;
+    profiler.cmdWriteBegin(commandBuffer, frame); // GPU time of the frame starts here
 
-        /*When the framebuffer is reset, update the values to black*/
-        VkClearValue clearColor = {0.2f, 0.2f, 0.2f, 1.0f};
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
+    if (depthProjectionEnabled)
+    {
+        depthProjector.recordDispatch(commandBuffer, frame); // before the render pass
+    }
+    if (gpuCullingEnabled)
+    {
+        culler.recordCull(commandBuffer, frame, frameMvp); // before the render pass
+    }
+    if (colorOverlayEnabled)
+    {
+        colorTexture.recordUpload(commandBuffer, frame); // before the render pass
+    }
 
-        vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo,
+    /*Bind the correct framebuffer for each image, and reuse the same renderpass as we only have one we're
+     * interested in*/
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+
+    /*Keep the rendering area to the same dimensions as the whole window*/
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = swapChainExtent;
+
+    /*When the framebuffer is reset, update the values to black*/
+    VkClearValue clearColor = {0.2f, 0.2f, 0.2f, 1.0f};
+    renderPassInfo.clearValueCount = 1;
+    renderPassInfo.pClearValues = &clearColor;
+
+    uint32_t jobs = recordingJobCount();
+    if (jobs == 0)
+    {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
             VK_SUBPASS_CONTENTS_INLINE); // Execute the command buffers with only the primary command buffer itself is
                                          // provided and no secondary command buffers are there.
+        recordDraws(commandBuffer, frame, 0, drawChunks.size());
+        if (colorOverlayEnabled)
+        {
+            colorTexture.recordOverlay(commandBuffer, swapChainExtent); // over the point cloud
+        }
+    }
+    else
+    {
+        /*the render pass only executes the secondary command buffers the jobs recorded*/
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        recordSecondaryCommandBuffers(frame, imageIndex, jobs);
+        vkCmdExecuteCommands(commandBuffer, jobs, secondaryCommandBuffers[frame].data());
+    }
 
-        vkCmdBindPipeline(
-            commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline); // Bind the GRAPHICS pipeline
+    vkCmdEndRenderPass(commandBuffer); // End render pass
 
-        /*
-        The number are as follows
+    profiler.cmdWriteEnd(commandBuffer, frame);
 
-        3 - vertices in the triangle
-        1 - Triangle in the scene
-        0 - Offset is 0 as data is tightly packed
-        0 - Offset between instances is 0, we only have one
-        */
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+}
 
-        VkBuffer vertexBuffers[] = {vertexBuffer[i]}; // We only have one vertex buffer
+/*
+State and draws of the render pass, for chunks [firstChunk, endChunk) of the draw list. Goes into the primary command
+buffer, or into each secondary one : a secondary command buffer inherits none of this state.
+*/
+void VulkanDisplayer::recordDraws(VkCommandBuffer commandBuffer, uint32_t frame, size_t firstChunk, size_t endChunk)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline); // Bind the GRAPHICS pipeline
 
-        VkDeviceSize offsets[]
-            = {0}; // This array specifies a one-to-one mapping between the ammount of vertex buffers and the offsets of
-                   // each buffer, i.e from where to start reading vertex data from.
+    /*
+    The viewport is the region of the framebuffer we
+    will be rendering to. This would most often
+    be the entirety of our screen.
+    */
+    VkViewport viewport = {};
+    viewport.x = 0.0f; // From the top left corner.
+    viewport.y = 0.0f;
+    viewport.width
+        = (float) swapChainExtent
+              .width; // The width we have for our images in the swap chain. Done to match the window resolutions.
+    viewport.height = (float) swapChainExtent.height; // The height we have for our images in the swap chain
+    viewport.minDepth = 0.0f; // The min depth and max depth should stick to 0,0 and 1,0 if we are not doing anything
+                              // that requires depth buffering.
+    viewport.maxDepth = 1.0f;
+
+    /*The scissor recatangle defines which pixels of the image will be stoed in the framebuffer*/
+    VkRect2D scissor = {};
+
+    /*In this case we want one which renders the entire framebuffer so we specify no offsets*/
+    scissor.offset = {0, 0};
+    scissor.extent = swapChainExtent;
+
+    /*Dynamic state of the pipeline, the swapchain may have been resized since it was created*/
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    /*
+    The number are as follows
+
+    3 - vertices in the triangle
+    1 - Triangle in the scene
+    0 - Offset is 0 as data is tightly packed
+    0 - Offset between instances is 0, we only have one
+    */
 
-        vkCmdBindVertexBuffers(
-            commandBuffers[i], 0, 1, vertexBuffers, offsets); // This call is used to bind vertex buffers to bindings.
+    VkBuffer vertexBuffers[] = {frameVertexBuffer(frame)}; // We only have one vertex buffer
 
-        vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer[i], 0,
+    VkDeviceSize offsets[]
+        = {0}; // This array specifies a one-to-one mapping between the ammount of vertex buffers and the offsets of
+               // each buffer, i.e from where to start reading vertex data from.
+
+    vkCmdBindVertexBuffers(
+        commandBuffer, 0, 1, vertexBuffers, offsets); // This call is used to bind vertex buffers to bindings.
+
+    if (indexedDraws())
+    {
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0,
             VK_INDEX_TYPE_UINT32); // You can only have one idnex buffer, apparently
+    }
 
-        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
-            &descriptorSets[i], 0,
-            nullptr); // They are not unique to graphics pipelines. Hence we specify the bind point to be graphics,
+    uint32_t dynamicOffset = uniformOffset(frame, 0); // this frame's slot 0 in the ring
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+        &descriptorSet, 1,
+        &dynamicOffset); // They are not unique to graphics pipelines. Hence we specify the bind point to be graphics,
 
-        // vkCmdDraw(commandBuffers[i], 3, 1, 0, 0); /**DRAW THE TRIANGLE***/
+    // vkCmdDraw(commandBuffer, 3, 1, 0, 0); /**DRAW THE TRIANGLE***/
 
-        vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    if (depthProjectionEnabled)
+    {
+        /*as many points as the compute shader appended*/
+        vkCmdDrawIndirect(commandBuffer, depthProjector.indirectBuffer(frame), 0, 1, sizeof(VkDrawIndirectCommand));
+        return;
+    }
+    if (gpuCullingEnabled)
+    {
+        culler.recordDraw(commandBuffer, frame); // the draws the culling pass wrote
+        return;
+    }
+    if (octreeEnabled)
+    {
+        octreeStreamer.recordDraws(commandBuffer); // the nodes update() selected
+        return;
+    }
+    for (size_t i = firstChunk; i < endChunk; i++)
+    {
+        if (indexedDraws())
+        {
+            vkCmdDrawIndexed(commandBuffer, drawChunks[i].indexCount, 1, drawChunks[i].firstIndex, 0, 0);
+        }
+        else
+        {
+            vkCmdDraw(commandBuffer, drawChunks[i].indexCount, 1, drawChunks[i].firstIndex, 0);
+        }
+    }
+}
 
-        vkCmdEndRenderPass(commandBuffers[i]); // End render pass
+/*
+Jobs recording the draw list in parallel this frame, 0 : inline recording. Depth projection and GPU culling record a
+few indirect draws and the octree one draw per node, there is nothing to split.
+*/
+uint32_t VulkanDisplayer::recordingJobCount() const
+{
+    if (depthProjectionEnabled || gpuCullingEnabled || octreeEnabled)
+    {
+        return 0;
+    }
+    return static_cast<uint32_t>(std::min<size_t>(secondaryCommandPools[0].size(), drawChunks.size()));
+}
+
+/*
+Cuts the draw list in jobs consecutive ranges, each recorded on a thread of the pool into the secondary command buffer
+of job j. The pool of job j (per frame slot) is only ever used by the thread running job j, so no locking, and it is
+reset by that thread too.
+*/
+void VulkanDisplayer::recordSecondaryCommandBuffers(uint32_t frame, uint32_t imageIndex, uint32_t jobs)
+{
+    VkCommandBufferInheritanceInfo inheritance = {};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.renderPass = renderPass;
+    inheritance.subpass = 0;
+    inheritance.framebuffer = swapChainFramebuffers[imageIndex];
+
+    ThreadPool::global().parallelFor(0, jobs, 1, [&](size_t jobBegin, size_t jobEnd) {
+        for (size_t job = jobBegin; job < jobEnd; job++)
+        {
+            vkResetCommandPool(device, secondaryCommandPools[frame][job], 0);
+            VkCommandBuffer secondary = secondaryCommandBuffers[frame][job];
+
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags
+                = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            beginInfo.pInheritanceInfo = &inheritance;
+            vkBeginCommandBuffer(secondary, &beginInfo);
+            recordDraws(secondary, frame, drawChunks.size() * job / jobs, drawChunks.size() * (job + 1) / jobs);
+            if (colorOverlayEnabled && job == jobs - 1)
+            {
+                colorTexture.recordOverlay(secondary, swapChainExtent); // executed last, over the point cloud
+            }
+            VK_CHECK(vkEndCommandBuffer(secondary));
+        }
+    });
+}
 
-        VK_CHECK(vkEndCommandBuffer(commandBuffers[i]));
+/*
+The draw list of the geometry, see splitDrawList(). A scene cache brings its own, cut when it was written.
+*/
+void VulkanDisplayer::buildDrawList()
+{
+    drawChunks.clear();
+    if (sceneCache)
+    {
+        for (const ChunkCuller::Chunk& chunk : sceneCache->chunks())
+        {
+            drawChunks.push_back({chunk.firstIndex, chunk.indexCount});
+        }
+        return;
+    }
+    /*a point file is drawn straight from the vertex buffer, its chunks are ranges of points*/
+    uint64_t drawnCount = pointFile ? pointFile->pointCount() : indices.size();
+    if (depthProjectionEnabled || drawnCount == 0)
+    {
+        return; // the draw comes from the indirect buffer
     }
+    drawChunks = splitDrawList(static_cast<uint32_t>(drawnCount), topology, drawChunkIndices);
 }
 
 /*
@@ -1453,21 +2479,42 @@ program's life cycle.
 */
 void VulkanDisplayer::cleanup()
 {
+    shaderWatcher.stop(); // no pipeline is being built past this point
 
     vkDeviceWaitIdle(device);
+    deletionQueue.flush();
+    vkDestroyPipeline(device, pendingPipeline.exchange(VK_NULL_HANDLE), nullptr);
+    profiler.flushPending();
+    Logger::global().flush(); // before the reports
+    profiler.printSummary(std::cout);
+    latency.printSummary(std::cout, presentWaitEnabled ? "present" : "GPU done");
+    profiler.destroy();
     cleanupSwapChain();
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    uniformBufferMapped = nullptr;
+    allocator.destroyBuffer(uniformBuffer, uniformBufferMemory);
+    if (geometryUsage == GeometryUsage::Dynamic)
+    {
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            allocator.destroyBuffer(streamingVertexBuffers[i], streamingVertexMemory[i]);
+        }
+    }
+    else
     {
-        vkDestroyBuffer(device, uniformBuffer[i], nullptr);
-        vkFreeMemory(device, uniformBufferMemory[i], nullptr);
+        allocator.destroyBuffer(vertexBuffer, vertexBufferMemory);
+        allocator.destroyBuffer(vertexChunkBuffer, vertexChunkMemory);
     }
+    allocator.destroyBuffer(indexBuffer, indexBufferMemory);
     // vkDestroyBuffer(device, stagingBuffer, nullptr);
     // vkFreeMemory(device, stagingMemory, nullptr);
-    // vkFreeMemory(device, textureImageMemory, nullptr);
+    if (colorOverlayEnabled)
+    {
+        colorTexture.destroy();
+    }
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
@@ -1475,18 +2522,55 @@ void VulkanDisplayer::cleanup()
         vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
         vkDestroyFence(device, inFlightFences[i], nullptr);
     }
-    vkDestroyCommandPool(device, commandPool, nullptr);
+    for (VkCommandPool framePool : frameCommandPools)
+    {
+        vkDestroyCommandPool(device, framePool, nullptr); // frees the per frame command buffers too
+    }
+    for (const std::vector<VkCommandPool>& jobPools : secondaryCommandPools)
+    {
+        for (VkCommandPool jobPool : jobPools)
+        {
+            vkDestroyCommandPool(device, jobPool, nullptr);
+        }
+    }
     vkDestroyPipeline(device, graphicsPipeline, nullptr);
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
     vkDestroyRenderPass(device, renderPass, nullptr);
+    if (depthProjectionEnabled)
+    {
+        depthProjector.destroy();
+    }
+    if (gpuCullingEnabled)
+    {
+        culler.destroy();
+    }
+    if (octreeEnabled)
+    {
+        const OctreeStreamer::Stats& stats = octreeStreamer.stats();
+        std::cout << "Octree : " << stats.drawnNodes << "/" << stats.selectedNodes << " selected nodes drawn, "
+                  << stats.drawnPoints << " points, " << stats.residentNodes << " nodes resident" << std::endl;
+        octreeStreamer.destroy();
+    }
+    uploads.destroy();
+    allocator.printStats(std::cout);
+    allocator.destroy();
+    pipelineCache.save();
+    pipelineCache.destroy();
     vkDestroyDevice(device, nullptr);
     // if (enableValidationLayers)
     // {
     //     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
     // }
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if (surface != VK_NULL_HANDLE)
+    {
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+    }
     vkDestroyInstance(instance, nullptr);
     is_initialized = false;
+    if (isHeadless())
+    {
+        return;
+    }
     /*
     This function will destroy the window and
     it's context upon recieving a valid value